@@ -346,7 +346,7 @@ private:
 
     boost::mutex map_mutex_;
     boost::unordered_map<uint16_t, boost::shared_ptr<Mode> > modes_;
-    boost::unordered_map<uint16_t, boost::function<void()> > mode_allocators_;
+    boost::unordered_map<uint16_t, can::Delegate0<> > mode_allocators_;
 
     boost::shared_ptr<Mode> selected_mode_;
     uint16_t mode_id_;
@@ -30,7 +30,7 @@ namespace canopen{
 
 class PublishFunc{
 public:
-    typedef boost::function<void()> func_type;
+    typedef can::Delegate0<> func_type;
 
     static func_type create(ros::NodeHandle &nh,  const std::string &name, boost::shared_ptr<canopen::Node> node, const std::string &key, bool force){
         boost::shared_ptr<ObjectStorage> s = node->getStorage();
@@ -93,6 +93,25 @@ public:
     }
 };
 
+class XmlRpcSettings : public Settings{
+public:
+    XmlRpcSettings() {}
+    XmlRpcSettings(const XmlRpc::XmlRpcValue &v) : value_(v) {}
+    XmlRpcSettings& operator=(const XmlRpc::XmlRpcValue &v) { value_ = v; return *this; }
+private:
+    virtual bool getRepr(const std::string &n, std::string & repr) const {
+        if(value_.hasMember(n)){
+            std::stringstream sstr;
+            sstr << const_cast< XmlRpc::XmlRpcValue &>(value_)[n]; // does not write since already existing
+            repr = sstr.str();
+            return true;
+        }
+        return false;
+    }
+    XmlRpc::XmlRpcValue value_;
+
+};
+
 class Logger: public DiagGroup<canopen::Layer>{
     const boost::shared_ptr<canopen::Node> node_;
     
@@ -182,6 +201,8 @@ protected:
 
     Timer heartbeat_timer_;
 
+    can::ThreadConfig thread_config_;
+
     boost::atomic<bool> initialized_;
     boost::mutex diag_mutex_;
 
@@ -193,6 +214,7 @@ protected:
     }
     
     void run(){
+        thread_config_.apply("chain");
 
         time_point abs_time = boost::chrono::high_resolution_clock::now();
         while(true){
@@ -279,7 +301,7 @@ protected:
     virtual void handleWrite(LayerStatus &status, const LayerState &current_state) {
         LayerStack::handleWrite(status, current_state);
         if(current_state > Init){
-            for(std::vector<boost::function<void() > >::iterator it = publishers_.begin(); it != publishers_.end(); ++it) (*it)();
+            for(std::vector<PublishFunc::func_type>::iterator it = publishers_.begin(); it != publishers_.end(); ++it) (*it)();
         }
     }
     virtual void handleShutdown(LayerStatus &status){
@@ -367,10 +389,27 @@ protected:
             return false;
         }
 
-        add(boost::make_shared<CANLayer>(interface_, can_device, loopback));
+        XmlRpc::XmlRpcValue bus_params;
+        nh_priv_.getParam("bus", bus_params);
+        add(boost::make_shared<CANLayer>(interface_, can_device, loopback, boost::make_shared<XmlRpcSettings>(bus_params)));
         
         return true;
     }
+    bool read_thread_config(const std::string &ns, can::ThreadConfig &config){
+        XmlRpc::XmlRpcValue params;
+        nh_priv_.getParam(ns, params);
+        if(!config.read(XmlRpcSettings(params), "thread")){
+            ROS_ERROR_STREAM("Thread configuration in '" << nh_priv_.resolveName(ns) << "' is invalid");
+            return false;
+        }
+        return true;
+    }
+    bool setup_threads(){
+        if(nh_priv_.param("lock_memory", false) && !can::lockMemory()){
+            ROS_WARN("Could not lock memory");
+        }
+        return read_thread_config(nh_priv_.getNamespace(), thread_config_);
+    }
     bool setup_sync(){
         ros::NodeHandle sync_nh(nh_priv_,"sync");
         
@@ -414,6 +453,9 @@ protected:
                 ROS_ERROR_STREAM("Initializing sync master failed");
                 return false;
             }
+            can::ThreadConfig sync_config;
+            if(!read_thread_config("sync", sync_config)) return false;
+            sync_->setThreadConfig(sync_config);
             add(sync_);
         }
         return true;
@@ -451,6 +493,10 @@ protected:
 
             hb_sender_.interface = interface_;
 
+            can::ThreadConfig hb_config;
+            if(!read_thread_config("heartbeat", hb_config)) return false;
+            heartbeat_timer_.setThreadConfig(hb_config, "heartbeat");
+
             heartbeat_timer_.start(Timer::TimerDelegate(&hb_sender_, &HeartbeatSender::send) , boost::chrono::duration<double>(1.0/rate), false);
 
             return true;
@@ -458,7 +504,7 @@ protected:
 
     }
     bool setup_nodes(){
-        nodes_.reset(new canopen::LayerGroupNoDiag<canopen::Node>("301 layer"));
+        nodes_.reset(new canopen::TransmitBatchGroup<canopen::Node>("301 layer", interface_));
         add(nodes_);
 
         XmlRpc::XmlRpcValue nodes;
@@ -539,7 +585,13 @@ protected:
             catch(...){
             }
             
-            boost::shared_ptr<ObjectDict>  dict = ObjectDict::fromFile(eds, overlay);
+            boost::shared_ptr<const ObjectDict>  dict;
+            try{
+                dict = ObjectDict::getShared(eds, overlay); // nodes with the same EDS and overlay share it
+            }
+            catch(const canopen::ParseException &e){
+                ROS_ERROR_STREAM(e.what());
+            }
             if(!dict){
                 ROS_ERROR_STREAM("EDS '" << eds << "' could not be parsed");
                 return false;
@@ -563,7 +615,7 @@ protected:
                         bool force = pos != std::string::npos;
                         if(force) obj_name.erase(pos);
 
-                        boost::function<void()> pub = PublishFunc::create(nh_, std::string(merged["name"])+"_"+obj_name, node, obj_name, force);
+                        PublishFunc::func_type pub = PublishFunc::create(nh_, std::string(merged["name"])+"_"+obj_name, node, obj_name, force);
                         if(!pub){
                             ROS_ERROR_STREAM("Could not create publisher for '" << obj_name << "'");
                             return false;
@@ -598,6 +650,15 @@ protected:
                 }
             }
         }
+        can::ThreadConfig::StatusMap threads = can::ThreadConfig::getStatus();
+        for(can::ThreadConfig::StatusMap::const_iterator it = threads.begin(); it != threads.end(); ++it){
+            if(it->second.ok){
+                stat.add("thread " + it->first, it->second.effective);
+            }else{
+                stat.add("thread " + it->first, it->second.effective + " (configuration failed)");
+                stat.mergeSummary(stat.WARN, "Thread configuration failed");
+            }
+        }
     }
 public:
     RosChain(const ros::NodeHandle &nh, const ros::NodeHandle &nh_priv)
@@ -620,7 +681,7 @@ public:
         srv_halt_ = nh_driver.advertiseService("halt",&RosChain::handle_halt, this);
         srv_shutdown_ = nh_driver.advertiseService("shutdown",&RosChain::handle_shutdown, this);
         
-        return setup_bus() && setup_sync() && setup_heartbeat() && setup_nodes();
+        return setup_threads() && setup_bus() && setup_sync() && setup_heartbeat() && setup_nodes();
     }
     virtual ~RosChain(){
         publishers_.clear();
@@ -2,6 +2,7 @@
 #define H_CAN_LAYER
 
 #include <socketcan_interface/threading.h>
+#include <socketcan_interface/statistics.h>
 #include "layer.h"
 
 namespace canopen{
@@ -11,6 +12,7 @@ class CANLayer: public Layer{
     boost::shared_ptr<can::DriverInterface> driver_;
     const std::string device_;
     const bool loopback_;
+    const can::Settings::ConstPtr settings_;
     can::Frame last_error_;
     can::CommInterface::FrameListener::Ptr error_listener_;
     void handleFrame(const can::Frame & msg){
@@ -19,10 +21,16 @@ class CANLayer: public Layer{
         LOG("ID: " << msg.id);
     }
     boost::shared_ptr<boost::thread> thread_;
+    can::ThreadConfig thread_config_;
+    double bus_load_warning_;
+    void run(){
+        thread_config_.apply(device_ + "/driver");
+        driver_->run();
+    }
 
 public:
-    CANLayer(const boost::shared_ptr<can::DriverInterface> &driver, const std::string &device, bool loopback)
-    : Layer(device + " Layer"), driver_(driver), device_(device), loopback_(loopback) { assert(driver_); }
+    CANLayer(const boost::shared_ptr<can::DriverInterface> &driver, const std::string &device, bool loopback, const can::Settings::ConstPtr &settings = can::Settings::ConstPtr())
+    : Layer(device + " Layer"), driver_(driver), device_(device), loopback_(loopback), settings_(settings), bus_load_warning_(0.8) { assert(driver_); }
 
     virtual void handleRead(LayerStatus &status, const LayerState &current_state) {
         if(current_state > Init){
@@ -59,17 +67,55 @@ public:
             report.add("can_error_frame", sstr.str());
 
         }
+        if(s.controller_state != can::State::unknown_controller_state){
+            static const char* names[] = { "unknown", "error active", "error warning", "error passive", "bus off", "stopped" };
+            report.add("controller_state", std::string(names[s.controller_state]));
+            report.add("tx_error_counter", s.tx_error_counter);
+            report.add("rx_error_counter", s.rx_error_counter);
+            if(s.controller_state == can::State::error_warning || s.controller_state == can::State::error_passive){
+                report.warn(std::string("controller is ") + names[s.controller_state]);
+            }
+        }
 
+        can::Statistics stats;
+        if(driver_->getStatistics(stats)){
+            report.add("rx_frames", stats.rx_frames);
+            report.add("rx_bytes", stats.rx_bytes);
+            report.add("rx_invalid", stats.rx_invalid);
+            report.add("tx_frames", stats.tx_frames);
+            report.add("tx_bytes", stats.tx_bytes);
+            report.add("tx_failures", stats.tx_failures);
+            report.add("error_frames", stats.error_frames);
+            for(size_t i = 0; i < can::Statistics::NUM_ERROR_CLASSES; ++i){
+                if(!stats.error_classes[i]) continue;
+                std::string desc;
+                if(!driver_->translateError(1u << i, desc) || desc.empty()) desc = boost::lexical_cast<std::string>(i);
+                report.add("error_frames: " + desc, stats.error_classes[i]);
+            }
+            report.add("frame_rate", stats.frame_rate);
+            report.add("bit_rate", stats.bit_rate);
+            if(stats.bitrate){
+                report.add("bus_load", stats.bus_load);
+                if(stats.bus_load > bus_load_warning_) report.warn("high bus load");
+            }
+            report.add("queue_depth", stats.queue_depth);
+            report.add("max_queue_depth", stats.max_queue_depth);
+            report.add("max_dispatch_latency", stats.max_dispatch_latency);
+        }
     }
     
     virtual void handleInit(LayerStatus &status){
 	if(thread_){
             status.warn("CAN thread already running");
-        } else if(!driver_->init(device_, loopback_)) {
+        } else if(settings_ && !thread_config_.read(*settings_, "thread")) {
+            status.error("CAN thread configuration is invalid");
+        } else if(settings_ && (bus_load_warning_ = settings_->get_optional<double>("bus_load_warning", 0.8)) <= 0) {
+            status.error("bus_load_warning must be positive");
+        } else if(!(settings_ ? driver_->init(device_, loopback_, *settings_) : driver_->init(device_, loopback_))) {
             status.error("CAN init failed");
         } else {
-            thread_.reset(new boost::thread(&can::DriverInterface::run, driver_));
-            error_listener_ = driver_->createMsgListener(can::ErrorHeader(), can::CommInterface::FrameDelegate(this, &CANLayer::handleFrame));
+            thread_.reset(new boost::thread(&CANLayer::run, this));
+            error_listener_ = driver_->createMsgListener(can::ErrorHeader(), can::CommInterface::FrameDelegate(this, &CANLayer::handleFrame), can::background_dispatch);
 	    
 	    if(!can::StateWaiter::wait_for(can::State::ready, driver_.get(), boost::posix_time::seconds(1))){
 		status.error("CAN init timed out");
@@ -96,6 +142,26 @@ public:
     }
 
 };
+
+template<typename T> class TransmitBatchGroup : public LayerGroupNoDiag<T>{
+    const boost::shared_ptr<can::DriverInterface> driver_;
+protected:
+    virtual void handleWrite(LayerStatus &status, const Layer::LayerState &current_state) {
+        bool batched = driver_->beginBatch(); // collect all frames of this pass, send them at once
+        try{
+            LayerGroupNoDiag<T>::handleWrite(status, current_state);
+        }
+        catch(...){
+            if(batched) driver_->commitBatch();
+            throw;
+        }
+        if(batched && !driver_->commitBatch()) status.error("CAN batch write failed");
+    }
+public:
+    TransmitBatchGroup(const std::string &n, const boost::shared_ptr<can::DriverInterface> &driver)
+    : LayerGroupNoDiag<T>(n), driver_(driver) { assert(driver_); }
+};
+
 } // namespace canopen
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <socketcan_interface/interface.h>
 #include <socketcan_interface/dispatcher.h>
+#include <socketcan_interface/thread_config.h>
 #include "exceptions.h"
 #include "layer.h"
 #include "objdict.h"
@@ -18,6 +19,8 @@ typedef boost::chrono::high_resolution_clock::time_point time_point;
 typedef boost::chrono::high_resolution_clock::duration time_duration;
 inline time_point get_abs_time(const time_duration& timeout) { return boost::chrono::high_resolution_clock::now() + timeout; }
 inline time_point get_abs_time() { return boost::chrono::high_resolution_clock::now(); }
+/** @return reception time of frame if provided by the driver, current time otherwise */
+inline time_point get_frame_time(const can::Frame &f) { return f.stamp != time_point() ? f.stamp : get_abs_time(); }
 
 
     
@@ -61,7 +64,7 @@ public:
     
     void init();
     
-    SDOClient(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<ObjectDict> dict, uint8_t node_id)
+    SDOClient(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<const ObjectDict> dict, uint8_t node_id)
     : interface_(interface), storage_(boost::make_shared<ObjectStorage>(dict, node_id, ObjectStorage::ReadDelegate(this, &SDOClient::read), ObjectStorage::WriteDelegate(this, &SDOClient::write)))
     {
     }
@@ -181,7 +184,7 @@ public:
         Unknown = 255, BootUp = 0, Stopped = 4, Operational = 5 , PreOperational = 127
     };
     const uint8_t node_id_;
-    Node(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<ObjectDict> dict, uint8_t node_id, const boost::shared_ptr<SyncCounter> sync = boost::shared_ptr<SyncCounter>());
+    Node(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<const ObjectDict> dict, uint8_t node_id, const boost::shared_ptr<SyncCounter> sync = boost::shared_ptr<SyncCounter>());
     
     const State getState();
     void enterState(const State &s);
@@ -194,7 +197,7 @@ public:
     bool reset_com();
     bool prepare();
     
-    typedef fastdelegate::FastDelegate1<const State&> StateDelegate;
+    typedef can::Delegate1<const State&> StateDelegate;
     typedef can::Listener<const StateDelegate, const State&> StateListener;
 
     StateListener::Ptr addStateListener(const StateDelegate & s){
@@ -290,6 +293,8 @@ public:
 class SyncLayer: public Layer, public SyncCounter{
 public:
     SyncLayer(const SyncProperties &p) : Layer("Sync layer"), SyncCounter(p) {}
+    /** configure the thread that sends the sync messages, if there is any; takes effect on next init */
+    virtual void setThreadConfig(const can::ThreadConfig &config) {}
 };
 
 class Master: boost::noncopyable {
@@ -304,26 +309,7 @@ public:
     };
 };
 
-class Settings
-{
-public:
-    template <typename T> T get_optional(const std::string &n, const T& def) const {
-        std::string repr;
-        if(!getRepr(n, repr)){
-            return def;
-        }
-        return boost::lexical_cast<T>(repr);
-    }
-    template <typename T> bool get(const std::string &n, T& val) const {
-        std::string repr;
-        if(!getRepr(n, repr)) return false;
-        val =  boost::lexical_cast<T>(repr);
-        return true;
-    }
-    virtual ~Settings() {}
-private:
-    virtual bool getRepr(const std::string &n, std::string & repr) const = 0;
-};
+typedef can::Settings Settings;
 
 
 /*template<typename InterfaceType, typename MasterType, typename NodeType> class Bus: boost::noncopyable{
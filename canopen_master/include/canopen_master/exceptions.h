@@ -10,7 +10,14 @@ namespace canopen{
 class Exception : public std::exception {};
 
 class PointerInvalid : public Exception{};
-class ParseException : public Exception{};
+class ParseException : public Exception{
+    std::string what_;
+public:
+    ParseException() {}
+    ParseException(const std::string &w) : what_(w) {}
+    virtual ~ParseException() throw() {}
+    virtual const char* what() const throw() { return what_.empty() ? "parse error" : what_.c_str(); }
+};
 
 class TimeoutException : public std::runtime_error{
 public:
@@ -128,6 +128,9 @@ public:
     : interface_(interface), sync_obj_(0)
     {
     }
+    void setThreadConfig(const can::ThreadConfig &config){
+        thread_config_ = config;
+    }
     void start(LayerStatus &status){
         if(thread_){
             status.warn("Sync thread already running");
@@ -176,6 +179,7 @@ private:
     
     boost::shared_ptr<boost::thread> thread_;
     boost::shared_ptr<can::CommInterface> interface_;
+    can::ThreadConfig thread_config_;
     
     void run();
     SyncObject * sync_obj_;
@@ -232,6 +236,9 @@ public:
             sync_master_->enableSync();
         }
     }
+    virtual void setThreadConfig(const can::ThreadConfig &config) {
+        sync_master_->setThreadConfig(config);
+    }
     virtual void removeNode(void * const ptr)  { 
         boost::mutex::scoped_lock lock(mutex_);
         bool was_empty = nodes_.empty();
@@ -1,11 +1,18 @@
 #ifndef H_OBJDICT
 #define H_OBJDICT
 
-#include <socketcan_interface/FastDelegate.h>
+#include <socketcan_interface/delegates.h>
 #include <boost/unordered_map.hpp>    
 #include <boost/unordered_set.hpp>    
 #include <boost/thread/mutex.hpp>    
 #include <boost/make_shared.hpp>
+#include <boost/atomic.hpp>
+#include <boost/type_traits/is_pod.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
 #include <typeinfo> 
 #include <vector>
 #include "exceptions.h"
@@ -37,16 +44,108 @@ public:
     template<typename T> static TypeGuard create() { return TypeGuard(TypeInfo<T>::id, sizeof(T)); }
 };
 
-class String: public std::vector<char>{
+/**
+ * byte buffer with the interface of std::vector<char>.
+ * Up to INLINE_SIZE bytes (all numeric values and node id offsets) are stored in place,
+ * only larger strings and domains are allocated on the heap.
+ */
+class String{
 public:
-    String() {}
-    String(const std::string &str) : std::vector<char>(str.begin(), str.end()) {}
+    typedef char value_type;
+    typedef char* iterator;
+    typedef const char* const_iterator;
+    typedef size_t size_type;
+    enum { INLINE_SIZE = 16 };
+
+    String() : size_(0), capacity_(INLINE_SIZE), storage_() {}
+    String(const std::string &str) : size_(0), capacity_(INLINE_SIZE), storage_() { assign(str.begin(), str.end()); }
+    template<typename It> String(It first, It last) : size_(0), capacity_(INLINE_SIZE), storage_() { assign(first, last); }
+    String(const String &other) : size_(0), capacity_(INLINE_SIZE), storage_() { assign(other.begin(), other.end()); }
+    String& operator=(const String &other){
+        if(this != &other) assign(other.begin(), other.end());
+        return *this;
+    }
+    ~String(){
+        if(capacity_ > INLINE_SIZE) delete[] storage_.heap;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    char* data() { return capacity_ > INLINE_SIZE ? storage_.heap : storage_.local; }
+    const char* data() const { return capacity_ > INLINE_SIZE ? storage_.heap : storage_.local; }
+    iterator begin() { return data(); }
+    iterator end() { return data() + size_; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size_; }
+    char& front() { return *data(); }
+    const char& front() const { return *data(); }
+    char& operator[](size_t i) { return data()[i]; }
+    const char& operator[](size_t i) const { return data()[i]; }
+    char& at(size_t i) {
+        if(i >= size_) BOOST_THROW_EXCEPTION(std::out_of_range("String::at"));
+        return data()[i];
+    }
+    const char& at(size_t i) const {
+        if(i >= size_) BOOST_THROW_EXCEPTION(std::out_of_range("String::at"));
+        return data()[i];
+    }
+
+    void reserve(size_t n){
+        if(n <= capacity_) return;
+        char *p = new char[n];
+        memcpy(p, data(), size_);
+        if(capacity_ > INLINE_SIZE) delete[] storage_.heap;
+        storage_.heap = p;
+        capacity_ = n;
+    }
+    /** new bytes are zero-initialized */
+    void resize(size_t n){
+        if(n > capacity_) reserve(std::max<size_t>(n, 2 * capacity_));
+        if(n > size_) memset(data() + size_, 0, n - size_);
+        size_ = n;
+    }
+    void clear() { size_ = 0; }
+    template<typename It> void assign(It first, It last){
+        size_t n = std::distance(first, last);
+        if(n > capacity_){
+            String tmp;
+            tmp.reserve(n);
+            std::copy(first, last, tmp.data());
+            swap(tmp);
+        }else{
+            std::copy(first, last, data());
+        }
+        size_ = n;
+    }
+    void swap(String &other){
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(storage_, other.storage_);
+    }
+
+    bool operator==(const String &other) const {
+        return size_ == other.size_ && std::equal(begin(), end(), other.begin());
+    }
+    bool operator!=(const String &other) const {
+        return !(*this == other);
+    }
+
     operator const char * () const {
         return &at(0);
     }
     operator const std::string () const {
         return std::string(begin(), end());
     }
+private:
+    uint32_t size_;
+    uint32_t capacity_; ///< INLINE_SIZE if the bytes are stored in place
+    union Storage{
+        char *heap;
+        char local[INLINE_SIZE];
+    };
+    Storage storage_;
 };
 
 class HoldAny{
@@ -62,6 +161,7 @@ public:
         buffer.resize(sizeof(T));
         *(T*)&(buffer.front()) = t;
     }
+    HoldAny(const String &t): buffer(t), type_guard(TypeGuard::create<String>()), empty(false) {} // the content, not the object
     HoldAny(const std::string &t): type_guard(TypeGuard::create<std::string>()), empty(false){
         if(!type_guard.is_type<std::string>()){
             BOOST_THROW_EXCEPTION(std::bad_cast());
@@ -167,10 +267,10 @@ public:
         Entry() {}
         
         Entry(const Code c, const uint16_t i,  const uint16_t t, const std::string & d, const bool r = true, const bool w = true, bool m = false, const HoldAny def = HoldAny(), const HoldAny init = HoldAny()):
-        obj_code(c), index(i), sub_index(0),data_type(t),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
+        obj_code(c), index(i), sub_index(0),data_type(t),constant(false),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
         
         Entry(const uint16_t i, const uint8_t s, const uint16_t t, const std::string & d, const bool r = true, const bool w = true, bool m = false, const HoldAny def = HoldAny(), const HoldAny init = HoldAny()):
-        obj_code(VAR), index(i), sub_index(s),data_type(t),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
+        obj_code(VAR), index(i), sub_index(s),data_type(t),constant(false),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
         
         operator Key() const { return Key(index, sub_index); }
         const HoldAny & value() const { return !init_val.is_empty() ? init_val : def_val; }
@@ -186,35 +286,67 @@ public:
         return at(k);
     }
     bool has(uint16_t i, uint8_t s) const{
-        return dict_.find(Key(i,s)) != dict_.end();
+        return find(Key(i,s)) != 0;
     }
     bool has(uint16_t i) const{
-        return dict_.find(Key(i)) != dict_.end();
+        return find(Key(i)) != 0;
     }
     bool has(const Key &k) const{
-        return dict_.find(k) != dict_.end();
-    }
-    bool insert(bool is_sub, boost::shared_ptr<const Entry> e){
-        std::pair<boost::unordered_map<Key, boost::shared_ptr<const Entry> >::iterator, bool>  res = dict_.insert(std::make_pair(is_sub?Key(e->index,e->sub_index):Key(e->index),e));
-        return res.second;
+        return find(k) != 0;
     }
-    bool iterate(boost::unordered_map<Key, boost::shared_ptr<const Entry> >::const_iterator &it) const;
+    bool insert(bool is_sub, boost::shared_ptr<const Entry> e);
+
+    typedef std::pair<Key, boost::shared_ptr<const Entry> > value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    /** iterate entries in order of index and sub-index, start with a default-constructed iterator */
+    bool iterate(const_iterator &it) const;
     typedef std::list<std::pair<std::string, std::string> > Overlay;
+    /**
+     * parse EDS/DCF file and apply the overlay (section name -> ParameterValue).
+     * The parsed dictionary gets compiled into the cache directory, keyed by a hash of the file contents,
+     * and is loaded from there as long as the contents do not change.
+     */
     static boost::shared_ptr<ObjectDict> fromFile(const std::string &path, const Overlay &overlay = Overlay());
+    /** like fromFile, but all callers with the same file contents and overlay share one dictionary as long as it is in use */
+    static boost::shared_ptr<const ObjectDict> getShared(const std::string &path, const Overlay &overlay = Overlay());
+    /**
+     * directory for compiled dictionaries, empty to disable caching.
+     * Defaults to $CANOPEN_DICT_CACHE if set, $ROS_HOME/canopen_dicts or ~/.ros/canopen_dicts otherwise.
+     */
+    static void setCacheDirectory(const std::string &dir);
+    static std::string getCacheDirectory();
     const DeviceInfo device_info;
     
-    ObjectDict(const DeviceInfo &info): device_info(info) {}
+    ObjectDict(const DeviceInfo &info): device_info(info), shift_(0) {}
+    /** all entries get copied into one block, for duplicate keys the first entry is kept like in insert */
+    ObjectDict(const DeviceInfo &info, const std::vector<std::pair<bool, boost::shared_ptr<const Entry> > > &entries);
 protected:
     const boost::shared_ptr<const Entry>& at(const Key &key) const{
-        try{
-            return dict_.at(key);
-        }
-        catch(std::out_of_range){
+        const value_type *v = find(key);
+        if(!v){
             BOOST_THROW_EXCEPTION(std::out_of_range("Unable to find " +std::string(key) + " in dictionary"));
         }
+        return v->second;
+    }
+    const value_type* find(const Key &key) const{
+        if(slots_.empty()) return 0;
+        const uint32_t k = key.hash;
+        for(size_t i = uint32_t(k * 2654435761u) >> shift_;; i = (i + 1) & (slots_.size() - 1)){
+            const Slot &s = slots_[i];
+            if(!s.pos) return 0;
+            if(s.key == k) return &dict_[s.pos - 1];
+        }
     }
+    void rehash();
 
-    boost::unordered_map<Key, boost::shared_ptr<const Entry> > dict_;
+    /** open addressing with linear probing, at most half full */
+    struct Slot{
+        uint32_t key;
+        uint32_t pos; ///< position in dict_ + 1, 0 for empty slots
+    };
+    std::vector<value_type> dict_; ///< sorted by key
+    std::vector<Slot> slots_;
+    unsigned int shift_;
 };
 
 std::size_t hash_value(ObjectDict::Key const& k);
@@ -251,15 +383,18 @@ template<typename T> std::ostream& operator<<(std::ostream& stream, const NodeId
 
 class AccessException : public Exception{
     const ObjectDict::Key k_;
+    std::string what_;
 public:
-    AccessException(const ObjectDict::Key &k) : k_(k) {}
+    AccessException(const ObjectDict::Key &k) : k_(k), what_("access denied: " + std::string(k)) {}
+    virtual ~AccessException() throw() {}
+    virtual const char* what() const throw() { return what_.c_str(); }
 };
  
  
 class ObjectStorage{
 public:
-    typedef fastdelegate::FastDelegate2<const ObjectDict::Entry&, String &> ReadDelegate;
-    typedef fastdelegate::FastDelegate2<const ObjectDict::Entry&, const String &> WriteDelegate;
+    typedef can::Delegate2<const ObjectDict::Entry&, String &> ReadDelegate;
+    typedef can::Delegate2<const ObjectDict::Entry&, const String &> WriteDelegate;
     
 protected:
     class Data: boost::noncopyable{
@@ -267,8 +402,42 @@ protected:
         String buffer;
         bool valid;
 
+        boost::atomic<uint64_t> cache; ///< copy of small buffers, read without locking the mutex
+        boost::atomic<bool> cache_valid;
+
         ReadDelegate read_delegate;
         WriteDelegate write_delegate;
+
+        /** update the lock-free copy of the buffer, mutex must be held */
+        void publish(){
+            if(valid && !buffer.empty() && buffer.size() <= sizeof(uint64_t)){
+                uint64_t v = 0;
+                memcpy(&v, &buffer.front(), buffer.size());
+                cache.store(v, boost::memory_order_relaxed);
+                cache_valid.store(true, boost::memory_order_release);
+            }else{
+                cache_valid.store(false, boost::memory_order_release);
+            }
+        }
+        /** publishes the buffer when leaving a locked section, even if a delegate throws */
+        class Publish{
+            Data &data_;
+        public:
+            Publish(Data &data) : data_(data) {}
+            ~Publish() { data_.publish(); }
+        };
+        template<typename T> bool load(T &val, const boost::true_type&) const {
+            if(!cache_valid.load(boost::memory_order_acquire)) return false;
+            uint64_t v = cache.load(boost::memory_order_relaxed);
+            memcpy(&val, &v, sizeof(T));
+            return true;
+        }
+        template<typename T> bool load(T &val, const boost::false_type&) const {
+            return false; // strings and domains always take the locked path
+        }
+        template<typename T> bool load(T &val) const {
+            return load(val, boost::integral_constant<bool, boost::is_pod<T>::value && sizeof(T) <= sizeof(uint64_t)>());
+        }
         
         template <typename T> T & access(){
             if(!valid){
@@ -290,14 +459,15 @@ protected:
         size_t size() { boost::mutex::scoped_lock lock(mutex); return buffer.size(); }
         
         template<typename T> Data(const ObjectDict::Key &k, const boost::shared_ptr<const ObjectDict::Entry> &e, const T &val, const ReadDelegate &r, const WriteDelegate &w)
-        : valid(false), read_delegate(r), write_delegate(w), type_guard(TypeGuard::create<T>()), entry(e), key(k){
+        : valid(false), cache(0), cache_valid(false), read_delegate(r), write_delegate(w), type_guard(TypeGuard::create<T>()), entry(e), key(k){
             assert(!r.empty());
             assert(!w.empty());
             assert(e);
             allocate<T>() = val;
+            publish();
         }
         Data(const ObjectDict::Key &k, const boost::shared_ptr<const ObjectDict::Entry> &e, const TypeGuard &t, const ReadDelegate &r, const WriteDelegate &w)
-        : valid(false), read_delegate(r), write_delegate(w), type_guard(t), entry(e), key(k){
+        : valid(false), cache(0), cache_valid(false), read_delegate(r), write_delegate(w), type_guard(t), entry(e), key(k){
             assert(!r.empty());
             assert(!w.empty());
             assert(e);
@@ -310,7 +480,11 @@ protected:
             if(w) write_delegate = w;
         }
         template<typename T> const T get(bool cached) {
+            T val;
+            if(entry->readable && (cached || entry->constant) && load(val)) return val;
+
             boost::mutex::scoped_lock lock(mutex);
+            Publish publish(*this);
             
             if(!entry->readable){
                 BOOST_THROW_EXCEPTION( AccessException(key) );
@@ -326,6 +500,7 @@ protected:
         }
         template<typename T>  void set(const T &val) {
             boost::mutex::scoped_lock lock(mutex);
+            Publish publish(*this);
             
             if(!entry->writable){
                 if(access<T>() != val){
@@ -337,7 +512,11 @@ protected:
             }
         }
         template<typename T>  void set_cached(const T &val) {
+            T cur;
+            if(load(cur) && !(val != cur)) return;
+
             boost::mutex::scoped_lock lock(mutex);
+            Publish publish(*this);
             if(!valid || val != access<T>() ){
                 if(!entry->writable){
                         BOOST_THROW_EXCEPTION( AccessException(key) );
@@ -0,0 +1,95 @@
+#ifndef H_CANOPEN_SIM_SLAVE
+#define H_CANOPEN_SIM_SLAVE
+
+#include <socketcan_interface/virtual_bus.h>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <vector>
+#include <cstring>
+
+namespace canopen{
+
+/**
+ * simulated CANopen slave on a can::VirtualBus for tests and benchmarks.
+ * Implements NMT (a heartbeat is sent on every state change), heartbeat producer (0x1017),
+ * expedited and segmented SDO server, synchronous TPDOs and RPDOs.
+ * PDO parameters are taken from the objects 0x1400-0x1BFF, which are evaluated on NMT start;
+ * COB-IDs default to the predefined connection set.
+ * The object values can be scripted with set/get and a sync delegate that gets called before the TPDOs are sent.
+ */
+class SimulatedSlave : public can::VirtualBus::Port{
+public:
+    typedef can::Delegate1<SimulatedSlave&> SyncDelegate;
+    enum State{
+        BootUp = 0, Stopped = 4, Operational = 5 , PreOperational = 127
+    };
+
+    SimulatedSlave(const can::VirtualBus::Ptr &bus, uint8_t node_id);
+    virtual ~SimulatedSlave();
+
+    const uint8_t node_id_;
+    bool strict_; ///< abort SDO uploads of objects that were never set, otherwise they read as 4 zero bytes
+
+    template<typename T> void set(uint16_t index, uint8_t sub_index, const T &val){
+        std::vector<uint8_t> buffer(sizeof(T));
+        memcpy(&buffer.front(), &val, sizeof(T));
+        setRaw(index, sub_index, buffer);
+    }
+    template<typename T> T get(uint16_t index, uint8_t sub_index){
+        T val = T();
+        std::vector<uint8_t> buffer = getRaw(index, sub_index);
+        if(!buffer.empty()) memcpy(&val, &buffer.front(), std::min(buffer.size(), sizeof(T)));
+        return val;
+    }
+    void setRaw(uint16_t index, uint8_t sub_index, const std::vector<uint8_t> &buffer);
+    std::vector<uint8_t> getRaw(uint16_t index, uint8_t sub_index);
+
+    void setSyncDelegate(const SyncDelegate &d);
+    State getState();
+
+    /** announce the slave with a boot-up message */
+    void boot();
+
+    virtual void deliver(const can::Frame &msg, bool own);
+    virtual void tick(const can::VirtualBus::TimePoint &now);
+private:
+    typedef std::map<uint32_t, std::vector<uint8_t> > ObjectMap;
+    static uint32_t key(uint16_t index, uint8_t sub_index) { return (uint32_t(index) << 8) | sub_index; }
+
+    struct PDO{
+        can::Header header;
+        uint8_t transmission_type;
+        std::vector<uint32_t> mapping;
+    };
+
+    const can::VirtualBus::Ptr bus_;
+    boost::mutex mutex_;
+    ObjectMap objects_;
+    State state_;
+    SyncDelegate sync_delegate_;
+    size_t sync_counter_;
+    std::vector<PDO> tpdos_;
+    std::vector<PDO> rpdos_;
+    can::VirtualBus::TimePoint next_heartbeat_;
+
+    // SDO transfer state
+    uint32_t sdo_key_;
+    std::vector<uint8_t> sdo_buffer_;
+    size_t sdo_offset_;
+    bool sdo_toggle_;
+
+    void send(const can::Frame &msg) { bus_->submit(msg, this); }
+    void sendHeartbeat();
+    void switchState(State s);
+    void configurePDOs(uint16_t com_base, uint16_t map_base, uint16_t default_id, std::vector<PDO> &pdos);
+    uint32_t getU32(uint16_t index, uint8_t sub_index, uint32_t def);
+    void abort(uint16_t index, uint8_t sub_index, uint32_t reason);
+
+    void handleNMT(const can::Frame &msg);
+    void handleSDO(const can::Frame &msg);
+    void handleSync();
+    void handleRPDO(const PDO &pdo, const can::Frame &msg);
+};
+
+} // namespace canopen
+#endif
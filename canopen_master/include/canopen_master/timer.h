@@ -1,17 +1,19 @@
 #ifndef H_CANOPEN_TIMER
 #define H_CANOPEN_TIMER
 
-#include <socketcan_interface/FastDelegate.h>
+#include <socketcan_interface/delegates.h>
+#include <socketcan_interface/thread_config.h>
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/asio/high_resolution_timer.hpp>
+#include <boost/bind.hpp>
 
 namespace canopen{
 
 class Timer{
 public:
-    typedef fastdelegate::FastDelegate0<bool> TimerDelegate;
-    Timer():work(io), timer(io),thread(fastdelegate::FastDelegate0<size_t>(&io, &boost::asio::io_service::run)){
+    typedef can::Delegate0<bool> TimerDelegate;
+    Timer():work(io), timer(io),thread(can::Delegate0<size_t>(&io, &boost::asio::io_service::run)){
     }
     
     void stop(){
@@ -24,13 +26,17 @@ public:
         period = boost::chrono::duration_cast<boost::chrono::high_resolution_clock::duration>(dur);
         if(start_now){
             timer.expires_from_now(period);
-            timer.async_wait(fastdelegate::FastDelegate1<const boost::system::error_code&>(this, &Timer::handler));
+            timer.async_wait(can::Delegate1<const boost::system::error_code&>(this, &Timer::handler));
         }
     }
     void restart(){
         boost::mutex::scoped_lock lock(mutex);
         timer.expires_from_now(period);
-        timer.async_wait(fastdelegate::FastDelegate1<const boost::system::error_code&>(this, &Timer::handler));
+        timer.async_wait(can::Delegate1<const boost::system::error_code&>(this, &Timer::handler));
+    }
+    /** apply thread configuration to the timer thread */
+    void setThreadConfig(const can::ThreadConfig &config, const std::string &name){
+        io.post(boost::bind(&can::ThreadConfig::apply, config, name));
     }
     const  boost::chrono::high_resolution_clock::duration & getPeriod(){
         boost::mutex::scoped_lock lock(mutex);
@@ -51,7 +57,7 @@ private:
             boost::mutex::scoped_lock lock(mutex);
             if(delegate && delegate()){
                 timer.expires_at(timer.expires_at() + period);
-                timer.async_wait(fastdelegate::FastDelegate1<const boost::system::error_code&>(this, &Timer::handler));
+                timer.async_wait(can::Delegate1<const boost::system::error_code&>(this, &Timer::handler));
             }
             
         }
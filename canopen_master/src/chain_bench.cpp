@@ -0,0 +1,306 @@
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+#include <canopen_master/can_layer.h>
+#include <canopen_master/master.h>
+#include <canopen_master/sim_slave.h>
+
+using namespace canopen;
+
+// drive model: position follows the target and the drive reports "operation enabled"
+void follow_target(SimulatedSlave &slave){
+    slave.set<int32_t>(0x6064, 0, slave.get<int32_t>(0x607A, 0));
+    slave.set<uint16_t>(0x6041, 0, 0x0237);
+}
+
+void read_cached(std::vector<ObjectStorage::Entry<uint16_t> > &entries, boost::atomic<bool> &running){
+    while(running){
+        uint16_t val;
+        for(size_t i = 0; i < entries.size(); ++i) entries[i].get_cached(val);
+    }
+}
+
+// SYNC is sent by the benchmark loop in bus time, so the layer only counts the nodes
+class BenchSyncLayer : public SyncLayer{
+    virtual void handleRead(LayerStatus &status, const LayerState &current_state) {}
+    virtual void handleWrite(LayerStatus &status, const LayerState &current_state) {}
+    virtual void handleDiag(LayerReport &report) {}
+    virtual void handleInit(LayerStatus &status) {}
+    virtual void handleShutdown(LayerStatus &status) {}
+    virtual void handleHalt(LayerStatus &status) {}
+    virtual void handleRecover(LayerStatus &status) {}
+public:
+    BenchSyncLayer(const SyncProperties &p) : SyncLayer(p) {}
+    virtual void addNode(void * const ptr) {}
+    virtual void removeNode(void * const ptr) {}
+};
+
+// transmits the frames in bus time while the master blocks on its transfers, i.e. during init and shutdown
+class BusPump{
+    can::VirtualBus::Ptr bus_;
+    boost::atomic<bool> running_;
+    boost::thread thread_;
+    void run(){
+        while(running_){
+            if(!bus_->step()){
+                bus_->advance(boost::chrono::milliseconds(1)); // idle bus
+                boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+            }
+        }
+    }
+public:
+    BusPump(const can::VirtualBus::Ptr &bus) : bus_(bus), running_(false) {}
+    ~BusPump() { stop(); }
+    void start(){
+        if(!running_.exchange(true)) thread_ = boost::thread(&BusPump::run, this);
+    }
+    void stop(){
+        running_ = false;
+        if(thread_.joinable()) thread_.join();
+    }
+};
+
+// measures the time from SYNC to each TPDO on the bus
+class SyncProbe : public can::VirtualBus::Port{
+    boost::mutex mutex_;
+    const size_t nodes_;
+    can::VirtualBus::TimePoint sync_;
+public:
+    static const size_t NUM_BUCKETS = 5;
+    size_t buckets[NUM_BUCKETS]; // < 1, 2, 5, 10, >= 10 ms
+    size_t count;
+    can::VirtualBus::Duration max;
+
+    SyncProbe(size_t nodes) : nodes_(nodes), count(0), max(can::VirtualBus::Duration::zero()) {
+        for(size_t i = 0; i < NUM_BUCKETS; ++i) buckets[i] = 0;
+    }
+    virtual void deliver(const can::Frame &msg, bool own){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(msg.id == 0x80){
+            sync_ = msg.stamp;
+        }else if(msg.id > 0x180 && msg.id <= 0x180 + nodes_ && sync_ != can::VirtualBus::TimePoint()){
+            can::VirtualBus::Duration d = msg.stamp - sync_;
+            double ms = boost::chrono::duration<double, boost::milli>(d).count();
+            size_t i = ms < 1 ? 0 : ms < 2 ? 1 : ms < 5 ? 2 : ms < 10 ? 3 : 4;
+            ++buckets[i];
+            ++count;
+            if(d > max) max = d;
+        }
+    }
+    void print(){
+        boost::mutex::scoped_lock lock(mutex_);
+        const char *labels[NUM_BUCKETS] = {"< 1 ms", "< 2 ms", "< 5 ms", "< 10 ms", ">= 10 ms"};
+        std::cout << "SYNC to TPDO (" << count << " PDOs, max " << boost::chrono::duration<double, boost::milli>(max).count() << " ms):" << std::endl;
+        for(size_t i = 0; i < NUM_BUCKETS; ++i) std::cout << "  " << labels[i] << ": " << buckets[i] << std::endl;
+    }
+};
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        std::cout << "usage: "<< argv[0] << " EDS [NODES [CYCLES [SYNC_MS [BITRATE]]]]" << std::endl;
+        return 1;
+    }
+    size_t num_nodes = argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 32;
+    size_t cycles = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 1000;
+    unsigned int sync_ms = argc > 4 ? boost::lexical_cast<unsigned int>(argv[4]) : 10;
+    unsigned int bitrate = argc > 5 ? boost::lexical_cast<unsigned int>(argv[5]) : 1000000;
+
+    if(num_nodes < 1 || num_nodes > 127 || sync_ms < 1){
+        std::cout << "invalid arguments" << std::endl;
+        return 1;
+    }
+
+    // one synchronous TPDO and RPDO per drive; heartbeats are off, because the master checks them against the real clock
+    ObjectDict::Overlay overlay;
+    overlay.push_back(std::make_pair("1017", "0"));
+    overlay.push_back(std::make_pair("1800sub2", "1"));
+    overlay.push_back(std::make_pair("1A00sub0", "2"));
+    overlay.push_back(std::make_pair("1A00sub1", "0x60410010"));
+    overlay.push_back(std::make_pair("1A00sub2", "0x60640020"));
+    overlay.push_back(std::make_pair("1400sub2", "1"));
+    overlay.push_back(std::make_pair("1600sub0", "2"));
+    overlay.push_back(std::make_pair("1600sub1", "0x60400010"));
+    overlay.push_back(std::make_pair("1600sub2", "0x607A0020"));
+
+    // dictionary startup: text parser vs. compiled cache vs. one shared instance for all nodes
+    std::vector<boost::shared_ptr<const ObjectDict> > dicts;
+    try{
+        std::string cache = ObjectDict::getCacheDirectory();
+        ObjectDict::setCacheDirectory("");
+        boost::shared_ptr<ObjectDict> plain = ObjectDict::fromFile(argv[1]);
+        for(uint16_t i = 1; i < 4; ++i){ // other PDOs must not map the same objects
+            if(plain->has(0x1600 + i, 0)) overlay.push_back(std::make_pair((boost::format("%04X") % (0x1600 + i)).str() + "sub0", "0"));
+            if(plain->has(0x1A00 + i, 0)) overlay.push_back(std::make_pair((boost::format("%04X") % (0x1A00 + i)).str() + "sub0", "0"));
+        }
+        time_point start = get_abs_time();
+        ObjectDict::fromFile(argv[1], overlay);
+        double parse_ms = boost::chrono::duration<double, boost::milli>(get_abs_time() - start).count();
+        ObjectDict::setCacheDirectory(cache);
+
+        ObjectDict::fromFile(argv[1], overlay); // compile, if not cached yet
+        start = get_abs_time();
+        ObjectDict::fromFile(argv[1], overlay);
+        double cached_ms = boost::chrono::duration<double, boost::milli>(get_abs_time() - start).count();
+
+        start = get_abs_time();
+        for(size_t i = 1; i <= num_nodes; ++i){
+            dicts.push_back(ObjectDict::getShared(argv[1], overlay));
+        }
+        double shared_ms = boost::chrono::duration<double, boost::milli>(get_abs_time() - start).count();
+
+        std::cout << "dictionary: parsed in " << parse_ms << " ms, loaded from cache in " << cached_ms << " ms";
+        if(cache.empty()) std::cout << " (caching disabled)";
+        std::cout << ", " << num_nodes << " nodes shared it in " << shared_ms << " ms" << std::endl;
+    }
+    catch(...){
+        std::cout << "could not load " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // virtual time: the bus only advances when the benchmark steps it, so the cycles do not depend on the host scheduler
+    can::VirtualBus::Ptr bus = boost::make_shared<can::VirtualBus>(bitrate, false);
+    boost::shared_ptr<can::VirtualInterface> driver = boost::make_shared<can::VirtualInterface>(bus);
+    BusPump pump(bus);
+
+    std::vector<boost::shared_ptr<SimulatedSlave> > slaves;
+    for(size_t i = 1; i <= num_nodes; ++i){
+        boost::shared_ptr<SimulatedSlave> slave = boost::make_shared<SimulatedSlave>(bus, i);
+        slave->setSyncDelegate(SimulatedSlave::SyncDelegate(&follow_target));
+        // the master maps the PDOs, but only writes the communication parameters if they are marked as changed
+        slave->set<uint8_t>(0x1400, 2, 1);
+        slave->set<uint8_t>(0x1800, 2, 1);
+        slaves.push_back(slave);
+    }
+
+    LayerStack stack("bench");
+    stack.add(boost::make_shared<CANLayer>(driver, "vbus", false));
+
+    SyncProperties sync_properties(can::MsgHeader(0x80), sync_ms, 0);
+    boost::shared_ptr<SyncLayer> sync = boost::make_shared<BenchSyncLayer>(sync_properties);
+    stack.add(sync);
+
+    boost::shared_ptr<LayerGroupNoDiag<Node> > nodes = boost::make_shared<LayerGroupNoDiag<Node> >("nodes");
+    std::vector<boost::shared_ptr<Node> > node_list;
+    time_point start;
+    LayerStatus init_status;
+    pump.start();
+    try{
+        for(size_t i = 1; i <= num_nodes; ++i){
+            node_list.push_back(boost::make_shared<Node>(driver, dicts[i-1], i, sync));
+            nodes->add(node_list.back());
+        }
+        stack.add(nodes);
+
+        start = get_abs_time();
+        stack.init(init_status);
+    }
+    catch(const std::exception &e){
+        std::cout << "setup failed: " << e.what() << std::endl;
+        LayerStatus s;
+        stack.shutdown(s);
+        return 1;
+    }
+    double init_s = boost::chrono::duration<double>(get_abs_time() - start).count();
+    if(!init_status.bounded<LayerStatus::Warn>()){
+        std::cout << "init failed: " << init_status.reason() << std::endl;
+        LayerStatus s;
+        stack.shutdown(s);
+        return 1;
+    }
+    pump.stop();
+    std::cout << num_nodes << " nodes initialized in " << init_s << " s (real time), " << bus->getStats().frames << " frames" << std::endl;
+
+    // objects of a motor layer: status word, position, control word and target of each drive
+    std::vector<ObjectStorage::Entry<uint16_t> > status_words, control_words;
+    std::vector<ObjectStorage::Entry<int32_t> > positions, targets;
+    try{
+        for(size_t i = 0; i < num_nodes; ++i){
+            boost::shared_ptr<ObjectStorage> storage = node_list[i]->getStorage();
+            status_words.push_back(storage->entry<uint16_t>(0x6041));
+            positions.push_back(storage->entry<int32_t>(0x6064));
+            control_words.push_back(storage->entry<uint16_t>(0x6040));
+            targets.push_back(storage->entry<int32_t>(0x607A));
+        }
+    }
+    catch(...){
+        status_words.clear();
+        targets.clear();
+    }
+
+    SyncProbe probe(num_nodes);
+    bus->attach(&probe);
+    bus->resetStats();
+
+    // each cycle: process the received PDOs, send new targets as RPDOs and SYNC, then let one period pass on the bus
+    const can::VirtualBus::Duration period = boost::chrono::milliseconds(sync_ms);
+    const can::Frame sync_frame(sync_properties.header_, 0);
+    size_t errors = 0;
+    can::VirtualBus::TimePoint bus_start = bus->now();
+    start = get_abs_time();
+    for(size_t i = 0; i < cycles; ++i){
+        LayerStatus s;
+        if(i > 0) stack.read(s); // nothing was received before the first SYNC
+        for(size_t n = 0; n < targets.size(); ++n){
+            control_words[n].set_cached(0x000f);
+            targets[n].set_cached(int32_t(i));
+        }
+        stack.write(s);
+        if(!s.bounded<LayerStatus::Warn>()) ++errors;
+        driver->send(sync_frame);
+        bus->advance(period);
+    }
+    double real_s = boost::chrono::duration<double>(get_abs_time() - start).count();
+    double elapsed = boost::chrono::duration<double>(bus->now() - bus_start).count();
+    can::VirtualBus::Stats stats = bus->getStats();
+
+    // cached object access of a motor layer in every cycle
+    for(size_t i = 0; i < status_words.size(); ++i){ // all values must be available, e.g. no PDO was received if the cycles were skipped
+        uint16_t sw;
+        int32_t pos;
+        if(!status_words[i].get_cached(sw) || !positions[i].get_cached(pos) || !control_words[i].set_cached(0x000f)){
+            std::cout << "cached access skipped, objects of node " << i + 1 << " are not available" << std::endl;
+            status_words.clear();
+        }
+    }
+    if(!status_words.empty()){
+        boost::atomic<bool> reading(false);
+        for(int concurrent = 0; concurrent < 2; ++concurrent){
+            boost::thread reader;
+            if(concurrent){ // e.g. a publisher thread that reads the same objects
+                reading = true;
+                reader = boost::thread(boost::bind(&read_cached, boost::ref(status_words), boost::ref(reading)));
+            }
+            const size_t rounds = 100000;
+            size_t sum = 0;
+            time_point access_start = get_abs_time();
+            for(size_t r = 0; r < rounds; ++r){
+                for(size_t i = 0; i < num_nodes; ++i){
+                    sum += status_words[i].get_cached();
+                    sum += positions[i].get_cached();
+                    control_words[i].set_cached(0x000f);
+                }
+            }
+            double ns = boost::chrono::duration<double, boost::nano>(get_abs_time() - access_start).count() / rounds;
+            reading = false;
+            if(reader.joinable()) reader.join();
+            std::cout << "cached access" << (concurrent ? " with concurrent reader: " : ": ") << ns << " ns per cycle for " << num_nodes
+                      << " nodes (" << ns / (3 * num_nodes) << " ns per access)" << (sum ? "" : " ") << std::endl;
+        }
+    }
+
+    bus->detach(&probe);
+    pump.start();
+    LayerStatus shutdown_status;
+    stack.shutdown(shutdown_status);
+    pump.stop();
+
+    std::cout << cycles << " cycles in " << elapsed << " s of bus time (simulated in " << real_s << " s), " << errors << " with errors" << std::endl;
+    std::cout << stats.frames << " frames (" << stats.frames / elapsed << " frames/s), bus load "
+              << 100.0 * boost::chrono::duration<double>(stats.busy).count() / elapsed << " %, max. pending " << stats.max_pending << std::endl;
+    if(stats.frames){
+        std::cout << "frame latency: mean " << boost::chrono::duration<double, boost::micro>(stats.total_latency).count() / stats.frames
+                  << " us, max " << boost::chrono::duration<double, boost::micro>(stats.max_latency).count() << " us" << std::endl;
+    }
+    probe.print();
+    return errors ? 1 : 0;
+}
@@ -103,7 +103,7 @@ EMCYHandler::EMCYHandler(const boost::shared_ptr<can::CommInterface> interface,
         storage_->entry(num_errors_, 0x1003,0);
         
         EMCYid emcy_id(storage_->entry<uint32_t>(0x1014).get_cached());
-        emcy_listener_ = interface->createMsgListener( emcy_id.header(), can::CommInterface::FrameDelegate(this, &EMCYHandler::handleEMCY));
+        emcy_listener_ = interface->createMsgListener( emcy_id.header(), can::CommInterface::FrameDelegate(this, &EMCYHandler::handleEMCY), can::background_dispatch);
     }
     catch(...){
        // pass
@@ -9,6 +9,7 @@ std::size_t hash_value(can::Header const& h){ return (unsigned int)(h);}
 using namespace canopen;
 
 void IPCSyncMaster::run() {
+    thread_config_.apply("sync");
     boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock = sync_obj_->waiter.get_lock();
     boost::posix_time::ptime abs_time = boost::get_system_time();
     
@@ -27,7 +27,7 @@ struct NMTcommand{
 
 #pragma pack(pop) /* pop previous alignment from stack */
 
-Node::Node(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<ObjectDict> dict, uint8_t node_id, const boost::shared_ptr<SyncCounter> sync)
+Node::Node(const boost::shared_ptr<can::CommInterface> interface, const boost::shared_ptr<const ObjectDict> dict, uint8_t node_id, const boost::shared_ptr<SyncCounter> sync)
 : Layer("Node 301"), node_id_(node_id), interface_(interface), sync_(sync) , state_(Unknown), sdo_(interface, dict, node_id), emcy_(interface, getStorage()), pdo_(interface){
     try{
         getStorage()->entry(heartbeat_, 0x1017);
@@ -110,7 +110,7 @@ void Node::switchState(const uint8_t &s){
 }
 void Node::handleNMT(const can::Frame & msg){
     boost::mutex::scoped_lock cond_lock(cond_mutex);
-    heartbeat_timeout_ = boost::chrono::high_resolution_clock::now() + boost::chrono::milliseconds(3*heartbeat_.get_cached());
+    heartbeat_timeout_ = get_frame_time(msg) + boost::chrono::milliseconds(3*heartbeat_.get_cached());
     assert(msg.dlc == 1);
     switchState(msg.data[0]);
     cond_lock.unlock();
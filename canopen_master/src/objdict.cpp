@@ -1,10 +1,20 @@
 #include <canopen_master/objdict.h>
 #include <socketcan_interface/string.h>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/ini_parser.hpp>
-#include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace canopen{
     size_t hash_value(ObjectDict::Key const& k)  { return k.hash;  }
@@ -42,6 +52,7 @@ ObjectDict::Key::operator std::string() const{
 }
 void ObjectStorage::Data::init(){
     boost::mutex::scoped_lock lock(mutex);
+    Publish publish(*this);
 
     if(entry->init_val.is_empty()) return;
 
@@ -56,6 +67,7 @@ void ObjectStorage::Data::init(){
 }
 void ObjectStorage::Data::force_write(){
     boost::mutex::scoped_lock lock(mutex);
+    Publish publish(*this);
     
     if(entry->writable){
         if(!valid && entry->readable){
@@ -68,6 +80,7 @@ void ObjectStorage::Data::force_write(){
 
 void ObjectStorage::Data::reset(){
     boost::mutex::scoped_lock lock(mutex);
+    Publish publish(*this);
     if(!entry->def_val.is_empty() && entry->def_val.type() == type_guard){
         buffer = entry->def_val.data();
         valid = true;
@@ -76,13 +89,193 @@ void ObjectStorage::Data::reset(){
     }
 }
 
-bool ObjectDict::iterate(boost::unordered_map<Key, boost::shared_ptr<const Entry> >::const_iterator &it) const{
-    if(it != boost::unordered_map<Key, boost::shared_ptr<const Entry> >::const_iterator()){
+bool ObjectDict::iterate(const_iterator &it) const{
+    if(it != const_iterator()){
         ++it;
     }else it = dict_.begin();
     return it != dict_.end();
 }
-void set_access( ObjectDict::Entry &entry, const std::string &access){
+
+struct KeyLess{
+    bool operator()(const ObjectDict::value_type &v, const ObjectDict::Key &k) const { return v.first.hash < k.hash; }
+};
+
+bool ObjectDict::insert(bool is_sub, boost::shared_ptr<const Entry> e){
+    Key key = is_sub ? Key(e->index, e->sub_index) : Key(e->index);
+    if(find(key)) return false;
+
+    std::vector<value_type> entries;
+    entries.reserve(dict_.size() + 1);
+    const_iterator pos = std::lower_bound(dict_.begin(), dict_.end(), key, KeyLess());
+    for(const_iterator it = dict_.begin(); it != pos; ++it) entries.push_back(*it);
+    entries.push_back(value_type(key, e));
+    for(const_iterator it = pos; it != dict_.end(); ++it) entries.push_back(*it);
+    dict_.swap(entries);
+    rehash();
+    return true;
+}
+
+ObjectDict::ObjectDict(const DeviceInfo &info, const std::vector<std::pair<bool, boost::shared_ptr<const Entry> > > &entries)
+: device_info(info), shift_(0) {
+    std::vector<std::pair<size_t, size_t> > order; // key, position in entries
+    order.reserve(entries.size());
+    for(size_t i = 0; i < entries.size(); ++i){
+        const Entry &e = *entries[i].second;
+        order.push_back(std::make_pair((entries[i].first ? Key(e.index, e.sub_index) : Key(e.index)).hash, i));
+    }
+    std::sort(order.begin(), order.end());
+
+    boost::shared_ptr<std::vector<Entry> > block = boost::make_shared<std::vector<Entry> >();
+    block->reserve(order.size());
+    dict_.reserve(order.size());
+    for(std::vector<std::pair<size_t, size_t> >::iterator it = order.begin(); it != order.end(); ++it){
+        if(!dict_.empty() && dict_.back().first.hash == it->first) continue; // duplicate, first one wins
+        block->push_back(*entries[it->second].second);
+        Key key = (it->first & 0xFFFF) == 0xFFFF ? Key(it->first >> 16) : Key(it->first >> 16, it->first & 0xFF);
+        dict_.push_back(value_type(key, boost::shared_ptr<const Entry>(block, &block->back()))); // shares ownership of the block
+    }
+    rehash();
+}
+
+void ObjectDict::rehash(){
+    unsigned int bits = 4;
+    while((size_t(1) << bits) < 2 * dict_.size()) ++bits;
+    Slot empty = { 0, 0 };
+    slots_.assign(size_t(1) << bits, empty);
+    shift_ = 32 - bits;
+    for(size_t p = 0; p < dict_.size(); ++p){
+        const uint32_t k = dict_[p].first.hash;
+        size_t i = uint32_t(k * 2654435761u) >> shift_;
+        while(slots_[i].pos) i = (i + 1) & (slots_.size() - 1);
+        slots_[i].key = k;
+        slots_[i].pos = p + 1;
+    }
+}
+void parse_error(size_t line, const std::string &msg){
+    std::stringstream buf;
+    if(line) buf << "line " << line << ": ";
+    buf << msg;
+    throw ParseException(buf.str());
+}
+
+/** trimmed piece of the source or of an overlay value, does not own the characters */
+struct EDSText{
+    const char *begin;
+    const char *end;
+    size_t line; ///< 0 if not in the source
+
+    EDSText() : begin(0), end(0), line(0) {}
+    EDSText(const char *b, const char *e, size_t l) : begin(b), end(e), line(l) {}
+    explicit EDSText(const std::string &s) : begin(s.data()), end(s.data() + s.size()), line(0) {}
+    explicit EDSText(const char *s) : begin(s), end(s + strlen(s)), line(0) {}
+
+    size_t size() const { return end - begin; }
+    bool empty() const { return begin == end; }
+    std::string str() const { return std::string(begin, end); }
+    bool operator==(const char *s) const { return size() == strlen(s) && memcmp(begin, s, size()) == 0; }
+    bool iequals(const EDSText &other) const { return size() == other.size() && strncasecmp(begin, other.begin, size()) == 0; }
+    bool starts_with(const char *prefix) const { size_t n = strlen(prefix); return size() >= n && memcmp(begin, prefix, n) == 0; }
+    bool istarts_with(const char *prefix) const { size_t n = strlen(prefix); return size() >= n && strncasecmp(begin, prefix, n) == 0; }
+
+    static EDSText trim(const char *b, const char *e, size_t line){
+        while(b != e && isspace((unsigned char)*b)) ++b;
+        while(e != b && isspace((unsigned char)e[-1])) --e;
+        return EDSText(b, e, line);
+    }
+};
+
+struct EDSTextIHash{
+    size_t operator()(const EDSText &t) const{
+        size_t h = 0;
+        for(const char *c = t.begin; c != t.end; ++c) boost::hash_combine(h, tolower((unsigned char)*c));
+        return h;
+    }
+};
+struct EDSTextIEqual{
+    bool operator()(const EDSText &a, const EDSText &b) const { return a.iequals(b); }
+};
+
+/**
+ * INI tokenizer for EDS/DCF files, sections and keys are looked up case-insensitively.
+ * The source gets scanned once, sections and values point into it and must not outlive it.
+ */
+class EDSFile{
+public:
+    struct Section{
+        EDSText name;
+        std::vector<std::pair<EDSText, EDSText> > values;
+
+        const EDSText* get(const EDSText &key) const{
+            for(std::vector<std::pair<EDSText, EDSText> >::const_iterator it = values.begin(); it != values.end(); ++it){
+                if(it->first.iequals(key)) return &it->second;
+            }
+            return 0;
+        }
+        const EDSText* get(const char *key) const { return get(EDSText(key)); }
+        const EDSText& required(const char *key) const{
+            const EDSText *value = get(key);
+            if(!value) parse_error(name.line, "[" + name.str() + "] has no " + key);
+            return *value;
+        }
+    };
+
+    EDSFile(const std::string &source){
+        const char *pos = source.data(), *end = pos + source.size();
+        Section *current = 0;
+        for(size_t line = 1; pos != end; ++line){
+            const char *eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+            if(!eol) eol = end;
+            EDSText text = EDSText::trim(pos, eol, line);
+            pos = eol == end ? end : eol + 1;
+
+            if(text.empty() || *text.begin == ';') continue;
+
+            if(*text.begin == '['){
+                const char *close = static_cast<const char*>(memchr(text.begin, ']', text.size()));
+                if(!close) parse_error(line, "unmatched '['");
+                Section s;
+                s.name = EDSText::trim(text.begin + 1, close, line);
+                if(!index_.insert(std::make_pair(s.name, sections_.size())).second){
+                    parse_error(line, "duplicate section [" + s.name.str() + "]");
+                }
+                sections_.push_back(s);
+                current = &sections_.back();
+            }else{
+                const char *eq = static_cast<const char*>(memchr(text.begin, '=', text.size()));
+                if(!eq) parse_error(line, "'=' expected");
+                EDSText key = EDSText::trim(text.begin, eq, line);
+                if(key.empty()) parse_error(line, "key expected");
+                if(!current) continue; // not part of any section, cannot be looked up
+                if(current->get(key)) parse_error(line, "duplicate key " + key.str() + " in [" + current->name.str() + "]");
+                current->values.push_back(std::make_pair(key, EDSText::trim(eq + 1, text.end, line)));
+            }
+        }
+    }
+
+    const Section* section(const EDSText &name) const{
+        boost::unordered_map<EDSText, size_t, EDSTextIHash, EDSTextIEqual>::const_iterator it = index_.find(name);
+        return it != index_.end() ? &sections_[it->second] : 0;
+    }
+    const Section* section(const std::string &name) const { return section(EDSText(name)); }
+
+    /** set ParameterValue of the named sections, the overlay must outlive this object */
+    void overlay(const ObjectDict::Overlay &overlay){
+        for(ObjectDict::Overlay::const_iterator it= overlay.begin(); it != overlay.end(); ++it){
+            Section *s = const_cast<Section*>(section(it->first));
+            if(!s) parse_error(0, "overlay refers to missing section [" + it->first + "]");
+            EDSText key("ParameterValue"), value(it->second);
+            std::vector<std::pair<EDSText, EDSText> >::iterator v = s->values.begin();
+            while(v != s->values.end() && !v->first.iequals(key)) ++v;
+            if(v != s->values.end()) v->second = value;
+            else s->values.push_back(std::make_pair(key, value));
+        }
+    }
+private:
+    std::vector<Section> sections_;
+    boost::unordered_map<EDSText, size_t, EDSTextIHash, EDSTextIEqual> index_;
+};
+
+void set_access( ObjectDict::Entry &entry, const EDSText &access){
     entry.constant = false;
     if(access == "ro"){
         entry.readable = true;
@@ -104,220 +297,662 @@ void set_access( ObjectDict::Entry &entry, const std::string &access){
         entry.writable = false;
         entry.constant = true;
     }else{
-        throw ParseException();
+        parse_error(access.line, "invalid AccessType '" + access.str() + "'");
     }
 }
 
-template<typename T> T int_from_string(const std::string &s);
-
-template<> int8_t int_from_string(const std::string &s){
-    return strtol(s.c_str(), 0, 0);
-}
-template<> uint8_t int_from_string(const std::string &s){
-    return strtoul(s.c_str(), 0, 0);
-}
-template<> int16_t int_from_string(const std::string &s){
-    return strtol(s.c_str(), 0, 0);
-}
-template<> uint16_t int_from_string(const std::string &s){
-    return strtoul(s.c_str(), 0, 0);
-}
-template<> int32_t int_from_string(const std::string &s){
-    return strtol(s.c_str(), 0, 0);
-}
-template<> uint32_t int_from_string(const std::string &s){
-    return strtoul(s.c_str(), 0, 0);
+/** strtol semantics: decimal, 0x-prefixed hex or 0-prefixed octal, parsing stops at the first invalid character */
+template<typename T> T int_from_text(const EDSText &t){
+    char buf[32];
+    std::string long_buf;
+    const char *s = buf;
+    if(t.size() < sizeof(buf)){
+        memcpy(buf, t.begin, t.size());
+        buf[t.size()] = '\0';
+    }else{
+        long_buf = t.str();
+        s = long_buf.c_str();
+    }
+    return boost::is_signed<T>::value ? T(strtoll(s, 0, 0)) : T(strtoull(s, 0, 0));
 }
 
-template<> int64_t int_from_string(const std::string &s){
-    return strtoll(s.c_str(), 0, 0);
-}
-template<> uint64_t int_from_string(const std::string &s){
-    return strtoull(s.c_str(), 0, 0);
+/** accepts 0, 1, true and false */
+bool bool_from_text(const EDSText &t, bool &b){
+    if(t == "1" || t == "true") b = true;
+    else if(t == "0" || t == "false") b = false;
+    else return false;
+    return true;
 }
 
-template<typename T> HoldAny parse_int(boost::property_tree::iptree &pt, const std::string &key){
-    if(pt.count(key) == 0) return HoldAny(TypeGuard::create<T>());
-                                          
-    std::string str = pt.get<std::string>(key);
-    if(boost::istarts_with(str,"$NODEID")){
-        return HoldAny(NodeIdOffset<T>(int_from_string<T>(boost::trim_copy(str.substr(str.find("+",7)+1)))));
-    }else return HoldAny(int_from_string<T>(boost::trim_copy(str)));
+inline void real_from_string(const char *s, char **end, float &f) { f = strtof(s, end); }
+inline void real_from_string(const char *s, char **end, double &d) { d = strtod(s, end); }
+
+template<typename T> HoldAny parse_int(const EDSText *value){
+    if(!value) return HoldAny(TypeGuard::create<T>());
+
+    if(value->istarts_with("$NODEID")){
+        const char *plus = std::find(value->begin + 7, value->end, '+');
+        return HoldAny(NodeIdOffset<T>(int_from_text<T>(plus == value->end ? *value : EDSText::trim(plus + 1, value->end, value->line))));
+    }else return HoldAny(int_from_text<T>(*value));
 }
 
-template<typename T> HoldAny parse_octets(boost::property_tree::iptree &pt, const std::string &key){
+template<typename T> HoldAny parse_octets(const EDSText *value){
+    if(!value) return HoldAny(TypeGuard::create<T>());
+    std::string str = value->str();
+    if(str.size() >= 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) str.erase(0, 2);
     std::string out;
-    if(pt.count(key) == 0 || can::hex2buffer(out,pt.get<std::string>(key), true)) return HoldAny(TypeGuard::create<T>());
+    if(!can::hex2buffer(out, str, true)){ // e.g. a file name for a domain, such values have always been left empty
+        LOG("line " << value->line << ": ignoring value '" << value->str() << "', hex octets expected");
+        return HoldAny(TypeGuard::create<T>());
+    }
     return HoldAny(T(out));
 }
 
-template<typename T> HoldAny parse_typed_value(boost::property_tree::iptree &pt, const std::string &key){
-    if(pt.count(key) == 0) return HoldAny(TypeGuard::create<T>());
-    return HoldAny(pt.get<T>(key));
+template<typename T> HoldAny parse_typed_value(const EDSText *value){
+    if(!value) return HoldAny(TypeGuard::create<T>());
+    std::string str = value->str();
+    char *end = 0;
+    T t;
+    real_from_string(str.c_str(), &end, t);
+    if(str.empty() || *end) parse_error(value->line, "invalid value '" + str + "'");
+    return HoldAny(t);
 }
-template<> HoldAny parse_typed_value<String>(boost::property_tree::iptree &pt, const std::string &key){
-    if(pt.count(key) == 0) return HoldAny(TypeGuard::create<String>());
-    return HoldAny(String(pt.get<std::string>(key)));
+template<> HoldAny parse_typed_value<String>(const EDSText *value){
+    if(!value) return HoldAny(TypeGuard::create<String>());
+    return HoldAny(String(value->str()));
 }
 
 struct ReadAnyValue{
-    template<const ObjectDict::DataTypes dt> static HoldAny func(boost::property_tree::iptree &pt, const std::string &key);
-    static HoldAny read_value(boost::property_tree::iptree &pt, uint16_t data_type, const std::string &key){
-        return branch_type<ReadAnyValue, HoldAny (boost::property_tree::iptree &, const std::string &)>(data_type)(pt, key);
+    template<const ObjectDict::DataTypes dt> static HoldAny func(const EDSText *value);
+    static HoldAny read_value(uint16_t data_type, const EDSText *value){
+        return branch_type<ReadAnyValue, HoldAny (const EDSText *)>(data_type)(value);
     }
 };
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER8>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<int8_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER16>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<int16_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER32>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<int32_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER64>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<int64_t>(pt,key); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER8>(const EDSText *value){  return parse_int<int8_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER16>(const EDSText *value){  return parse_int<int16_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER32>(const EDSText *value){  return parse_int<int32_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_INTEGER64>(const EDSText *value){  return parse_int<int64_t>(value); }
 
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED8>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<uint8_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED16>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<uint16_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED32>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<uint32_t>(pt,key); }
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED64>(boost::property_tree::iptree &pt, const std::string &key){  return parse_int<uint64_t>(pt,key); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED8>(const EDSText *value){  return parse_int<uint8_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED16>(const EDSText *value){  return parse_int<uint16_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED32>(const EDSText *value){  return parse_int<uint32_t>(value); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_UNSIGNED64>(const EDSText *value){  return parse_int<uint64_t>(value); }
 
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_DOMAIN>(boost::property_tree::iptree &pt, const std::string &key)
-{ return parse_octets<ObjectStorage::DataType<ObjectDict::DEFTYPE_DOMAIN>::type>(pt,key); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_DOMAIN>(const EDSText *value)
+{ return parse_octets<ObjectStorage::DataType<ObjectDict::DEFTYPE_DOMAIN>::type>(value); }
 
-template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_OCTET_STRING>(boost::property_tree::iptree &pt, const std::string &key)
-{ return parse_octets<ObjectStorage::DataType<ObjectDict::DEFTYPE_OCTET_STRING>::type>(pt,key); }
+template<> HoldAny ReadAnyValue::func<ObjectDict::DEFTYPE_OCTET_STRING>(const EDSText *value)
+{ return parse_octets<ObjectStorage::DataType<ObjectDict::DEFTYPE_OCTET_STRING>::type>(value); }
 
-template<const ObjectDict::DataTypes dt> HoldAny ReadAnyValue::func(boost::property_tree::iptree &pt, const std::string &key){
-    return parse_typed_value<typename ObjectStorage::DataType<dt>::type>(pt, key);
+template<const ObjectDict::DataTypes dt> HoldAny ReadAnyValue::func(const EDSText *value){
+    return parse_typed_value<typename ObjectStorage::DataType<dt>::type>(value);
 }
 
-template<typename T> void read_optional(T& var, boost::property_tree::iptree &pt, const std::string &key){
-    var = pt.get(key, T());
+template<typename T> void read_optional(T& var, const EDSFile::Section &section, const char *key){
+    const EDSText *value = section.get(key);
+    var = value ? int_from_text<T>(*value) : T();
 }
-
-template<typename T> void read_integer(T& var, boost::property_tree::iptree &pt, const std::string &key){
-    var = int_from_string<T>(pt.get<std::string>(key));
+template<> void read_optional(std::string& var, const EDSFile::Section &section, const char *key){
+    const EDSText *value = section.get(key);
+    var = value ? value->str() : std::string();
 }
-
-template<typename T> T read_integer(boost::property_tree::iptree &pt, const std::string &key){
-    return int_from_string<T>(pt.get<std::string>(key, std::string()));
+template<> void read_optional(bool& var, const EDSFile::Section &section, const char *key){
+    const EDSText *value = section.get(key);
+    var = false;
+    if(value) bool_from_text(*value, var);
 }
 
-
-void read_var(ObjectDict::Entry &entry, boost::property_tree::iptree &object){
-        read_integer<uint16_t>(entry.data_type, object, "DataType");
-        entry.mappable = object.get<bool>("PDOMapping", false);
-        set_access(entry, object.get<std::string>("AccessType"));
+void read_var(ObjectDict::Entry &entry, const EDSFile::Section &object){
+        const EDSText &data_type = object.required("DataType");
+        entry.data_type = int_from_text<uint16_t>(data_type);
+        if(!branch_type<ReadAnyValue, HoldAny (const EDSText *)>(entry.data_type)) parse_error(data_type.line, "unsupported DataType " + data_type.str());
+        read_optional(entry.mappable, object, "PDOMapping");
+        set_access(entry, object.required("AccessType"));
         
-        entry.def_val = ReadAnyValue::read_value(object, entry.data_type, "DefaultValue");
-        entry.init_val = ReadAnyValue::read_value(object, entry.data_type, "ParameterValue");
+        entry.def_val = ReadAnyValue::read_value(entry.data_type, object.get("DefaultValue"));
+        entry.init_val = ReadAnyValue::read_value(entry.data_type, object.get("ParameterValue"));
 }
 
-void parse_object(boost::shared_ptr<ObjectDict> dict, boost::property_tree::iptree &pt, const std::string &name, const uint8_t* sub_index = 0){
-        boost::optional<boost::property_tree::iptree&> object =  pt.get_child_optional(name.substr(2));
+/** parsed dictionary before it gets instantiated, this is what gets cached */
+struct CompiledDict{
+    struct Record{
+        bool is_sub;
+        boost::shared_ptr<const ObjectDict::Entry> entry;
+        std::string section; ///< section that holds the ParameterValue of this entry, empty if there is none
+    };
+    DeviceInfo info;
+    std::vector<Record> records;
+
+    void insert(bool is_sub, const boost::shared_ptr<const ObjectDict::Entry> &entry, const std::string &section = std::string()){
+        Record r = { is_sub, entry, section };
+        records.push_back(r);
+    }
+    boost::shared_ptr<ObjectDict> create() const{
+        std::vector<std::pair<bool, boost::shared_ptr<const ObjectDict::Entry> > > entries;
+        entries.reserve(records.size());
+        for(std::vector<Record>::const_iterator it = records.begin(); it != records.end(); ++it){
+            entries.push_back(std::make_pair(it->is_sub, it->entry));
+        }
+        return boost::make_shared<ObjectDict>(info, entries);
+    }
+};
+
+void parse_object(CompiledDict &dict, const EDSFile &file, const std::string &name, const uint8_t* sub_index = 0){
+        const std::string section = name.substr(2);
+        const EDSFile::Section *object = file.section(section);
         if(!object) return;
 
         boost::shared_ptr<ObjectDict::Entry> entry = boost::make_shared<ObjectDict::Entry>();
-        entry->index = int_from_string<uint16_t>(name);
-        entry->obj_code = ObjectDict::Code(int_from_string<uint16_t>(object->get<std::string>("ObjectType", boost::lexical_cast<std::string>((uint16_t)ObjectDict::VAR))));
-        entry->desc = object->get<std::string>("Denotation",object->get<std::string>("ParameterName"));
+        entry->index = int_from_text<uint16_t>(EDSText(name));
+        const EDSText *object_type = object->get("ObjectType");
+        entry->obj_code = object_type ? ObjectDict::Code(int_from_text<uint16_t>(*object_type)) : ObjectDict::VAR;
+        const EDSText *denotation = object->get("Denotation");
+        entry->desc = (denotation ? *denotation : object->required("ParameterName")).str();
         
-        // std::cout << name << ": "<< entry->desc << std::endl;
         if(entry->obj_code == ObjectDict::VAR || entry->obj_code == ObjectDict::DOMAIN_DATA){
             entry->sub_index = sub_index? *sub_index: 0;
             read_var(*entry, *object);
-            dict->insert(sub_index != 0, entry);
+            dict.insert(sub_index != 0, entry, section);
         }else if(entry->obj_code == ObjectDict::ARRAY || entry->obj_code == ObjectDict::RECORD){
-            uint8_t subs = read_integer<uint8_t>(*object, "CompactSubObj");
-            if(subs){ // compact
-                dict->insert(true, boost::make_shared<const canopen::ObjectDict::Entry>(entry->index, 0, ObjectDict::DEFTYPE_UNSIGNED8, "NrOfObjects", true, false, false, HoldAny(subs)));
+            const EDSText *compact = object->get("CompactSubObj");
+            uint8_t subs = compact ? int_from_text<uint8_t>(*compact) : 0;
+            if(subs){ // compact, sub-indices 1..subs with optional [<index>Name], [<index>Denotation] and [<index>Value] sections
+                dict.insert(true, boost::make_shared<const canopen::ObjectDict::Entry>(entry->index, 0, ObjectDict::DEFTYPE_UNSIGNED8, "NrOfObjects", true, false, false, HoldAny(subs)));
 
                 read_var(*entry, *object);
+
+                const EDSFile::Section *names = file.section(section + "Name");
+                const EDSFile::Section *denotations = file.section(section + "Denotation");
+                const EDSFile::Section *values = file.section(section + "Value");
                 
-                for(uint8_t i=1; i< subs; ++i){
-                    std::string subname = pt.get<std::string>(name.substr(2)+"Name." + boost::lexical_cast<std::string>((int)i),entry->desc + boost::lexical_cast<std::string>((int)i));
-                    subname = pt.get<std::string>(name.substr(2)+"Denotation." + boost::lexical_cast<std::string>((int)i), subname);
+                for(unsigned int i=1; i <= subs; ++i){
+                    char key[4];
+                    snprintf(key, sizeof(key), "%u", i);
+                    const EDSText *subname = denotations ? denotations->get(key) : 0;
+                    if(!subname && names) subname = names->get(key);
                     
-                    dict->insert(true, boost::make_shared<const canopen::ObjectDict::Entry>(entry->index, i, entry->data_type, name, entry->readable, entry->writable, entry->mappable, entry->def_val,
-                       ReadAnyValue::read_value(pt, entry->data_type, name.substr(2)+"Value." + boost::lexical_cast<std::string>((int)i))));
+                    dict.insert(true, boost::make_shared<const canopen::ObjectDict::Entry>(entry->index, i, entry->data_type, subname ? subname->str() : entry->desc + key,
+                        entry->readable, entry->writable, entry->mappable, entry->def_val, ReadAnyValue::read_value(entry->data_type, values ? values->get(key) : 0)));
                 }
             }else{
-                read_integer(subs, *object, "SubNumber");
+                subs = int_from_text<uint8_t>(object->required("SubNumber"));
                 for(uint8_t i=0; i< subs; ++i){
-                   std::stringstream buf;
-                   buf << name << "sub" << std::hex << int(i);
-                   // std::cout << "added " << buf.str() <<  "  " << int(i) << std::endl;
-                   parse_object(dict, pt, buf.str(), &i);
+                   char sub[8];
+                   snprintf(sub, sizeof(sub), "sub%x", int(i));
+                   parse_object(dict, file, name + sub, &i);
                 }
             }
         }else{
-            throw ParseException();
+            parse_error(object_type->line, "invalid ObjectType " + object_type->str());
         }
 }
-void parse_objects(boost::shared_ptr<ObjectDict> dict, boost::property_tree::iptree &pt, const std::string &key){
-    if(!pt.count(key)) return;
+void parse_objects(CompiledDict &dict, const EDSFile &file, const char *key){
+    const EDSFile::Section *objects = file.section(EDSText(key));
+    if(!objects) return;
     
-    boost::property_tree::iptree objects = pt.get_child(key);
-    uint16_t count = read_integer<uint16_t>(objects, "SupportedObjects");
-    for(uint16_t i=0; i < count; ++i){
-        std::string name = objects.get<std::string>(boost::lexical_cast<std::string>(i+1));
-        parse_object(dict, pt, name);
+    const EDSText *supported = objects->get("SupportedObjects");
+    size_t count = supported ? int_from_text<uint16_t>(*supported) : 0;
+    std::vector<const EDSText*> names(count + 1, (const EDSText*)0); // keys are 1..count
+    for(std::vector<std::pair<EDSText, EDSText> >::const_iterator it = objects->values.begin(); it != objects->values.end(); ++it){
+        if(it->first.empty() || !isdigit((unsigned char)*it->first.begin)) continue;
+        size_t i = int_from_text<uint16_t>(it->first);
+        if(i > 0 && i <= count) names[i] = &it->second;
+    }
+    for(size_t i=1; i <= count; ++i){
+        if(!names[i]) parse_error(objects->name.line, "[" + objects->name.str() + "] has no entry " + boost::lexical_cast<std::string>(i));
+        if(!names[i]->istarts_with("0x")) parse_error(names[i]->line, "invalid object " + names[i]->str());
+        parse_object(dict, file, names[i]->str());
     }
 }
-boost::shared_ptr<ObjectDict> ObjectDict::fromFile(const std::string &path, const ObjectDict::Overlay &overlay){
-    DeviceInfo info;
-    boost::property_tree::iptree pt;
-    boost::shared_ptr<ObjectDict> dict;
-    
-    boost::property_tree::read_ini(path, pt);
+void parse_dict(CompiledDict &dict, const EDSFile &file){
+    DeviceInfo &info = dict.info;
     
-    boost::property_tree::iptree di = pt.get_child("DeviceInfo");
+    const EDSFile::Section *di = file.section(EDSText("DeviceInfo"));
+    if(!di) parse_error(0, "[DeviceInfo] is missing");
     
-    read_optional(info.vendor_name, di, "VendorName");
-    read_optional(info.vendor_number, di, "VendorNumber");
-    read_optional(info.product_name, di, "ProductName");
-    read_optional(info.product_number, di, "ProductNumber");
-    read_optional(info.revision_number, di, "RevisionNumber");
-    read_optional(info.order_code, di, "OrderCode");
-    read_optional(info.simple_boot_up_master, di, "SimpleBootUpMaster");
-    read_optional(info.simple_boot_up_slave, di, "SimpleBootUpSlave");
-    read_optional(info.granularity, di, "Granularity");
-    read_optional(info.dynamic_channels_supported, di, "DynamicChannelsSupported");
-    read_optional(info.group_messaging, di, "GroupMessaging");
-    read_optional(info.nr_of_rx_pdo, di, "NrOfRXPDO");
-    read_optional(info.nr_of_tx_pdo, di, "NrOfTXPDO");
-    read_optional(info.lss_supported, di, "LSS_Supported");
-
-    boost::unordered_set<uint32_t> baudrates;
-    boost::unordered_set<uint16_t> dummy_usage;
-
-    BOOST_FOREACH(boost::property_tree::iptree::value_type &v, di){
-        if(v.first.find("BaudRate_") == 0){
-            uint16_t rate = int_from_string<uint16_t>(v.first.substr(9));
-            if(v.second.get_value<bool>())
+    read_optional(info.vendor_name, *di, "VendorName");
+    read_optional(info.vendor_number, *di, "VendorNumber");
+    read_optional(info.product_name, *di, "ProductName");
+    read_optional(info.product_number, *di, "ProductNumber");
+    read_optional(info.revision_number, *di, "RevisionNumber");
+    read_optional(info.order_code, *di, "OrderCode");
+    read_optional(info.simple_boot_up_master, *di, "SimpleBootUpMaster");
+    read_optional(info.simple_boot_up_slave, *di, "SimpleBootUpSlave");
+    read_optional(info.granularity, *di, "Granularity");
+    read_optional(info.dynamic_channels_supported, *di, "DynamicChannelsSupported");
+    read_optional(info.group_messaging, *di, "GroupMessaging");
+    read_optional(info.nr_of_rx_pdo, *di, "NrOfRXPDO");
+    read_optional(info.nr_of_tx_pdo, *di, "NrOfTXPDO");
+    read_optional(info.lss_supported, *di, "LSS_Supported");
+
+    for(std::vector<std::pair<EDSText, EDSText> >::const_iterator it = di->values.begin(); it != di->values.end(); ++it){
+        if(it->first.starts_with("BaudRate_")){
+            uint16_t rate = int_from_text<uint16_t>(EDSText(it->first.begin + 9, it->first.end, it->first.line));
+            bool supported;
+            if(!bool_from_text(it->second, supported)) parse_error(it->second.line, "invalid value '" + it->second.str() + "'");
+            if(supported)
                 info.baudrates.insert(rate * 1000);
         }
     }
 
-    if(pt.count("DummyUsage")){
-        BOOST_FOREACH(boost::property_tree::iptree::value_type &v, pt.get_child("DummyUsage")){
-            if(v.first.find("Dummy") == 0){
-                // std::cout << ("0x"+v.first.substr(5)) << std::endl;
-                uint16_t dummy = int_from_string<uint16_t>("0x"+v.first.substr(5));
-                if(v.second.get_value<bool>())
+    if(const EDSFile::Section *dummies = file.section(EDSText("DummyUsage"))){
+        for(std::vector<std::pair<EDSText, EDSText> >::const_iterator it = dummies->values.begin(); it != dummies->values.end(); ++it){
+            if(it->first.starts_with("Dummy")){
+                uint16_t dummy = int_from_text<uint16_t>(EDSText("0x" + std::string(it->first.begin + 5, it->first.end)));
+                bool used;
+                if(!bool_from_text(it->second, used)) parse_error(it->second.line, "invalid value '" + it->second.str() + "'");
+                if(used)
                     info.dummy_usage.insert(dummy);
             }
         }
     }
 
-    dict = boost::make_shared<ObjectDict>(info);
+    parse_objects(dict, file, "MandatoryObjects");
+    parse_objects(dict, file, "OptionalObjects");
+    parse_objects(dict, file, "ManufacturerObjects");
+}
+
+/**
+ * Compiled dictionary file, all values in host byte order:
+ * header (magic, version, byte order mark, FNV-1a hash and size of the source), device info, entries.
+ * Strings are stored with a 32-bit length, values are tagged with ValueTag.
+ * A file that does not match the source in any of the header fields gets ignored and replaced.
+ */
+namespace dict_cache{
 
-    for(Overlay::const_iterator it= overlay.begin(); it != overlay.end(); ++it){
-        pt.get_child(it->first).put("ParameterValue", it->second);
+const char MAGIC[8] = { 'C', 'O', 'D', 'I', 'C', 'T', '\0', '\0' };
+const uint32_t VERSION = 3;
+const uint32_t ORDER_MARK = 0x01020304;
+
+enum ValueTag{
+    VALUE_NONE, ///< HoldAny()
+    VALUE_EMPTY, ///< typed, but without value
+    VALUE_DATA,
+    VALUE_NODEID_OFFSET
+};
+
+uint64_t hash(const std::string &data){
+    uint64_t h = 14695981039346656037ULL;
+    for(std::string::const_iterator it = data.begin(); it != data.end(); ++it){
+        h = (h ^ (unsigned char)*it) * 1099511628211ULL;
     }
+    return h;
+}
 
-    parse_objects(dict, pt, "MandatoryObjects");
-    parse_objects(dict, pt, "OptionalObjects");
-    parse_objects(dict, pt, "ManufacturerObjects");
-    
+class Writer{
+    std::string buffer_;
+public:
+    template<typename T> void put(const T &t){
+        buffer_.append(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+    void put(const char *data, size_t len){
+        put<uint32_t>(len);
+        buffer_.append(data, len);
+    }
+    void put(const std::string &s){
+        put(s.data(), s.size());
+    }
+    const std::string& data() const { return buffer_; }
+};
+
+class Reader{
+    const char *pos_;
+    const char *end_;
+public:
+    Reader(const char *data, size_t len) : pos_(data), end_(data + len) {}
+    void get(void *out, size_t len){
+        if(size_t(end_ - pos_) < len) throw ParseException();
+        memcpy(out, pos_, len);
+        pos_ += len;
+    }
+    template<typename T> T get(){
+        T t;
+        get(&t, sizeof(T));
+        return t;
+    }
+    std::string get_string(){
+        uint32_t len = get<uint32_t>();
+        if(size_t(end_ - pos_) < len) throw ParseException();
+        std::string s(pos_, len);
+        pos_ += len;
+        return s;
+    }
+    bool at_end() const { return pos_ == end_; }
+};
+
+template<typename T> void put_offset(Writer &w, const HoldAny &val, boost::true_type /*integral*/){
+    w.put<uint8_t>(VALUE_NODEID_OFFSET);
+    w.put<T>(NodeIdOffset<T>::apply(val, 0));
+}
+template<typename T> void put_offset(Writer &w, const HoldAny &val, boost::false_type){
+    throw ParseException();
+}
+template<typename T> HoldAny get_offset(Reader &r, boost::true_type /*integral*/){
+    return HoldAny(NodeIdOffset<T>(r.get<T>()));
+}
+template<typename T> HoldAny get_offset(Reader &r, boost::false_type){
+    throw ParseException();
+}
+
+template<typename T> void put_data(Writer &w, const HoldAny &val){
+    w.put<T>(val.get<T>());
+}
+template<> void put_data<String>(Writer &w, const HoldAny &val){
+    const String &s = val.get<String>();
+    w.put(s.data(), s.size());
+}
+template<typename T> HoldAny get_data(Reader &r){
+    return HoldAny(r.get<T>());
+}
+template<> HoldAny get_data<String>(Reader &r){
+    return HoldAny(String(r.get_string()));
+}
+
+struct AnyValue{
+    template<const ObjectDict::DataTypes dt> static void func(Writer *w, Reader *r, HoldAny &val){
+        typedef typename ObjectStorage::DataType<dt>::type type;
+        if(w){
+            if(val.is_empty()){
+                if(val.type().valid() && !val.type().is_type<type>()) throw ParseException();
+                w->put<uint8_t>(val.type().valid() ? VALUE_EMPTY : VALUE_NONE);
+            }else if(val.type().is_type<type>()){
+                w->put<uint8_t>(VALUE_DATA);
+                put_data<type>(*w, val);
+            }else{
+                put_offset<type>(*w, val, boost::is_integral<type>());
+            }
+        }else{
+            switch(r->get<uint8_t>()){
+                case VALUE_NONE: val = HoldAny(); break;
+                case VALUE_EMPTY: val = HoldAny(TypeGuard::create<type>()); break;
+                case VALUE_DATA: val = get_data<type>(*r); break;
+                case VALUE_NODEID_OFFSET: val = get_offset<type>(*r, boost::is_integral<type>()); break;
+                default: throw ParseException();
+            }
+        }
+    }
+    static void transfer(uint16_t data_type, Writer *w, Reader *r, HoldAny &val){
+        void (*f)(Writer*, Reader*, HoldAny&) = branch_type<AnyValue, void (Writer*, Reader*, HoldAny&)>(data_type);
+        if(!f) throw ParseException();
+        f(w, r, val);
+    }
+};
+
+template<typename T> void put_set(Writer &w, const boost::unordered_set<T> &set){
+    w.put<uint32_t>(set.size());
+    for(typename boost::unordered_set<T>::const_iterator it = set.begin(); it != set.end(); ++it) w.put<T>(*it);
+}
+template<typename T> void get_set(Reader &r, boost::unordered_set<T> &set){
+    for(uint32_t n = r.get<uint32_t>(); n > 0; --n) set.insert(r.get<T>());
+}
+
+void write(Writer &w, uint64_t source_hash, uint64_t source_size, const CompiledDict &dict){
+    w.put<char[8]>(MAGIC);
+    w.put<uint32_t>(VERSION);
+    w.put<uint32_t>(ORDER_MARK);
+    w.put<uint64_t>(source_hash);
+    w.put<uint64_t>(source_size);
+
+    const DeviceInfo &info = dict.info;
+    w.put(info.vendor_name);
+    w.put<uint32_t>(info.vendor_number);
+    w.put(info.product_name);
+    w.put<uint32_t>(info.product_number);
+    w.put<uint32_t>(info.revision_number);
+    w.put(info.order_code);
+    put_set(w, info.baudrates);
+    w.put<uint8_t>(info.simple_boot_up_master);
+    w.put<uint8_t>(info.simple_boot_up_slave);
+    w.put<uint8_t>(info.granularity);
+    w.put<uint8_t>(info.dynamic_channels_supported);
+    w.put<uint8_t>(info.group_messaging);
+    w.put<uint16_t>(info.nr_of_rx_pdo);
+    w.put<uint16_t>(info.nr_of_tx_pdo);
+    w.put<uint8_t>(info.lss_supported);
+    put_set(w, info.dummy_usage);
+
+    w.put<uint32_t>(dict.records.size());
+    for(std::vector<CompiledDict::Record>::const_iterator it = dict.records.begin(); it != dict.records.end(); ++it){
+        const ObjectDict::Entry &e = *it->entry;
+        w.put<uint8_t>(it->is_sub);
+        w.put<uint8_t>(e.obj_code);
+        w.put<uint16_t>(e.index);
+        w.put<uint8_t>(e.sub_index);
+        w.put<uint16_t>(e.data_type);
+        w.put<uint8_t>((e.constant ? 1 : 0) | (e.readable ? 2 : 0) | (e.writable ? 4 : 0) | (e.mappable ? 8 : 0));
+        w.put(e.desc);
+        w.put(it->section);
+        HoldAny def_val = e.def_val, init_val = e.init_val;
+        AnyValue::transfer(e.data_type, &w, 0, def_val);
+        AnyValue::transfer(e.data_type, &w, 0, init_val);
+    }
+}
+
+bool read(Reader &r, uint64_t source_hash, uint64_t source_size, CompiledDict &dict){
+    char magic[sizeof(MAGIC)];
+    r.get(magic, sizeof(magic));
+    if(memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || r.get<uint32_t>() != VERSION || r.get<uint32_t>() != ORDER_MARK
+        || r.get<uint64_t>() != source_hash || r.get<uint64_t>() != source_size){
+        return false;
+    }
+
+    DeviceInfo &info = dict.info;
+    info.vendor_name = r.get_string();
+    info.vendor_number = r.get<uint32_t>();
+    info.product_name = r.get_string();
+    info.product_number = r.get<uint32_t>();
+    info.revision_number = r.get<uint32_t>();
+    info.order_code = r.get_string();
+    get_set(r, info.baudrates);
+    info.simple_boot_up_master = r.get<uint8_t>();
+    info.simple_boot_up_slave = r.get<uint8_t>();
+    info.granularity = r.get<uint8_t>();
+    info.dynamic_channels_supported = r.get<uint8_t>();
+    info.group_messaging = r.get<uint8_t>();
+    info.nr_of_rx_pdo = r.get<uint16_t>();
+    info.nr_of_tx_pdo = r.get<uint16_t>();
+    info.lss_supported = r.get<uint8_t>();
+    get_set(r, info.dummy_usage);
+
+    uint32_t num = r.get<uint32_t>();
+    dict.records.reserve(num);
+    for(uint32_t i = 0; i < num; ++i){
+        boost::shared_ptr<ObjectDict::Entry> e = boost::make_shared<ObjectDict::Entry>();
+        bool is_sub = r.get<uint8_t>();
+        e->obj_code = ObjectDict::Code(r.get<uint8_t>());
+        e->index = r.get<uint16_t>();
+        e->sub_index = r.get<uint8_t>();
+        e->data_type = r.get<uint16_t>();
+        uint8_t flags = r.get<uint8_t>();
+        e->constant = flags & 1;
+        e->readable = flags & 2;
+        e->writable = flags & 4;
+        e->mappable = flags & 8;
+        e->desc = r.get_string();
+        std::string section = r.get_string();
+        AnyValue::transfer(e->data_type, 0, &r, e->def_val);
+        AnyValue::transfer(e->data_type, 0, &r, e->init_val);
+        dict.insert(is_sub, e, section);
+    }
+    return r.at_end();
+}
+
+std::string default_directory(){
+    if(const char *dir = getenv("CANOPEN_DICT_CACHE")) return dir;
+    if(const char *ros_home = getenv("ROS_HOME")) return std::string(ros_home) + "/canopen_dicts";
+    if(const char *home = getenv("HOME")) return std::string(home) + "/.ros/canopen_dicts";
+    return std::string();
+}
+
+boost::mutex directory_mutex;
+std::string directory = default_directory();
+
+std::string file_name(const std::string &dir, uint64_t source_hash){
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.dict", (unsigned long long)source_hash);
+    return dir + "/" + name;
+}
+
+bool load(const std::string &dir, uint64_t source_hash, uint64_t source_size, CompiledDict &dict){
+    try{
+        boost::interprocess::file_mapping file(file_name(dir, source_hash).c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+        Reader r(static_cast<const char*>(region.get_address()), region.get_size());
+        return read(r, source_hash, source_size, dict);
+    }
+    catch(...){ // missing, truncated or incompatible
+        return false;
+    }
+}
+
+void store(const std::string &dir, uint64_t source_hash, uint64_t source_size, const CompiledDict &dict){
+    Writer w;
+    try{
+        write(w, source_hash, source_size, dict);
+    }
+    catch(...){ // dictionary cannot be compiled, it will be parsed again next time
+        return;
+    }
+
+    size_t pos = 0;
+    do{ // create missing parent directories
+        pos = dir.find('/', pos + 1);
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+    }while(pos != std::string::npos);
+
+    std::string name = file_name(dir, source_hash);
+    std::string tmp = name + ".XXXXXX"; // unique per writer, threads of the same process included
+    int fd = mkstemp(&tmp[0]);
+    if(fd < 0) return;
+    fchmod(fd, 0644);
+
+    const char *data = w.data().data();
+    size_t left = w.data().size();
+    while(left > 0){
+        ssize_t n = ::write(fd, data, left);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) break;
+        data += n;
+        left -= n;
+    }
+    if(close(fd) != 0 || left > 0){
+        remove(tmp.c_str());
+        return;
+    }
+    if(rename(tmp.c_str(), name.c_str()) != 0) remove(tmp.c_str()); // atomic, in case another process loads it concurrently
+}
+
+} // dict_cache
+
+void read_source(const std::string &path, std::string &source){
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file){
+        throw ParseException(path + ": cannot open file");
+    }
+    std::stringstream buf;
+    buf << file.rdbuf();
+    source = buf.str();
+}
+
+/** @return false if the overlay does not refer to a ParameterValue of an entry and has to be applied to the source */
+bool apply_overlay(CompiledDict &dict, const ObjectDict::Overlay &overlay){
+    for(ObjectDict::Overlay::const_iterator it= overlay.begin(); it != overlay.end(); ++it){
+        EDSText section(it->first), value(it->second);
+        bool found = false;
+        for(std::vector<CompiledDict::Record>::iterator r = dict.records.begin(); r != dict.records.end(); ++r){
+            if(!r->section.empty() && section.iequals(EDSText(r->section))){
+                boost::shared_ptr<ObjectDict::Entry> entry = boost::make_shared<ObjectDict::Entry>(*r->entry);
+                entry->init_val = ReadAnyValue::read_value(entry->data_type, &value);
+                r->entry = entry;
+                found = true;
+            }
+        }
+        if(!found) return false;
+    }
+    return true;
+}
+
+boost::shared_ptr<ObjectDict> from_source(const std::string &path, const std::string &source, const ObjectDict::Overlay &overlay){
+    uint64_t source_hash = dict_cache::hash(source);
+    std::string dir = ObjectDict::getCacheDirectory();
+
+    try{
+        CompiledDict dict;
+        if(dir.empty() || !dict_cache::load(dir, source_hash, source.size(), dict)){
+            dict = CompiledDict();
+            parse_dict(dict, EDSFile(source));
+
+            if(!dir.empty()) dict_cache::store(dir, source_hash, source.size(), dict);
+        }
+
+        if(!apply_overlay(dict, overlay)){ // e.g. sections without ParameterValue, parse with the overlay applied to the source
+            EDSFile file(source);
+            file.overlay(overlay);
+
+            dict = CompiledDict();
+            parse_dict(dict, file);
+        }
+        return dict.create();
+    }
+    catch(const ParseException &e){
+        throw ParseException(path + ": " + e.what());
+    }
+}
+
+boost::shared_ptr<ObjectDict> ObjectDict::fromFile(const std::string &path, const ObjectDict::Overlay &overlay){
+    std::string source;
+    read_source(path, source);
+    return from_source(path, source, overlay);
+}
+
+boost::shared_ptr<const ObjectDict> ObjectDict::getShared(const std::string &path, const ObjectDict::Overlay &overlay){
+    static boost::mutex mutex;
+    static std::map<std::string, boost::weak_ptr<const ObjectDict> > shared;
+
+    std::string source;
+    read_source(path, source);
+
+    std::stringstream key;
+    key << std::hex << dict_cache::hash(source) << ':' << source.size();
+    for(ObjectDict::Overlay::const_iterator it= overlay.begin(); it != overlay.end(); ++it){
+        key << '\0' << it->first << '=' << it->second;
+    }
+
+    typedef std::map<std::string, boost::weak_ptr<const ObjectDict> > SharedMap;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        SharedMap::iterator it = shared.find(key.str());
+        if(it != shared.end()){
+            if(boost::shared_ptr<const ObjectDict> dict = it->second.lock()) return dict;
+        }
+    }
+
+    // parse without holding the lock, other files can be loaded in parallel
+    boost::shared_ptr<const ObjectDict> parsed = from_source(path, source, overlay);
+
+    boost::mutex::scoped_lock lock(mutex);
+    boost::weak_ptr<const ObjectDict> &entry = shared[key.str()];
+    boost::shared_ptr<const ObjectDict> dict = entry.lock();
+    if(!dict){ // otherwise a concurrent caller was faster, share its dictionary
+        entry = parsed;
+        dict = parsed;
+        for(SharedMap::iterator it = shared.begin(); it != shared.end();){
+            if(it->second.expired()) shared.erase(it++);
+            else ++it;
+        }
+    }
     return dict;
 }
 
+void ObjectDict::setCacheDirectory(const std::string &dir){
+    boost::mutex::scoped_lock lock(dict_cache::directory_mutex);
+    dict_cache::directory = dir;
+}
+std::string ObjectDict::getCacheDirectory(){
+    boost::mutex::scoped_lock lock(dict_cache::directory_mutex);
+    return dict_cache::directory;
+}
+
 size_t ObjectStorage::map(const boost::shared_ptr<const ObjectDict::Entry> &e, const ObjectDict::Key &key, const ReadDelegate & read_delegate, const WriteDelegate & write_delegate){
     boost::unordered_map<ObjectDict::Key, boost::shared_ptr<Data> >::iterator it = storage_.find(key);
     
@@ -393,7 +1028,7 @@ void ObjectStorage::init(const ObjectDict::Key &key){
 void ObjectStorage::init_all(){
     boost::mutex::scoped_lock lock(mutex_);
 
-    boost::unordered_map<ObjectDict::Key, boost::shared_ptr<const ObjectDict::Entry> >::const_iterator entry_it;
+    ObjectDict::const_iterator entry_it;
     while(dict_->iterate(entry_it)){
         init_nolock(entry_it->first, entry_it->second);
     }
@@ -113,6 +113,7 @@ void PDOMapper::PDO::parse_and_set_mapping(const boost::shared_ptr<ObjectStorage
         }
         
         frame.dlc = 0;
+        frame.data.fill(0);
         for(uint8_t sub = 1; sub <=map_num; ++sub){
             ObjectStorage::Entry<uint32_t> mapentry;
             storage->entry(mapentry, map_index, sub);
@@ -133,10 +134,15 @@ void PDOMapper::PDO::parse_and_set_mapping(const boost::shared_ptr<ObjectStorage
             }
             
             frame.dlc += b->size;
-            assert( frame.dlc <= 8 );
+            assert( frame.dlc <= can::Frame::MAX_FD_LEN );
             b->clean();
             buffers.push_back(b);
         }
+        if(frame.dlc > can::Frame::MAX_LEN){ // mapping needs CAN FD, padded to the next valid length
+            frame.is_fd = 1;
+            frame.brs = 1;
+            frame.dlc = can::dlc2len(can::len2dlc(frame.dlc));
+        }
     }
     if(com_changed){
         uint8_t subs = dict(com_index, SUB_COM_NUM).value().get<uint8_t>();
@@ -195,7 +201,7 @@ bool PDOMapper::init(const boost::shared_ptr<ObjectStorage> storage, LayerStatus
 
         return true;
     }
-    catch(const std::out_of_range &e){
+    catch(const std::logic_error &e){ // std::out_of_range or std::invalid_argument
         status.error(std::string("PDO error: ") + e.what());
         return false;
     }
@@ -213,11 +219,20 @@ bool PDOMapper::RPDO::init(const boost::shared_ptr<ObjectStorage> &storage, cons
     if(buffers.empty() || pdoid.invalid){
        return false;     
     }
-        
+    const bool fd = frame.is_fd;
+
     frame = pdoid.header();
     frame.is_rtr = pdoid.no_rtr?0:1;
     
     transmission_type = dict(com_index, SUB_COM_TRANSMISSION_TYPE).value().get<uint8_t>();
+
+    if(fd && frame.is_rtr){ // CAN FD has no remote frames
+        if(transmission_type == 0xFC || transmission_type == 0xFD){
+            BOOST_THROW_EXCEPTION(std::invalid_argument(boost::str(boost::format("PDO %1$04X: RTR is not possible for a mapping of more than %2% bytes")
+                                                                   % com_index % (int)can::Frame::MAX_LEN)));
+        }
+        frame.is_rtr = 0; // RTR is only used by the transmission types above
+    }
     
     listener_ = interface_->createMsgListener(pdoid.header() ,can::CommInterface::FrameDelegate(this, &RPDO::handleFrame));
     
@@ -399,7 +399,7 @@ void SDOClient::init(){
     catch(...){
         server_id = can::MsgHeader(0x580+ storage_->node_id_);
     }
-    listener_ = interface_->createMsgListener(server_id, can::CommInterface::FrameDelegate(this, &SDOClient::handleFrame));
+    listener_ = interface_->createMsgListener(server_id, can::CommInterface::FrameDelegate(this, &SDOClient::handleFrame), can::background_dispatch);
 }
 void SDOClient::wait_for_response(){
     boost::mutex::scoped_lock cond_lock(cond_mutex);
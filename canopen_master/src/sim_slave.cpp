@@ -0,0 +1,293 @@
+#include <canopen_master/sim_slave.h>
+
+using namespace canopen;
+
+const uint16_t RPDO_COM_BASE =0x1400;
+const uint16_t RPDO_MAP_BASE =0x1600;
+const uint16_t TPDO_COM_BASE =0x1800;
+const uint16_t TPDO_MAP_BASE =0x1A00;
+
+const uint32_t COB_ID_INVALID = (1u<<31);
+const uint32_t COB_ID_EXTENDED = (1u<<29);
+
+SimulatedSlave::SimulatedSlave(const can::VirtualBus::Ptr &bus, uint8_t node_id)
+: node_id_(node_id), strict_(false), bus_(bus), state_(BootUp), sync_counter_(0), sdo_key_(0), sdo_offset_(0), sdo_toggle_(false)
+{
+    set<uint32_t>(0x1000, 0, 0);
+    set<uint16_t>(0x1017, 0, 0);
+    bus_->attach(this);
+}
+SimulatedSlave::~SimulatedSlave(){
+    bus_->detach(this);
+}
+
+void SimulatedSlave::setRaw(uint16_t index, uint8_t sub_index, const std::vector<uint8_t> &buffer){
+    boost::mutex::scoped_lock lock(mutex_);
+    objects_[key(index, sub_index)] = buffer;
+}
+std::vector<uint8_t> SimulatedSlave::getRaw(uint16_t index, uint8_t sub_index){
+    boost::mutex::scoped_lock lock(mutex_);
+    ObjectMap::iterator it = objects_.find(key(index, sub_index));
+    return it != objects_.end() ? it->second : std::vector<uint8_t>();
+}
+void SimulatedSlave::setSyncDelegate(const SyncDelegate &d){
+    boost::mutex::scoped_lock lock(mutex_);
+    sync_delegate_ = d;
+}
+SimulatedSlave::State SimulatedSlave::getState(){
+    boost::mutex::scoped_lock lock(mutex_);
+    return state_;
+}
+void SimulatedSlave::boot(){
+    boost::mutex::scoped_lock lock(mutex_);
+    switchState(BootUp);
+}
+
+uint32_t SimulatedSlave::getU32(uint16_t index, uint8_t sub_index, uint32_t def){
+    ObjectMap::iterator it = objects_.find(key(index, sub_index));
+    if(it == objects_.end() || it->second.empty()) return def;
+    uint32_t val = 0;
+    memcpy(&val, &it->second.front(), std::min(it->second.size(), sizeof(val)));
+    return val;
+}
+
+void SimulatedSlave::sendHeartbeat(){
+    can::Frame msg(can::MsgHeader(0x700 + node_id_), 1);
+    msg.data[0] = state_;
+    send(msg);
+}
+void SimulatedSlave::switchState(State s){
+    state_ = s == BootUp ? PreOperational : s; // boot-up message gets sent, the slave enters pre-operational on its own
+    if(s == Operational){
+        configurePDOs(TPDO_COM_BASE, TPDO_MAP_BASE, 0x180, tpdos_);
+        configurePDOs(RPDO_COM_BASE, RPDO_MAP_BASE, 0x200, rpdos_);
+        sync_counter_ = 0;
+    }
+    can::Frame msg(can::MsgHeader(0x700 + node_id_), 1);
+    msg.data[0] = s;
+    send(msg);
+    next_heartbeat_ = bus_->now() + boost::chrono::milliseconds(getU32(0x1017, 0, 0) & 0xFFFF);
+}
+
+void SimulatedSlave::configurePDOs(uint16_t com_base, uint16_t map_base, uint16_t default_id, std::vector<PDO> &pdos){
+    pdos.clear();
+    for(uint16_t i = 0; i < 512; ++i){
+        uint8_t num = getU32(map_base + i, 0, 0) & 0xFF;
+        if(num == 0) continue;
+
+        uint32_t cob_id = getU32(com_base + i, 1, i < 4 ? (default_id + 0x100 * i + node_id_) : COB_ID_INVALID);
+        if(cob_id & COB_ID_INVALID) continue;
+
+        PDO pdo;
+        pdo.header = can::Header(cob_id & can::Header::ID_MASK, cob_id & COB_ID_EXTENDED, false, false);
+        pdo.transmission_type = getU32(com_base + i, 2, 0xFF) & 0xFF;
+        for(uint8_t sub = 1; sub <= num && sub <= 0x40; ++sub){
+            pdo.mapping.push_back(getU32(map_base + i, sub, 0));
+        }
+        pdos.push_back(pdo);
+    }
+}
+
+void SimulatedSlave::deliver(const can::Frame &msg, bool own){
+    if(own || msg.is_error) return;
+
+    if(!msg.is_extended && msg.id == 0){
+        handleNMT(msg);
+    }else if(!msg.is_extended && msg.id == 0x600u + node_id_){
+        handleSDO(msg);
+    }else if(!msg.is_extended && msg.id == 0x80){
+        handleSync();
+    }else{
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_ != Operational) return;
+        for(std::vector<PDO>::const_iterator it = rpdos_.begin(); it != rpdos_.end(); ++it){
+            if((unsigned int)it->header == (unsigned int)msg) handleRPDO(*it, msg);
+        }
+    }
+}
+
+void SimulatedSlave::tick(const can::VirtualBus::TimePoint &now){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(state_ == BootUp) return;
+    uint16_t period = getU32(0x1017, 0, 0) & 0xFFFF;
+    if(period && now >= next_heartbeat_){
+        sendHeartbeat();
+        next_heartbeat_ = now + boost::chrono::milliseconds(period);
+    }
+}
+
+void SimulatedSlave::handleNMT(const can::Frame &msg){
+    if(msg.dlc < 2 || (msg.data[1] != 0 && msg.data[1] != node_id_)) return;
+    boost::mutex::scoped_lock lock(mutex_);
+    switch(msg.data[0]){
+        case 1:
+            if(state_ != BootUp) switchState(Operational);
+            break;
+        case 2:
+            if(state_ != BootUp) switchState(Stopped);
+            break;
+        case 128:
+            if(state_ != BootUp) switchState(PreOperational);
+            break;
+        case 129: // object values are kept over resets
+        case 130:
+            switchState(BootUp);
+            break;
+    }
+}
+
+void SimulatedSlave::abort(uint16_t index, uint8_t sub_index, uint32_t reason){
+    can::Frame msg(can::MsgHeader(0x580 + node_id_), 8);
+    msg.data.fill(0);
+    msg.data[0] = 4 << 5;
+    msg.data[1] = index & 0xFF;
+    msg.data[2] = index >> 8;
+    msg.data[3] = sub_index;
+    memcpy(&msg.data[4], &reason, 4);
+    sdo_key_ = 0;
+    send(msg);
+}
+
+void SimulatedSlave::handleSDO(const can::Frame &msg){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(msg.dlc != 8 || state_ == BootUp || state_ == Stopped) return;
+
+    uint8_t command = msg.data[0] >> 5;
+    uint16_t index = msg.data[1] | (msg.data[2] << 8);
+    uint8_t sub_index = msg.data[3];
+
+    can::Frame resp(can::MsgHeader(0x580 + node_id_), 8);
+    resp.data.fill(0);
+
+    switch(command){
+        case 1: // initiate download
+        {
+            bool expedited = msg.data[0] & 2;
+            if(expedited){
+                size_t size = (msg.data[0] & 1) ? 4 - ((msg.data[0] >> 2) & 3) : 4;
+                objects_[key(index, sub_index)].assign(&msg.data[4], &msg.data[4] + size);
+                sdo_key_ = 0;
+            }else{
+                sdo_key_ = key(index, sub_index);
+                sdo_buffer_.clear();
+                sdo_toggle_ = false;
+            }
+            resp.data[0] = 3 << 5;
+            memcpy(&resp.data[1], &msg.data[1], 3);
+            break;
+        }
+        case 0: // download segment
+        {
+            bool toggle = msg.data[0] & 0x10;
+            if(!sdo_key_ || toggle != sdo_toggle_){
+                abort(sdo_key_ >> 8, sdo_key_ & 0xFF, 0x05030000); // Toggle bit not alternated
+                return;
+            }
+            size_t size = 7 - ((msg.data[0] >> 1) & 7);
+            sdo_buffer_.insert(sdo_buffer_.end(), &msg.data[1], &msg.data[1] + size);
+            resp.data[0] = (1 << 5) | (toggle ? 0x10 : 0);
+            sdo_toggle_ = !sdo_toggle_;
+            if(msg.data[0] & 1){ // last segment
+                objects_[sdo_key_] = sdo_buffer_;
+                sdo_key_ = 0;
+            }
+            break;
+        }
+        case 2: // initiate upload
+        {
+            static const std::vector<uint8_t> unknown(4, 0);
+            ObjectMap::iterator it = objects_.find(key(index, sub_index));
+            if(it == objects_.end() && strict_){
+                abort(index, sub_index, 0x06020000); // Object does not exist in the object dictionary.
+                return;
+            }
+            const std::vector<uint8_t> &val = it != objects_.end() ? it->second : unknown;
+            memcpy(&resp.data[1], &msg.data[1], 3);
+            if(val.size() <= 4){
+                resp.data[0] = (2 << 5) | ((4 - val.size()) << 2) | 3;
+                if(!val.empty()) memcpy(&resp.data[4], &val.front(), val.size());
+                sdo_key_ = 0;
+            }else{
+                resp.data[0] = (2 << 5) | 1;
+                uint32_t size = val.size();
+                memcpy(&resp.data[4], &size, 4);
+                sdo_key_ = key(index, sub_index);
+                sdo_buffer_ = val;
+                sdo_offset_ = 0;
+                sdo_toggle_ = false;
+            }
+            break;
+        }
+        case 3: // upload segment
+        {
+            bool toggle = msg.data[0] & 0x10;
+            if(!sdo_key_ || toggle != sdo_toggle_){
+                abort(sdo_key_ >> 8, sdo_key_ & 0xFF, 0x05030000); // Toggle bit not alternated
+                return;
+            }
+            size_t size = std::min<size_t>(7, sdo_buffer_.size() - sdo_offset_);
+            memcpy(&resp.data[1], &sdo_buffer_[sdo_offset_], size);
+            sdo_offset_ += size;
+            bool done = sdo_offset_ == sdo_buffer_.size();
+            resp.data[0] = (toggle ? 0x10 : 0) | ((7 - size) << 1) | (done ? 1 : 0);
+            sdo_toggle_ = !sdo_toggle_;
+            if(done) sdo_key_ = 0;
+            break;
+        }
+        case 4: // abort
+            sdo_key_ = 0;
+            return;
+        default:
+            abort(index, sub_index, 0x05040001); // Client/server command specifier not valid or unknown.
+            return;
+    }
+    send(resp);
+}
+
+void SimulatedSlave::handleSync(){
+    SyncDelegate d;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_ != Operational) return;
+        d = sync_delegate_;
+    }
+    if(d) d(*this);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if(state_ != Operational) return;
+    ++sync_counter_;
+    for(std::vector<PDO>::const_iterator it = tpdos_.begin(); it != tpdos_.end(); ++it){
+        if(it->transmission_type > 240) continue; // not synchronous
+        if(it->transmission_type > 1 && (sync_counter_ % it->transmission_type) != 0) continue;
+
+        can::Frame msg(it->header, 0);
+        msg.data.fill(0);
+        for(std::vector<uint32_t>::const_iterator m = it->mapping.begin(); m != it->mapping.end(); ++m){
+            size_t len = (*m & 0xFF) / 8;
+            if(msg.dlc + len > can::Frame::MAX_FD_LEN) break;
+            ObjectMap::iterator obj = objects_.find(*m >> 8);
+            if(obj != objects_.end() && !obj->second.empty()){
+                memcpy(&msg.data[msg.dlc], &obj->second.front(), std::min(len, obj->second.size()));
+            }
+            msg.dlc += len;
+        }
+        if(msg.dlc > can::Frame::MAX_LEN){
+            msg.is_fd = 1;
+            msg.brs = 1;
+            msg.dlc = can::dlc2len(can::len2dlc(msg.dlc));
+        }
+        send(msg);
+    }
+}
+
+void SimulatedSlave::handleRPDO(const PDO &pdo, const can::Frame &msg){
+    size_t offset = 0;
+    for(std::vector<uint32_t>::const_iterator m = pdo.mapping.begin(); m != pdo.mapping.end(); ++m){
+        size_t len = (*m & 0xFF) / 8;
+        if(offset + len > msg.dlc) break;
+        if((*m >> 16) >= 0x1000){ // skip dummy entries
+            objects_[*m >> 8].assign(&msg.data[offset], &msg.data[offset] + len);
+        }
+        offset += len;
+    }
+}
@@ -0,0 +1,165 @@
+// Bring in my package's API, which is what I'm testing
+#include <canopen_master/objdict.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+#include "test_utils.h"
+
+using namespace canopen;
+
+size_t countEntries(const ObjectDict &dict){
+    size_t n = 0;
+    ObjectDict::const_iterator it;
+    while(dict.iterate(it)) ++n;
+    return n;
+}
+
+TEST(ObjectDictParserTest, elmo)
+{
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(configFile("Elmo.dcf"));
+    ASSERT_TRUE(dict);
+
+    const DeviceInfo &info = dict->device_info;
+    EXPECT_EQ("Elmo Motion Control", info.vendor_name);
+    EXPECT_EQ(0x9Au, info.vendor_number); // hex numbers
+    EXPECT_EQ("Gold Drive", info.product_name);
+    EXPECT_EQ(0x30923u, info.product_number);
+    EXPECT_EQ(0x103F6u, info.revision_number);
+    EXPECT_EQ(1u, info.baudrates.count(1000000));
+    EXPECT_EQ(4u, info.nr_of_rx_pdo);
+
+    EXPECT_EQ(458u, countEntries(*dict));
+
+    EXPECT_EQ(154u, (*dict)(0x1018, 1).def_val.get<uint32_t>());
+    EXPECT_TRUE(dict->has(0x1017));
+    EXPECT_FALSE(dict->has(0x1017, 0));
+
+    const ObjectDict::Entry &hb = (*dict)(0x1016, 2);
+    EXPECT_EQ("Consumer Heartbeat Time_2", hb.desc);
+    EXPECT_EQ(ObjectDict::DEFTYPE_UNSIGNED32, hb.data_type);
+    EXPECT_TRUE(hb.readable);
+    EXPECT_TRUE(hb.writable);
+
+    const ObjectDict::Entry &map = (*dict)(0x1600, 1); // ParameterValue of the DCF
+    EXPECT_EQ(0x60400010u, map.init_val.get<uint32_t>());
+    EXPECT_TRUE((*dict)(0x1600, 2).def_val.is_empty());
+    EXPECT_EQ(0x60600008u, (*dict)(0x1600, 2).init_val.get<uint32_t>());
+}
+
+TEST(ObjectDictParserTest, schunkCompactSubObjects)
+{
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(configFile("Schunk.eds"));
+    ASSERT_TRUE(dict);
+
+    EXPECT_EQ(364u, countEntries(*dict));
+
+    EXPECT_EQ(254u, (*dict)(0x1003, 0).def_val.get<uint8_t>());
+    EXPECT_EQ("NrOfObjects", (*dict)(0x1003, 0).desc);
+    EXPECT_EQ("Pre-defined error field1", (*dict)(0x1003, 1).desc);
+    EXPECT_EQ("Pre-defined error field254", (*dict)(0x1003, 254).desc);
+    EXPECT_FALSE(dict->has(0x1003, 255));
+    EXPECT_FALSE((*dict)(0x1003, 1).writable);
+
+    EXPECT_EQ(3u, (*dict)(0x1016, 0).def_val.get<uint8_t>());
+    for(uint8_t i = 1; i <= 3; ++i){
+        const ObjectDict::Entry &e = (*dict)(0x1016, i);
+        EXPECT_EQ("Consumer heartbeat time" + std::to_string(i), e.desc);
+        EXPECT_EQ(0u, e.def_val.get<uint32_t>());
+        EXPECT_TRUE(e.writable);
+    }
+    EXPECT_FALSE(dict->has(0x1016, 4));
+
+    const ObjectDict::Entry &sw = (*dict)(0x6041);
+    EXPECT_EQ(ObjectDict::DEFTYPE_UNSIGNED16, sw.data_type);
+    EXPECT_TRUE(sw.readable);
+    EXPECT_FALSE(sw.writable);
+    EXPECT_TRUE(sw.mappable);
+}
+
+TEST(ObjectDictParserTest, schunkNodeIdOffsets)
+{
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(configFile("Schunk_0_63.dcf"));
+    ASSERT_TRUE(dict);
+
+    EXPECT_EQ("SCHUNK GmbH & Co. KG", dict->device_info.vendor_name);
+    EXPECT_EQ(202u, countEntries(*dict));
+
+    const ObjectDict::Entry &cob_id = (*dict)(0x1400, 1);
+    EXPECT_EQ(0x205u, NodeIdOffset<uint32_t>::apply(cob_id.def_val, 5));
+    EXPECT_EQ(0x205u, NodeIdOffset<uint32_t>::apply(cob_id.init_val, 5));
+    EXPECT_EQ(0x201u, NodeIdOffset<uint32_t>::apply(cob_id.init_val, 1));
+
+    EXPECT_EQ(255u, (*dict)(0x1400, 2).def_val.get<uint8_t>());
+    EXPECT_EQ(1u, (*dict)(0x1400, 2).init_val.get<uint8_t>());
+}
+
+TEST(ObjectDictParserTest, overlay)
+{
+    ObjectDict::Overlay overlay;
+    overlay.push_back(std::make_pair("1017", "100"));
+    overlay.push_back(std::make_pair("1400sub2", "0xFE"));
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(configFile("Elmo.dcf"), overlay);
+    ASSERT_TRUE(dict);
+    EXPECT_EQ(100u, (*dict)(0x1017).init_val.get<uint16_t>());
+    EXPECT_EQ(0xFEu, (*dict)(0x1400, 2).init_val.get<uint8_t>());
+}
+
+TEST(ObjectDictParserTest, octetValues)
+{
+    TempFile file("[DeviceInfo]\n[MandatoryObjects]\nSupportedObjects=3\n1=0x1000\n2=0x1001\n3=0x1002\n"
+        "[1000]\nParameterName=a\nDataType=0xA\nAccessType=rw\nDefaultValue=0x0102\nParameterValue=a0b\n"
+        "[1001]\nParameterName=b\nDataType=0xF\nAccessType=rw\nDefaultValue=image.bin\n"
+        "[1002]\nParameterName=c\nDataType=0xA\nAccessType=rw\nDefaultValue=\n");
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(file.path);
+
+    const ObjectDict::Entry &a = (*dict)(0x1000);
+    EXPECT_EQ(std::string("\x01\x02"), (const std::string&) a.def_val.get<ObjectStorage::DataType<ObjectDict::DEFTYPE_OCTET_STRING>::type>());
+    EXPECT_EQ(std::string("\x0a\x0b"), (const std::string&) a.init_val.get<ObjectStorage::DataType<ObjectDict::DEFTYPE_OCTET_STRING>::type>());
+
+    const ObjectDict::Entry &b = (*dict)(0x1001); // not hex, kept empty
+    EXPECT_TRUE(b.def_val.is_empty());
+    EXPECT_TRUE(b.def_val.type().is_type<ObjectStorage::DataType<ObjectDict::DEFTYPE_DOMAIN>::type>());
+
+    const ObjectDict::Entry &c = (*dict)(0x1002);
+    EXPECT_FALSE(c.def_val.is_empty());
+    EXPECT_EQ(0u, c.def_val.data().size());
+}
+
+struct MalformedInput{
+    const char *text;
+    const char *error;
+};
+
+TEST(ObjectDictParserTest, errorsReportLineNumbers)
+{
+    const std::string objects = "[DeviceInfo]\n[MandatoryObjects]\nSupportedObjects=1\n1=0x1000\n[1000]\nParameterName=a\n";
+    const MalformedInput inputs[] = {
+        { "[DeviceInfo]\nx\n", "line 2: '=' expected" },
+        { "[DeviceInfo]\n[DEVICEINFO]\n", "line 2: duplicate section [DEVICEINFO]" },
+        { "[DeviceInfo]\n[MandatoryObjects]\nSupportedObjects=2\n1=0x1000\n", "line 2: [MandatoryObjects] has no entry 2" },
+        { "DataType=0x7\nAccessType=xx\n", "line 8: invalid AccessType 'xx'" },
+        { "DataType=0x8\nAccessType=ro\nDefaultValue=1.5x\n", "line 9: invalid value '1.5x'" },
+        { "", "[DeviceInfo] is missing" },
+    };
+    for(size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i){
+        std::string text = inputs[i].text;
+        if(text.compare(0, 1, "[") != 0 && !text.empty()) text = objects + text;
+        TempFile file(text);
+        try{
+            ObjectDict::fromFile(file.path);
+            ADD_FAILURE() << "no exception for input " << i;
+        }
+        catch(const ParseException &e){
+            EXPECT_NE(std::string::npos, std::string(e.what()).find(inputs[i].error)) << e.what();
+            EXPECT_EQ(0u, std::string(e.what()).find(file.path)) << e.what();
+        }
+    }
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+  ObjectDict::setCacheDirectory(""); // tests that use the cache set their own directory
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
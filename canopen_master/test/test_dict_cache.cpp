@@ -0,0 +1,172 @@
+#include <canopen_master/objdict.h>
+
+#include <gtest/gtest.h>
+
+#include "test_utils.h"
+
+using namespace canopen;
+
+/** enables the cache in a temporary directory */
+class ScopedCache : public TempDirectory{
+public:
+    ScopedCache() { ObjectDict::setCacheDirectory(path); }
+    ~ScopedCache() { ObjectDict::setCacheDirectory(""); }
+};
+
+std::string readFile(const std::string &path){
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &path, const std::string &contents){
+    std::ofstream(path.c_str(), std::ios::binary | std::ios::trunc) << contents;
+}
+
+void expectEqualValues(const HoldAny &a, const HoldAny &b, const std::string &what){
+    ASSERT_EQ(a.type().valid(), b.type().valid()) << what;
+    if(a.type().valid()){
+        EXPECT_TRUE(a.type() == b.type()) << what;
+    }
+    ASSERT_EQ(a.is_empty(), b.is_empty()) << what;
+    if(!a.is_empty()){
+        EXPECT_TRUE(a.data() == b.data()) << what;
+    }
+}
+
+void expectEqualDicts(const ObjectDict &a, const ObjectDict &b){
+    EXPECT_EQ(a.device_info.vendor_name, b.device_info.vendor_name);
+    EXPECT_EQ(a.device_info.product_number, b.device_info.product_number);
+    EXPECT_TRUE(a.device_info.baudrates == b.device_info.baudrates);
+    EXPECT_TRUE(a.device_info.dummy_usage == b.device_info.dummy_usage);
+
+    ObjectDict::const_iterator ia, ib;
+    while(a.iterate(ia)){
+        ASSERT_TRUE(b.iterate(ib));
+        ASSERT_EQ(ia->first.hash, ib->first.hash);
+        const ObjectDict::Entry &ea = *ia->second, &eb = *ib->second;
+        const std::string what = ia->first;
+        EXPECT_EQ(ea.obj_code, eb.obj_code) << what;
+        EXPECT_EQ(ea.sub_index, eb.sub_index) << what;
+        EXPECT_EQ(ea.data_type, eb.data_type) << what;
+        EXPECT_EQ(ea.constant, eb.constant) << what;
+        EXPECT_EQ(ea.readable, eb.readable) << what;
+        EXPECT_EQ(ea.writable, eb.writable) << what;
+        EXPECT_EQ(ea.mappable, eb.mappable) << what;
+        EXPECT_EQ(ea.desc, eb.desc) << what;
+        expectEqualValues(ea.def_val, eb.def_val, what + " DefaultValue");
+        expectEqualValues(ea.init_val, eb.init_val, what + " ParameterValue");
+    }
+    EXPECT_FALSE(b.iterate(ib));
+}
+
+const std::string SOURCE =
+    "[DeviceInfo]\nVendorName=test\n"
+    "[MandatoryObjects]\nSupportedObjects=1\n1=0x1000\n"
+    "[1000]\nParameterName=Device type\nObjectType=0x7\nDataType=0x0007\nAccessType=ro\nDefaultValue=0x1234\n";
+
+TEST(DictCacheTest, roundTrip)
+{
+    const char *files[] = { "Elmo.dcf", "Schunk.eds", "Schunk_0_63.dcf" };
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i){
+        boost::shared_ptr<ObjectDict> parsed = ObjectDict::fromFile(configFile(files[i]));
+
+        ScopedCache cache;
+        boost::shared_ptr<ObjectDict> stored = ObjectDict::fromFile(configFile(files[i]));
+        ASSERT_EQ(1u, cache.files().size()) << files[i];
+        boost::shared_ptr<ObjectDict> loaded = ObjectDict::fromFile(configFile(files[i]));
+
+        SCOPED_TRACE(files[i]);
+        expectEqualDicts(*parsed, *stored);
+        expectEqualDicts(*parsed, *loaded);
+    }
+}
+
+TEST(DictCacheTest, usedUntilSourceChanges)
+{
+    ScopedCache cache;
+    TempFile source(SOURCE);
+    EXPECT_EQ("Device type", ObjectDict::fromFile(source.path)->get(0x1000)->desc);
+
+    // patch the compiled file to see that it gets loaded instead of the source
+    ASSERT_EQ(1u, cache.files().size());
+    const std::string compiled = cache.files().front();
+    std::string contents = readFile(compiled);
+    size_t pos = contents.find("Device type");
+    ASSERT_NE(std::string::npos, pos);
+    contents[pos] = 'd';
+    writeFile(compiled, contents);
+    EXPECT_EQ("device type", ObjectDict::fromFile(source.path)->get(0x1000)->desc);
+
+    source.write(SOURCE + "ParameterValue=0x5678\n");
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(source.path);
+    EXPECT_EQ("Device type", dict->get(0x1000)->desc);
+    EXPECT_EQ(0x5678u, dict->get(0x1000)->init_val.get<uint32_t>());
+    EXPECT_EQ(2u, cache.files().size()); // keyed by the contents
+}
+
+TEST(DictCacheTest, invalidFilesGetReplaced)
+{
+    ScopedCache cache;
+    TempFile source(SOURCE);
+    ObjectDict::fromFile(source.path);
+    ASSERT_EQ(1u, cache.files().size());
+    const std::string compiled = cache.files().front();
+    const std::string valid = readFile(compiled);
+    ASSERT_GT(valid.size(), 12u);
+
+    std::string other_version = valid;
+    other_version[8] ^= 0x80; // version follows the 8-byte magic
+    std::string wrong_magic = valid;
+    wrong_magic[0] = 'X';
+    const std::string invalid[] = { other_version, wrong_magic, valid.substr(0, valid.size() / 2), std::string() };
+
+    for(size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i){
+        writeFile(compiled, invalid[i]);
+        boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(source.path);
+        EXPECT_EQ("Device type", dict->get(0x1000)->desc) << i;
+        EXPECT_EQ(0x1234u, dict->get(0x1000)->def_val.get<uint32_t>()) << i;
+        EXPECT_TRUE(valid == readFile(compiled)) << i;
+    }
+    EXPECT_EQ(1u, cache.files().size()); // no temporary files left behind
+}
+
+TEST(DictCacheTest, overlayIsNotCached)
+{
+    ScopedCache cache;
+    boost::shared_ptr<ObjectDict> plain = ObjectDict::fromFile(configFile("Elmo.dcf"));
+
+    ObjectDict::Overlay overlay;
+    overlay.push_back(std::make_pair("1017", "100"));
+    overlay.push_back(std::make_pair("1400sub2", "0xFE"));
+    boost::shared_ptr<ObjectDict> dict = ObjectDict::fromFile(configFile("Elmo.dcf"), overlay);
+    EXPECT_EQ(100u, (*dict)(0x1017).init_val.get<uint16_t>());
+    EXPECT_EQ(0xFEu, (*dict)(0x1400, 2).init_val.get<uint8_t>());
+
+    expectEqualDicts(*plain, *ObjectDict::fromFile(configFile("Elmo.dcf")));
+    EXPECT_EQ(1u, cache.files().size());
+}
+
+TEST(DictCacheTest, getShared)
+{
+    ScopedCache cache;
+    ObjectDict::Overlay overlay;
+    overlay.push_back(std::make_pair("1017", "100"));
+
+    boost::shared_ptr<const ObjectDict> a = ObjectDict::getShared(configFile("Elmo.dcf"));
+    boost::shared_ptr<const ObjectDict> b = ObjectDict::getShared(configFile("Elmo.dcf"));
+    boost::shared_ptr<const ObjectDict> c = ObjectDict::getShared(configFile("Elmo.dcf"), overlay);
+    boost::shared_ptr<const ObjectDict> d = ObjectDict::getShared(configFile("Elmo.dcf"), overlay);
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(c, d);
+    EXPECT_NE(a, c);
+    EXPECT_EQ(100u, (*c)(0x1017).init_val.get<uint16_t>());
+    EXPECT_NE(100u, (*a)(0x1017).value().get<uint16_t>());
+
+    TempFile source(SOURCE);
+    boost::shared_ptr<const ObjectDict> e = ObjectDict::getShared(source.path);
+    source.write(SOURCE + "ParameterValue=0x5678\n");
+    boost::shared_ptr<const ObjectDict> f = ObjectDict::getShared(source.path);
+    EXPECT_NE(e, f); // new contents, new dictionary
+    EXPECT_TRUE(e->get(0x1000)->init_val.is_empty());
+    EXPECT_EQ(0x5678u, f->get(0x1000)->init_val.get<uint32_t>());
+}
@@ -0,0 +1,137 @@
+#include <canopen_master/objdict.h>
+
+#include <set>
+
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+typedef std::vector<std::pair<bool, boost::shared_ptr<const ObjectDict::Entry> > > EntryList;
+
+boost::shared_ptr<const ObjectDict::Entry> makeEntry(bool is_sub, uint16_t index, uint8_t sub_index, const std::string &desc = "entry"){
+    if(is_sub) return boost::make_shared<ObjectDict::Entry>(index, sub_index, ObjectDict::DEFTYPE_UNSIGNED8, desc);
+    return boost::make_shared<ObjectDict::Entry>(ObjectDict::VAR, index, ObjectDict::DEFTYPE_UNSIGNED8, desc);
+}
+
+/** all keys get found, iteration is sorted and complete */
+void checkDict(const ObjectDict &dict, const std::set<size_t> &keys){
+    for(std::set<size_t>::const_iterator it = keys.begin(); it != keys.end(); ++it){
+        ObjectDict::Key key = (*it & 0xFFFF) == 0xFFFF ? ObjectDict::Key(*it >> 16) : ObjectDict::Key(*it >> 16, *it & 0xFF);
+        ASSERT_TRUE(dict.has(key)) << std::string(key);
+        EXPECT_EQ(key.index(), dict.get(key)->index);
+        if(key.hasSub()){
+            EXPECT_EQ(key.sub_index(), dict.get(key)->sub_index);
+        }
+    }
+    std::set<size_t>::const_iterator expected = keys.begin();
+    ObjectDict::const_iterator it;
+    while(dict.iterate(it)){
+        ASSERT_TRUE(expected != keys.end());
+        EXPECT_EQ(*expected, it->first.hash);
+        ++expected;
+    }
+    EXPECT_TRUE(expected == keys.end());
+}
+
+TEST(ObjectDictTest, empty)
+{
+    ObjectDict dict((DeviceInfo()));
+    EXPECT_FALSE(dict.has(0x1000));
+    EXPECT_FALSE(dict.has(0x1000, 0));
+    EXPECT_THROW(dict.get(ObjectDict::Key(0x1000)), std::out_of_range);
+    ObjectDict::const_iterator it;
+    EXPECT_FALSE(dict.iterate(it));
+
+    ObjectDict bulk((DeviceInfo()), EntryList());
+    EXPECT_FALSE(bulk.has(0x1000));
+    EXPECT_FALSE(bulk.iterate(it));
+}
+
+TEST(ObjectDictTest, subIndex0xFF)
+{
+    ObjectDict dict((DeviceInfo()));
+    EXPECT_TRUE(dict.insert(true, makeEntry(true, 0x2000, 0xFF, "sub")));
+    EXPECT_FALSE(dict.has(0x2000)); // an object without sub-index is a different key
+    EXPECT_TRUE(dict.insert(false, makeEntry(false, 0x2000, 0, "var")));
+    EXPECT_FALSE(dict.insert(true, makeEntry(true, 0x2000, 0xFF, "duplicate")));
+
+    EXPECT_EQ("sub", dict(0x2000, 0xFF).desc);
+    EXPECT_EQ("var", dict(0x2000).desc);
+    EXPECT_FALSE(dict.has(0x2000, 0xFE));
+    EXPECT_FALSE(dict.has(0x2000, 0));
+    EXPECT_FALSE(dict.has(0x20FF));
+    EXPECT_THROW(dict.get(ObjectDict::Key(0x2000, 0)), std::out_of_range);
+
+    EntryList entries;
+    entries.push_back(std::make_pair(false, makeEntry(false, 0x2000, 0, "var")));
+    entries.push_back(std::make_pair(true, makeEntry(true, 0x2000, 0xFF, "sub")));
+    entries.push_back(std::make_pair(true, makeEntry(true, 0x2000, 0xFF, "duplicate"))); // first one wins
+    ObjectDict bulk((DeviceInfo()), entries);
+    EXPECT_EQ("sub", bulk(0x2000, 0xFF).desc);
+    EXPECT_EQ("var", bulk(0x2000).desc);
+    EXPECT_EQ(0xFF, bulk(0x2000, 0xFF).sub_index);
+
+    std::set<size_t> keys;
+    keys.insert(ObjectDict::Key(0x2000).hash);
+    keys.insert(ObjectDict::Key(0x2000, 0xFF).hash);
+    checkDict(dict, keys);
+    checkDict(bulk, keys);
+}
+
+TEST(ObjectDictTest, aroundMinimumTableSize)
+{
+    // 16 slots hold up to 8 entries, grow to 32 for the 9th
+    for(size_t n = 1; n <= 20; ++n){
+        ObjectDict dict((DeviceInfo()));
+        EntryList entries;
+        std::set<size_t> keys;
+        for(size_t i = 0; i < n; ++i){
+            bool is_sub = i % 2;
+            uint16_t index = 0x1000 + 0x100 * (i / 4); // similar keys, many probe collisions
+            uint8_t sub_index = i % 4;
+            boost::shared_ptr<const ObjectDict::Entry> e = makeEntry(is_sub, index, sub_index);
+            if(!dict.insert(is_sub, e)) continue; // every other entry is a duplicate VAR
+            entries.push_back(std::make_pair(is_sub, e));
+            keys.insert((is_sub ? ObjectDict::Key(index, sub_index) : ObjectDict::Key(index)).hash);
+        }
+        ObjectDict bulk((DeviceInfo()), entries);
+        checkDict(dict, keys);
+        checkDict(bulk, keys);
+
+        for(uint16_t index = 0x0F00; index < 0x1000 + 0x100 * (n / 4 + 2); index += 0x80){
+            for(int sub = 0; sub < 0x100; sub += 0x3F){
+                bool expected = keys.count(ObjectDict::Key(index, sub).hash);
+                EXPECT_EQ(expected, dict.has(index, sub)) << n;
+                EXPECT_EQ(expected, bulk.has(index, sub)) << n;
+            }
+            EXPECT_EQ(keys.count(ObjectDict::Key(index).hash) != 0, dict.has(index)) << n;
+        }
+    }
+}
+
+TEST(ObjectDictTest, manyKeys)
+{
+    EntryList entries;
+    std::set<size_t> keys;
+    unsigned int seed = 1;
+    for(size_t i = 0; i < 3000; ++i){
+        seed = seed * 1103515245 + 12345;
+        uint16_t index = (seed >> 8) & 0xFFFF;
+        uint8_t sub_index = seed >> 24;
+        bool is_sub = sub_index != 0xFF || (seed & 1);
+        entries.push_back(std::make_pair(is_sub, makeEntry(is_sub, index, sub_index)));
+        keys.insert((is_sub ? ObjectDict::Key(index, sub_index) : ObjectDict::Key(index)).hash);
+    }
+    ObjectDict bulk((DeviceInfo()), entries);
+    checkDict(bulk, keys);
+
+    size_t misses = 0;
+    for(uint32_t k = 0; k < 0x10000; ++k){
+        uint16_t index = k * 7919;
+        uint8_t sub_index = k;
+        bool expected = keys.count(ObjectDict::Key(index, sub_index).hash);
+        EXPECT_EQ(expected, bulk.has(index, sub_index));
+        misses += !expected;
+    }
+    EXPECT_GT(misses, 0u);
+}
@@ -0,0 +1,129 @@
+#include <canopen_master/objdict.h>
+
+#include <gtest/gtest.h>
+
+using canopen::String;
+using canopen::HoldAny;
+
+bool isInline(const String &s){
+    const char *p = s.data(), *o = reinterpret_cast<const char*>(&s);
+    return p >= o && p < o + sizeof(String);
+}
+
+TEST(StringTest, smallValuesStayInline)
+{
+    String s;
+    EXPECT_TRUE(s.empty());
+    EXPECT_TRUE(isInline(s));
+
+    s.resize(sizeof(uint32_t));
+    EXPECT_EQ(0, s[0]); // zero-initialized
+    EXPECT_EQ(0, s[3]);
+    *reinterpret_cast<uint32_t*>(&s.front()) = 0xdeadbeef;
+    s.resize(String::INLINE_SIZE);
+    EXPECT_TRUE(isInline(s));
+    EXPECT_EQ(0xdeadbeef, *reinterpret_cast<const uint32_t*>(s.data()));
+    EXPECT_EQ(0, s[String::INLINE_SIZE - 1]);
+
+    String copy(s);
+    EXPECT_TRUE(isInline(copy));
+    EXPECT_TRUE(copy == s);
+}
+
+TEST(StringTest, growToHeap)
+{
+    String s(std::string("abc"));
+    s.resize(String::INLINE_SIZE + 1);
+    EXPECT_FALSE(isInline(s));
+    EXPECT_EQ(std::string("abc") + std::string(String::INLINE_SIZE - 2, '\0'), (const std::string&) s);
+
+    s.resize(100);
+    EXPECT_GE(s.capacity(), 100u);
+    EXPECT_EQ('c', s[2]);
+    EXPECT_EQ(0, s[99]);
+
+    s.clear(); // keeps the heap buffer like std::vector
+    EXPECT_TRUE(s.empty());
+    EXPECT_GE(s.capacity(), 100u);
+}
+
+TEST(StringTest, assign)
+{
+    const std::string large(40, 'x');
+    std::vector<char> small(3, 'y');
+
+    String s;
+    s.assign(small.begin(), small.end());
+    EXPECT_TRUE(isInline(s));
+    EXPECT_EQ("yyy", (const std::string&) s);
+
+    s.assign(large.begin(), large.end());
+    EXPECT_FALSE(isInline(s));
+    EXPECT_EQ(large, (const std::string&) s);
+
+    s.assign(small.begin(), small.end()); // reuses the heap buffer
+    EXPECT_EQ("yyy", (const std::string&) s);
+
+    s = s;
+    EXPECT_EQ("yyy", (const std::string&) s);
+}
+
+TEST(StringTest, copyAndSwap)
+{
+    const std::string large(40, 'x');
+    String heap(large), small(std::string("ab"));
+
+    String copy(heap);
+    EXPECT_NE(heap.data(), copy.data());
+    copy[0] = 'z';
+    EXPECT_EQ('x', heap[0]);
+    EXPECT_TRUE(copy != heap);
+
+    copy = small;
+    EXPECT_TRUE(copy == small);
+    small = heap;
+    EXPECT_TRUE(small == heap);
+    EXPECT_FALSE(isInline(small));
+
+    String a(std::string("inline")), b(large);
+    a.swap(b);
+    EXPECT_EQ(large, (const std::string&) a);
+    EXPECT_EQ("inline", (const std::string&) b);
+    EXPECT_FALSE(isInline(a));
+    EXPECT_TRUE(isInline(b));
+
+    String c(std::string("other"));
+    c.swap(b);
+    EXPECT_EQ("inline", (const std::string&) c);
+    EXPECT_EQ("other", (const std::string&) b);
+}
+
+TEST(StringTest, access)
+{
+    String empty;
+    EXPECT_THROW(empty.at(0), std::out_of_range);
+    EXPECT_THROW((void)(const char*) empty, std::out_of_range);
+
+    String s(std::string("abc"));
+    EXPECT_EQ('c', s.at(2));
+    EXPECT_THROW(s.at(3), std::out_of_range);
+    EXPECT_EQ(3, s.end() - s.begin());
+}
+
+TEST(StringTest, holdAnyStoresContent)
+{
+    const std::string large(40, 'x');
+    HoldAny small_val(String(std::string("abc"))), large_val((String(large)));
+
+    EXPECT_TRUE(small_val.type().is_type<String>());
+    EXPECT_EQ("abc", (const std::string&) small_val.get<String>());
+    EXPECT_EQ(3u, small_val.data().size());
+    EXPECT_EQ(large, (const std::string&) large_val.get<String>());
+
+    HoldAny copy = large_val;
+    EXPECT_TRUE(copy.data() == large_val.data());
+
+    HoldAny number(uint32_t(0x12345678));
+    EXPECT_EQ(sizeof(uint32_t), number.data().size());
+    EXPECT_EQ(0x12345678u, number.get<uint32_t>());
+}
@@ -0,0 +1,62 @@
+#ifndef CANOPEN_MASTER_TEST_UTILS_H
+#define CANOPEN_MASTER_TEST_UTILS_H
+
+#include <boost/noncopyable.hpp>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** bundled EDS/DCF files of canopen_test_utils, CANOPEN_TEST_CONFIG_DIR is set by CMakeLists.txt */
+inline std::string configFile(const std::string &name){
+    return std::string(CANOPEN_TEST_CONFIG_DIR) + "/" + name;
+}
+
+/** file with the given contents, removed on destruction */
+class TempFile : boost::noncopyable{
+public:
+    std::string path;
+    TempFile(const std::string &contents){
+        char name[] = "/tmp/canopen_test_XXXXXX";
+        int fd = mkstemp(name);
+        if(fd >= 0) close(fd);
+        path = name;
+        write(contents);
+    }
+    void write(const std::string &contents){
+        std::ofstream(path.c_str(), std::ios::binary | std::ios::trunc) << contents;
+    }
+    ~TempFile(){
+        unlink(path.c_str());
+    }
+};
+
+/** empty directory, removed with its files on destruction */
+class TempDirectory : boost::noncopyable{
+public:
+    std::string path;
+    TempDirectory(){
+        char name[] = "/tmp/canopen_test_XXXXXX";
+        if(mkdtemp(name)) path = name;
+    }
+    std::vector<std::string> files() const{
+        std::vector<std::string> names;
+        if(DIR *dir = opendir(path.c_str())){
+            while(dirent *e = readdir(dir)){
+                std::string name = e->d_name;
+                if(name != "." && name != "..") names.push_back(path + "/" + name);
+            }
+            closedir(dir);
+        }
+        return names;
+    }
+    ~TempDirectory(){
+        std::vector<std::string> names = files();
+        for(size_t i = 0; i < names.size(); ++i) unlink(names[i].c_str());
+        rmdir(path.c_str());
+    }
+};
+
+#endif
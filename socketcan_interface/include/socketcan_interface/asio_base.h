@@ -3,35 +3,262 @@
 
 #include <socketcan_interface/interface.h>
 #include <socketcan_interface/dispatcher.h>
+#include <socketcan_interface/reactor.h>
+#include <socketcan_interface/ring.h>
+#include <socketcan_interface/statistics.h>
+#include <socketcan_interface/thread_config.h>
 #include <boost/asio.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <vector>
+#include <algorithm>
 
 namespace can{
 
 
 template<typename Socket> class AsioDriver : public DriverInterface{
-    typedef FilteredDispatcher<const unsigned int, CommInterface::FrameListener> FrameDispatcher;
+    typedef TableDispatcher<CommInterface::FrameListener> FrameDispatcher;
     typedef SimpleDispatcher<StateInterface::StateListener> StateDispatcher;
-    FrameDispatcher frame_dispatcher_;
     StateDispatcher state_dispatcher_;
   
     State state_;
     boost::mutex state_mutex_;
     boost::mutex socket_mutex_;
+
+    boost::atomic<bool> batch_active_;
+    boost::thread::id batch_owner_;
+    boost::mutex batch_mutex_;
+    std::vector<Frame> batch_;
+
+    StatisticsCounter statistics_;
+    boost::atomic<size_t> max_queue_depth_;
+
+    /** listeners of one dispatch class with their own input queue and dispatch thread (or the shared one of a reactor) */
+    class Lane : boost::noncopyable{
+        boost::mutex mutex_;
+        boost::condition_variable cond_;
+        bool running_;
+        bool pending_; ///< frames were committed since last notify, only accessed by reader
+        boost::atomic<boost::int64_t> notified_; ///< steady clock time of the oldest notify that was not drained yet, 0 if none
+        StatisticsCounter &statistics_;
+        boost::thread thread_;
+        boost::asio::io_service *service_; ///< shared dispatch thread, 0 if the lane has its own thread
+        boost::atomic<bool> scheduled_; ///< drain was posted to the shared dispatch thread
+
+        static boost::int64_t now(){
+            return boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void drain(){
+            boost::int64_t notified = notified_.exchange(0, boost::memory_order_relaxed);
+            while(const Frame *msg = input.front()){
+                dispatcher.dispatch(*msg);
+                input.pop();
+            }
+            if(notified) statistics_.updateLatency(boost::chrono::nanoseconds(now() - notified));
+        }
+        void loop(){
+            if(!name.empty()) config.apply(name);
+            boost::mutex::scoped_lock lock(mutex_);
+            while(running_){
+                if(input.empty()){
+                    cond_.wait(lock);
+                    continue;
+                }
+                lock.unlock();
+                drain();
+                lock.lock();
+            }
+        }
+        void schedule(){
+            if(!scheduled_.exchange(true)) service_->post(boost::bind(&Lane::drainShared, this));
+        }
+        void drainShared(){
+            drain();
+            boost::mutex::scoped_lock lock(mutex_); // stop() must not return before the lane is released
+            scheduled_ = false;
+            if(!input.empty()) schedule(); // frames were committed while the flag was still set
+            cond_.notify_all();
+        }
+    public:
+        FrameDispatcher dispatcher;
+        SPSCRing<Frame> input; ///< frames that were read, but not dispatched yet; written by reader, read by dispatch thread
+        ThreadConfig config; ///< gets applied to the dispatch thread, if name is set
+        std::string name;
+
+        Lane(size_t input_size, StatisticsCounter &statistics, boost::asio::io_service *service)
+        : running_(false), pending_(false), notified_(0), statistics_(statistics), service_(service), scheduled_(false), input(input_size) {}
+
+        void commit(){
+            input.commit();
+            pending_ = true;
+        }
+        bool push(const Frame &msg){
+            Frame *slot = input.reserve();
+            if(!slot) return false;
+            *slot = msg;
+            commit();
+            return true;
+        }
+        /** wake up dispatch thread, if frames were committed */
+        void notify(){
+            if(pending_){
+                pending_ = false;
+                boost::int64_t expected = 0;
+                notified_.compare_exchange_strong(expected, now(), boost::memory_order_relaxed); // keep older stamp
+                if(service_){
+                    schedule();
+                    return;
+                }
+                { boost::mutex::scoped_lock lock(mutex_); } // dispatch thread either waits already or will see the frames
+                cond_.notify_one();
+            }
+        }
+        void start(){
+            while(input.front()) input.pop(); // drop stale frames, reader and dispatcher are not running
+            pending_ = false;
+            notified_ = 0;
+            running_ = true;
+            if(!service_) thread_ = boost::thread(&Lane::loop, this);
+        }
+        void stop(){
+            boost::mutex::scoped_lock lock(mutex_);
+            running_ = false;
+            if(service_){
+                while(scheduled_) cond_.wait(lock); // pending frames get dispatched
+                return;
+            }
+            lock.unlock();
+            cond_.notify_one();
+            if(thread_.joinable()) thread_.join();
+        }
+    };
+    static const size_t NUM_LANES = background_dispatch + 1;
+    boost::scoped_ptr<Lane> lanes_[NUM_LANES];
+    Frame overrun_frame_; ///< gets filled if the realtime input is full
+
+    Reactor::Ptr reactor_; ///< shared IO threads, if set
+    boost::asio::io_service own_io_service_; ///< used if there is no reactor
+
+    boost::mutex run_mutex_;
+    boost::condition_variable run_cond_;
+    bool stopped_; ///< run() should return, only used with a reactor
+    size_t handlers_; ///< pending tracked handlers, protected by run_mutex_
+
+    void handlerDone(){
+        boost::mutex::scoped_lock lock(run_mutex_);
+        if(--handlers_ == 0) run_cond_.notify_all();
+    }
+
+    size_t queueDepth(){
+        size_t depth = 0;
+        for(size_t i = 0; i < NUM_LANES; ++i) depth += lanes_[i]->input.size();
+        return depth;
+    }
+
+    /** count a received frame that had to be dropped, because an input queue was full */
+    void inputOverrun(){
+        boost::mutex::scoped_lock lock(state_mutex_);
+        ++state_.rx_overruns; // no state dispatch, this would flood the listeners
+    }
     
 protected:
-    boost::asio::io_service io_service_;
-    boost::asio::strand strand_;
+    boost::asio::io_service &io_service_; ///< own io_service or the one of the reactor
     Socket socket_;
-    Frame input_;
+
+    /** completion handler wrapper, so the driver can wait for its handlers before it gets destroyed or run() returns */
+    template<typename Handler> class TrackedHandler{
+        AsioDriver *driver_;
+        Handler handler_;
+    public:
+        TrackedHandler(AsioDriver *driver, const Handler &handler) : driver_(driver), handler_(handler) {}
+        void operator()(const boost::system::error_code& error){
+            handler_(error);
+            driver_->handlerDone();
+        }
+        void operator()(const boost::system::error_code& error, std::size_t){ // read and write operations
+            handler_(error);
+            driver_->handlerDone();
+        }
+    };
+    /** wrap the handler of an asynchronous operation, needed for all operations of derived drivers that can run on a reactor */
+    template<typename Handler> TrackedHandler<Handler> track(const Handler &handler){
+        boost::mutex::scoped_lock lock(run_mutex_);
+        ++handlers_;
+        return TrackedHandler<Handler>(this, handler);
+    }
+    const Reactor::Ptr& getReactor() const { return reactor_; }
+
+    /** wait until all tracked handlers have completed, has to be called by destructors of derived drivers after shutdown */
+    void waitForHandlers(){
+        if(!reactor_) return; // handlers are destroyed together with the own io_service
+        boost::mutex::scoped_lock lock(run_mutex_);
+        while(handlers_ != 0) run_cond_.wait(lock);
+    }
     
     virtual void triggerReadSome() = 0;
     virtual bool enqueue(const Frame & msg) = 0;
+    virtual bool enqueueBatch(const std::vector<Frame> & msgs){
+        for(std::vector<Frame>::const_iterator it = msgs.begin(); it != msgs.end(); ++it){
+            if(!enqueue(*it)) return false;
+        }
+        return true;
+    }
     
-    void dispatchFrame(const Frame &msg){
-        strand_.post(boost::bind(&FrameDispatcher::dispatch, &frame_dispatcher_, msg)); // copies msg
+    /** gets called after frame listeners were added or removed */
+    virtual void listenersChanged() {}
+    /**
+     * get the keys of all registered frame listeners
+     * @return false if catch-all listeners are registered
+     */
+    bool getListenedKeys(std::vector<unsigned int> &keys){
+        keys.clear();
+        bool filtered = true;
+        for(size_t i = 0; i < NUM_LANES; ++i){
+            if(!lanes_[i]->dispatcher.getKeys(keys)) filtered = false;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        return filtered;
+    }
+
+    /**
+     * get slot for the next received frame, the frame gets converted in-place.
+     * Must be followed by commitInput, only to be called from the reader.
+     */
+    Frame& reserveInput(){
+        Frame *msg = lanes_[realtime_dispatch]->input.reserve();
+        return msg ? *msg : overrun_frame_;
+    }
+    /** pass frame from reserveInput to all dispatch classes that listen to it */
+    void commitInput(Frame &msg){
+        statistics_.countRx(msg);
+        for(size_t i = 0; i < NUM_LANES; ++i){
+            Lane &lane = *lanes_[i];
+            if(!lane.dispatcher.hasListeners(msg)) continue;
+
+            if(i != realtime_dispatch){
+                if(!lane.push(msg)) inputOverrun();
+            }else if(&msg != &overrun_frame_){
+                lane.commit(); // no copy
+            }else{
+                inputOverrun();
+            }
+        }
+    }
+    /** counters are updated by AsioDriver, derived drivers can set bit rate and window length */
+    StatisticsCounter& statistics() { return statistics_; }
+    /** configure dispatch thread of a dispatch class, takes effect on next run() */
+    void setDispatchThreadConfig(DispatchClass dispatch_class, const ThreadConfig &config, const std::string &name){
+        lanes_[dispatch_class]->config = config;
+        lanes_[dispatch_class]->name = name;
+        if(reactor_ && !name.empty() && (config.policy >= 0 || !config.cpus.empty())){
+            reactor_->configureDispatchThread(dispatch_class, config, name); // shared by all drivers, last one wins
+        }
     }
     void setErrorCode(const boost::system::error_code& error){
         boost::mutex::scoped_lock lock(state_mutex_);
@@ -55,64 +282,172 @@ protected:
             state_dispatcher_.dispatch(state_);
         }
     }
+    /** listeners get notified if the controller state changes, but not for counter changes */
+    void setControllerState(State::ControllerState state, unsigned int tx_error_counter, unsigned int rx_error_counter){
+        boost::mutex::scoped_lock lock(state_mutex_);
+        state_.tx_error_counter = tx_error_counter;
+        state_.rx_error_counter = rx_error_counter;
+        if(state_.controller_state != state){
+            state_.controller_state = state;
+            state_dispatcher_.dispatch(state_);
+        }
+    }
     
     void frameReceived(const boost::system::error_code& error){
         if(!error){
-            dispatchFrame(input_);
+            size_t depth = queueDepth();
+            size_t max = max_queue_depth_.load(boost::memory_order_relaxed);
+            while(depth > max && !max_queue_depth_.compare_exchange_weak(max, depth, boost::memory_order_relaxed)) {}
+            for(size_t i = 0; i < NUM_LANES; ++i) lanes_[i]->notify(); // once per batch
             triggerReadSome();
         }else{
             setErrorCode(error);
         }
     }
 
-    AsioDriver()
-    : strand_(io_service_), socket_(io_service_)
-    {}
+    /**
+     * @param[in] input_size: number of frames that can be buffered between reader and dispatch threads, per dispatch class
+     * @param[in] reactor: run on shared IO and dispatch threads instead of the thread that calls run() and an own thread per dispatch class
+     */
+    AsioDriver(size_t input_size = 1024, const Reactor::Ptr &reactor = Reactor::Ptr())
+    : batch_active_(false), max_queue_depth_(0), reactor_(reactor), stopped_(false), handlers_(0),
+      io_service_(reactor ? reactor->getIOService() : own_io_service_), socket_(io_service_)
+    {
+        for(size_t i = 0; i < NUM_LANES; ++i){
+            lanes_[i].reset(new Lane(input_size, statistics_, reactor ? &reactor->getDispatchService(DispatchClass(i)) : 0));
+            lanes_[i]->dispatcher.setChangeDelegate(typename FrameDispatcher::ChangeDelegate(this, &AsioDriver::listenersChanged));
+        }
+    }
 
 public:
-    virtual ~AsioDriver() { shutdown(); }
+    virtual ~AsioDriver() { shutdown(); waitForHandlers(); }
     
     State getState(){
         boost::mutex::scoped_lock lock(state_mutex_);
         return state_;
     }
+    /** process IO until shutdown, with a reactor this only waits and the IO and dispatching is done by the reactor threads */
     virtual void run(){
         setDriverState(socket_.is_open()?State::open : State::closed);
         
-        if(getState().driver_state == State::open){
+        if(getState().driver_state == State::open && reactor_){
+            {
+                boost::mutex::scoped_lock lock(run_mutex_);
+                stopped_ = false;
+            }
+            setDriverState(State::ready);
+
+            for(size_t i = 0; i < NUM_LANES; ++i) lanes_[i]->start();
+
+            triggerReadSome();
+
+            {
+                boost::mutex::scoped_lock lock(run_mutex_);
+                while(!stopped_) run_cond_.wait(lock);
+            }
+            waitForHandlers(); // no more frames get committed
+
+            for(size_t i = 0; i < NUM_LANES; ++i) lanes_[i]->stop();
+
+            setDriverState(socket_.is_open()?State::open : State::closed);
+        }else if(getState().driver_state == State::open){
             io_service_.reset();
             boost::asio::io_service::work work(io_service_);
             setDriverState(State::ready);
 
-            boost::thread post_thread(boost::bind(&boost::asio::io_service::run, &io_service_));
+            for(size_t i = 0; i < NUM_LANES; ++i) lanes_[i]->start();
             
             triggerReadSome();
             
             boost::system::error_code ec;
             io_service_.run(ec);
             setErrorCode(ec);
+
+            for(size_t i = 0; i < NUM_LANES; ++i) lanes_[i]->stop();
             
             setDriverState(socket_.is_open()?State::open : State::closed);
         }   
         state_dispatcher_.dispatch(state_);
     }
     virtual bool send(const Frame & msg){
-        return getState().driver_state == State::ready && enqueue(msg);
+        if(getState().driver_state != State::ready) return false;
+        if(batch_active_){
+            boost::mutex::scoped_lock lock(batch_mutex_);
+            if(batch_active_ && batch_owner_ == boost::this_thread::get_id()){
+                batch_.push_back(msg);
+                return true;
+            }
+        }
+        if(!enqueue(msg)){
+            statistics_.countTxFailure();
+            return false;
+        }
+        statistics_.countTx(msg);
+        return true;
+    }
+
+    virtual bool beginBatch(){
+        boost::mutex::scoped_lock lock(batch_mutex_);
+        if(batch_active_) return false;
+        batch_.clear();
+        batch_owner_ = boost::this_thread::get_id();
+        batch_active_ = true;
+        return true;
+    }
+
+    virtual bool commitBatch(){
+        std::vector<Frame> frames;
+        {
+            boost::mutex::scoped_lock lock(batch_mutex_);
+            if(!batch_active_ || batch_owner_ != boost::this_thread::get_id()) return false;
+            frames.swap(batch_);
+            batch_owner_ = boost::thread::id();
+            batch_active_ = false;
+        }
+        // without the lock, enqueueBatch might block on a full queue and other threads must not wait for it
+        bool ok = frames.empty() || (getState().driver_state == State::ready && enqueueBatch(frames));
+        for(std::vector<Frame>::const_iterator it = frames.begin(); it != frames.end(); ++it){
+            if(ok) statistics_.countTx(*it);
+            else statistics_.countTxFailure();
+        }
+        frames.clear();
+        boost::mutex::scoped_lock lock(batch_mutex_);
+        if(!batch_active_ && frames.capacity() > batch_.capacity()) batch_.swap(frames); // keep the buffer for the next batch
+        return ok;
     }
     
+    virtual bool getStatistics(Statistics &stats){
+        statistics_.snapshot(stats);
+        stats.queue_depth = queueDepth();
+        stats.max_queue_depth = max_queue_depth_.load(boost::memory_order_relaxed);
+        return true;
+    }
+
     virtual void shutdown(){
         if(socket_.is_open()){
             socket_.cancel();
             socket_.close();
         }
-        io_service_.stop();
+        if(reactor_){
+            boost::mutex::scoped_lock lock(run_mutex_);
+            stopped_ = true;
+            run_cond_.notify_all();
+        }else{
+            io_service_.stop();
+        }
     }
     
     virtual FrameListener::Ptr createMsgListener(const FrameDelegate &delegate){
-        return frame_dispatcher_.createListener(delegate);
+        return createMsgListener(delegate, realtime_dispatch);
     }
     virtual FrameListener::Ptr createMsgListener(const Frame::Header&h , const FrameDelegate &delegate){
-        return frame_dispatcher_.createListener(h, delegate);
+        return createMsgListener(h, delegate, realtime_dispatch);
+    }
+    virtual FrameListener::Ptr createMsgListener(const FrameDelegate &delegate, DispatchClass dispatch_class){
+        return lanes_[dispatch_class]->dispatcher.createListener(delegate);
+    }
+    virtual FrameListener::Ptr createMsgListener(const Frame::Header&h , const FrameDelegate &delegate, DispatchClass dispatch_class){
+        return lanes_[dispatch_class]->dispatcher.createListener(h, delegate);
     }
     virtual StateListener::Ptr createStateListener(const StateDelegate &delegate){
         return state_dispatcher_.createListener(delegate);
@@ -0,0 +1,439 @@
+#ifndef H_CAN_CAPTURE
+#define H_CAN_CAPTURE
+
+#include <socketcan_interface/interface.h>
+#include <socketcan_interface/dispatcher.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace can{
+
+/**
+ * binary capture format, all values in host byte order:
+ *
+ * - CaptureFileHeader
+ * - sequence of records, each a CaptureRecord followed by CaptureRecord::len payload bytes
+ * - a record of type 0 (zero-filled space of a capture that was not closed properly) or the end of file terminates the capture
+ *
+ * Every CaptureFileHeader::index_interval frames an index record is appended, it links to the previous index record
+ * and the file header points to the latest one, so readers can seek without scanning the whole capture.
+ */
+struct CaptureFileHeader{
+    static const boost::uint32_t VERSION = 1;
+    char magic[8]; ///< "CANCAP\0\0"
+    boost::uint32_t version;
+    boost::uint32_t index_interval; ///< frames per index record
+    boost::int64_t wall_start; ///< system time at the start of the recording in ns since the epoch
+    boost::uint64_t last_index; ///< file offset of the latest index record, 0 if none
+    boost::uint64_t frames; ///< number of frame records, updated with every index record and on close
+
+    static const char* MAGIC() { return "CANCAP\0\0"; }
+};
+
+struct CaptureRecord{
+    enum Type{
+        End = 0, FrameRecord = 1, IndexRecord = 2
+    };
+    enum Flags{
+        FD = 1, BRS = 2
+    };
+    boost::uint8_t type;
+    boost::uint8_t flags;
+    boost::uint8_t len; ///< payload bytes following the record
+    boost::uint8_t reserved;
+    boost::uint32_t header; ///< ID with the Header::ERROR_MASK, RTR_MASK and EXTENDED_MASK bits
+    boost::int64_t stamp; ///< Frame::TimePoint in ns
+};
+
+/** payload of index records */
+struct CaptureIndex{
+    boost::uint64_t frames; ///< number of frame records before this index record
+    boost::uint64_t previous; ///< file offset of the previous index record, 0 if none
+};
+
+/**
+ * append-only writer for binary captures.
+ * The file is memory-mapped and grown in chunks, so writing a frame is a copy into the page cache.
+ * Data that was written survives a crash of the process, close() truncates the file to its final size.
+ */
+class CaptureWriter : boost::noncopyable{
+    boost::mutex mutex_;
+    int fd_;
+    char *map_;
+    size_t mapped_;
+    size_t offset_;
+    const size_t chunk_size_;
+    boost::uint32_t index_interval_;
+    boost::uint64_t frames_;
+    boost::uint64_t last_index_;
+
+    bool reserve(size_t len){
+        if(offset_ + len <= mapped_) return true;
+        size_t size = mapped_ + std::max(len, chunk_size_);
+        if(ftruncate(fd_, size) != 0) return false;
+        void *p = mremap(map_, mapped_, size, MREMAP_MAYMOVE);
+        if(p == MAP_FAILED) return false;
+        map_ = static_cast<char*>(p);
+        mapped_ = size;
+        return true;
+    }
+    void append(const CaptureRecord &rec, const void *payload){
+        memcpy(map_ + offset_ + sizeof(rec), payload, rec.len);
+        memcpy(map_ + offset_, &rec, sizeof(rec)); // header last, an interrupted write leaves an end marker
+        offset_ += sizeof(rec) + rec.len;
+    }
+    CaptureFileHeader& fileHeader() { return *reinterpret_cast<CaptureFileHeader*>(map_); }
+    void writeIndex(boost::int64_t stamp){
+        CaptureRecord rec = CaptureRecord();
+        rec.type = CaptureRecord::IndexRecord;
+        rec.len = sizeof(CaptureIndex);
+        rec.stamp = stamp;
+        CaptureIndex index;
+        index.frames = frames_;
+        index.previous = last_index_;
+        last_index_ = offset_;
+        append(rec, &index);
+        fileHeader().frames = frames_;
+        fileHeader().last_index = last_index_;
+    }
+public:
+    /**
+     * @param[in] chunk_size: the file grows by this number of bytes
+     */
+    CaptureWriter(size_t chunk_size = (16 << 20)) : fd_(-1), map_(0), mapped_(0), offset_(0), chunk_size_(chunk_size), index_interval_(0), frames_(0), last_index_(0) {}
+    ~CaptureWriter() { close(); }
+
+    /**
+     * create capture, an existing file gets overwritten
+     * @param[in] index_interval: frames per index record
+     */
+    bool open(const std::string &path, boost::uint32_t index_interval = 1024){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(fd_ >= 0 || index_interval == 0) return false;
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd_ < 0) return false;
+        void *p = MAP_FAILED;
+        if(ftruncate(fd_, chunk_size_) == 0){
+            p = mmap(0, chunk_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        }
+        if(p == MAP_FAILED){
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        map_ = static_cast<char*>(p);
+        mapped_ = chunk_size_;
+        index_interval_ = index_interval;
+        frames_ = 0;
+        last_index_ = 0;
+
+        CaptureFileHeader header = CaptureFileHeader();
+        memcpy(header.magic, CaptureFileHeader::MAGIC(), sizeof(header.magic));
+        header.version = CaptureFileHeader::VERSION;
+        header.index_interval = index_interval;
+        header.wall_start = boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::system_clock::now().time_since_epoch()).count();
+        memcpy(map_, &header, sizeof(header));
+        offset_ = sizeof(header);
+        return true;
+    }
+    bool isOpen(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return fd_ >= 0;
+    }
+    /** append frame, frames without stamp are stamped with the current time */
+    bool write(const Frame &msg){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(fd_ < 0 || !reserve(2 * sizeof(CaptureRecord) + Frame::MAX_FD_LEN + sizeof(CaptureIndex))) return false;
+
+        CaptureRecord rec = CaptureRecord();
+        rec.type = CaptureRecord::FrameRecord;
+        rec.flags = (msg.is_fd ? CaptureRecord::FD : 0) | (msg.brs ? CaptureRecord::BRS : 0);
+        rec.len = msg.is_rtr ? 0 : std::min<unsigned char>(msg.dlc, Frame::MAX_FD_LEN);
+        rec.header = msg.id | (msg.is_error ? Header::ERROR_MASK : 0) | (msg.is_rtr ? Header::RTR_MASK : 0) | (msg.is_extended ? Header::EXTENDED_MASK : 0);
+        Frame::TimePoint stamp = msg.stamp != Frame::TimePoint() ? msg.stamp : Frame::TimePoint::clock::now();
+        rec.stamp = boost::chrono::duration_cast<boost::chrono::nanoseconds>(stamp.time_since_epoch()).count();
+        if(msg.is_rtr){ // keep requested length
+            rec.reserved = msg.dlc;
+        }
+        append(rec, msg.data.data());
+
+        if(++frames_ % index_interval_ == 0) writeIndex(rec.stamp);
+        return true;
+    }
+    /** flush mapped data to disk */
+    bool sync(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return fd_ >= 0 && msync(map_, offset_, MS_SYNC) == 0;
+    }
+    void close(){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(fd_ < 0) return;
+        fileHeader().frames = frames_;
+        munmap(map_, mapped_);
+        if(ftruncate(fd_, offset_) != 0) {} // trailing zeros terminate the capture anyway
+        ::close(fd_);
+        fd_ = -1;
+        map_ = 0;
+        mapped_ = 0;
+    }
+    boost::uint64_t getFrameCount(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return frames_;
+    }
+};
+
+/** sequential reader for binary captures with index based seek */
+class CaptureReader : boost::noncopyable{
+    struct IndexEntry{
+        boost::int64_t stamp;
+        boost::uint64_t frames;
+        boost::uint64_t offset;
+        bool operator<(const IndexEntry &other) const { return stamp < other.stamp; }
+    };
+    int fd_;
+    const char *map_;
+    size_t size_;
+    size_t offset_;
+    CaptureFileHeader header_;
+    std::vector<IndexEntry> index_;
+
+    bool readRecord(CaptureRecord &rec, size_t offset) const {
+        if(offset + sizeof(rec) > size_) return false;
+        memcpy(&rec, map_ + offset, sizeof(rec));
+        return rec.type != CaptureRecord::End && offset + sizeof(rec) + rec.len <= size_;
+    }
+    void loadIndex(){
+        index_.clear();
+        boost::uint64_t offset = header_.last_index;
+        while(offset >= sizeof(header_)){
+            CaptureRecord rec;
+            CaptureIndex index;
+            if(!readRecord(rec, offset) || rec.type != CaptureRecord::IndexRecord || rec.len != sizeof(index)) break;
+            memcpy(&index, map_ + offset + sizeof(rec), sizeof(index));
+            IndexEntry e = { rec.stamp, index.frames, offset };
+            index_.push_back(e);
+            if(index.previous >= offset) break;
+            offset = index.previous;
+        }
+        std::reverse(index_.begin(), index_.end());
+    }
+public:
+    CaptureReader() : fd_(-1), map_(0), size_(0), offset_(0) {}
+    ~CaptureReader() { close(); }
+
+    bool open(const std::string &path){
+        close();
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if(fd_ < 0) return false;
+        struct stat st;
+        void *p = MAP_FAILED;
+        if(fstat(fd_, &st) == 0 && size_t(st.st_size) >= sizeof(header_)){
+            p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+        }
+        if(p == MAP_FAILED){
+            close();
+            return false;
+        }
+        map_ = static_cast<const char*>(p);
+        size_ = st.st_size;
+        memcpy(&header_, map_, sizeof(header_));
+        if(memcmp(header_.magic, CaptureFileHeader::MAGIC(), sizeof(header_.magic)) != 0 || header_.version != CaptureFileHeader::VERSION){
+            close();
+            return false;
+        }
+        madvise(const_cast<char*>(map_), size_, MADV_SEQUENTIAL);
+        offset_ = sizeof(header_);
+        loadIndex();
+        return true;
+    }
+    void close(){
+        if(map_) munmap(const_cast<char*>(map_), size_);
+        if(fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        map_ = 0;
+        size_ = 0;
+        index_.clear();
+    }
+    bool isOpen() const { return map_ != 0; }
+    const CaptureFileHeader& getFileHeader() const { return header_; }
+
+    /** read next frame, frame stamps are restored */
+    bool next(Frame &msg){
+        CaptureRecord rec;
+        while(readRecord(rec, offset_)){
+            size_t payload = offset_ + sizeof(rec);
+            offset_ = payload + rec.len;
+            if(rec.type != CaptureRecord::FrameRecord) continue;
+
+            msg = Frame(Header(rec.header & Header::ID_MASK, rec.header & Header::EXTENDED_MASK, rec.header & Header::RTR_MASK, rec.header & Header::ERROR_MASK));
+            msg.is_fd = (rec.flags & CaptureRecord::FD) ? 1 : 0;
+            msg.brs = (rec.flags & CaptureRecord::BRS) ? 1 : 0;
+            size_t len = std::min<size_t>(rec.len, Frame::MAX_FD_LEN);
+            memcpy(msg.data.data(), map_ + payload, len);
+            msg.dlc = msg.is_rtr ? rec.reserved : len;
+            msg.stamp = Frame::TimePoint(boost::chrono::duration_cast<Frame::TimePoint::duration>(boost::chrono::nanoseconds(rec.stamp)));
+            return true;
+        }
+        return false;
+    }
+    void rewind(){
+        offset_ = sizeof(header_);
+    }
+    /** position reader at the latest index record before the given stamp, frames up to stamp still have to be skipped by the caller */
+    void seek(const Frame::TimePoint &stamp){
+        IndexEntry e;
+        e.stamp = boost::chrono::duration_cast<boost::chrono::nanoseconds>(stamp.time_since_epoch()).count();
+        std::vector<IndexEntry>::iterator it = std::upper_bound(index_.begin(), index_.end(), e);
+        offset_ = it == index_.begin() ? sizeof(header_) : (it-1)->offset;
+    }
+};
+
+/**
+ * driver that replays a binary capture, the device name is the path of the capture.
+ * Frames are dispatched with their original timing scaled by the speed factor and get stamped with the replay time,
+ * sent frames are dropped (or looped back).
+ * The driver closes at the end of the capture.
+ *
+ * Supported settings:
+ * - speed: replay speed factor, 1.0 (default) replays in real time, 0 as fast as possible
+ * - start: skip the first seconds of the capture, default 0
+ */
+class ReplayInterface : public DriverInterface{
+    typedef TableDispatcher<CommInterface::FrameListener> FrameDispatcher;
+    typedef SimpleDispatcher<StateInterface::StateListener> StateDispatcher;
+    FrameDispatcher frame_dispatcher_;
+    StateDispatcher state_dispatcher_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    State state_;
+    CaptureReader reader_;
+    bool loopback_;
+    double speed_;
+    double start_;
+
+    void setDriverState(State::DriverState s){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_.driver_state != s){
+            state_.driver_state = s;
+            state_dispatcher_.dispatch(state_);
+        }
+        lock.unlock();
+        cond_.notify_all();
+    }
+    /** @return false on shutdown */
+    bool waitUntil(const Frame::TimePoint &abs_time){
+        boost::mutex::scoped_lock lock(mutex_);
+        while(state_.driver_state == State::ready){
+            if(Frame::TimePoint::clock::now() >= abs_time) return true;
+            cond_.wait_until(lock, abs_time);
+        }
+        return false;
+    }
+public:
+    ReplayInterface() : loopback_(false), speed_(1.0), start_(0) {}
+    virtual ~ReplayInterface() { shutdown(); }
+
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings){
+        double speed = settings.get_optional<double>("speed", 1.0);
+        double start = settings.get_optional<double>("start", 0);
+        if(speed < 0 || start < 0) return false;
+        if(!init(device, loopback)) return false;
+        boost::mutex::scoped_lock lock(mutex_);
+        speed_ = speed;
+        start_ = start;
+        return true;
+    }
+    virtual bool init(const std::string &device, bool loopback){
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if(state_.driver_state != State::closed) return false;
+            if(!reader_.open(device)){
+                state_.error_code = boost::system::error_code(errno ? errno : EINVAL, boost::system::system_category());
+                state_dispatcher_.dispatch(state_);
+                return false;
+            }
+            state_.error_code = boost::system::error_code();
+            loopback_ = loopback;
+        }
+        setDriverState(State::ready);
+        return true;
+    }
+    virtual bool recover() { return getState().isReady(); }
+    virtual State getState(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return state_;
+    }
+    virtual void shutdown(){
+        setDriverState(State::closed);
+    }
+    virtual bool translateError(unsigned int internal_error, std::string & str) { return false; }
+    virtual bool doesLoopBack() const { return loopback_; }
+
+    /** replay the capture in the calling thread */
+    virtual void run(){
+        double speed, start;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if(state_.driver_state != State::ready) return;
+            speed = speed_;
+            start = start_;
+        }
+        Frame msg;
+        if(!reader_.next(msg)){
+            setDriverState(State::closed);
+            return;
+        }
+        const Frame::TimePoint first = msg.stamp;
+        const Frame::TimePoint skip_until = first + boost::chrono::duration_cast<Frame::TimePoint::duration>(boost::chrono::duration<double>(start));
+        if(start > 0){
+            reader_.seek(skip_until);
+            while(reader_.next(msg) && msg.stamp < skip_until) {}
+        }
+        const Frame::TimePoint begin = Frame::TimePoint::clock::now();
+        do{
+            if(msg.stamp < skip_until) continue;
+            Frame::TimePoint replay_time = begin;
+            if(speed > 0){
+                replay_time += boost::chrono::duration_cast<Frame::TimePoint::duration>((msg.stamp - skip_until) / speed);
+                if(!waitUntil(replay_time)) return;
+            }else if(!getState().isReady()){
+                return;
+            }else{
+                replay_time = Frame::TimePoint::clock::now();
+            }
+            msg.stamp = replay_time;
+            frame_dispatcher_.dispatch(msg);
+        }while(reader_.next(msg));
+        setDriverState(State::closed);
+    }
+
+    virtual bool send(const Frame & msg){
+        if(!getState().isReady()) return false;
+        if(loopback_) frame_dispatcher_.dispatch(msg);
+        return true;
+    }
+
+    virtual FrameListener::Ptr createMsgListener(const FrameDelegate &delegate){
+        return frame_dispatcher_.createListener(delegate);
+    }
+    virtual FrameListener::Ptr createMsgListener(const Frame::Header&h , const FrameDelegate &delegate){
+        return frame_dispatcher_.createListener(h, delegate);
+    }
+    virtual StateListener::Ptr createStateListener(const StateDelegate &delegate){
+        return state_dispatcher_.createListener(delegate);
+    }
+};
+
+} // namespace can
+#endif
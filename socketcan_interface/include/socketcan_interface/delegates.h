@@ -0,0 +1,218 @@
+#ifndef H_CAN_DELEGATES
+#define H_CAN_DELEGATES
+
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/has_trivial_copy.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <new>
+
+namespace can{
+
+namespace detail{
+
+class DelegateDummy;
+
+/** inline storage of delegates, large enough for an object pointer with a member function pointer or a few lambda captures */
+union DelegateBuffer{
+    void *object;
+    void (*function)();
+    void (DelegateDummy::*member)();
+    char data[4 * sizeof(void*)];
+};
+
+struct DelegateOps{
+    void (*copy)(DelegateBuffer &dst, const DelegateBuffer &src);
+    void (*destroy)(DelegateBuffer &buffer);
+};
+
+template<typename F, bool Inline = sizeof(F) <= sizeof(DelegateBuffer) && boost::alignment_of<F>::value <= boost::alignment_of<DelegateBuffer>::value>
+struct DelegateManager{ // inline
+    static F& get(DelegateBuffer &buffer) { return *reinterpret_cast<F*>(buffer.data); }
+    static const F& get(const DelegateBuffer &buffer) { return *reinterpret_cast<const F*>(buffer.data); }
+    static void create(DelegateBuffer &buffer, const F &f) { new (buffer.data) F(f); }
+    static void copy(DelegateBuffer &dst, const DelegateBuffer &src) { new (dst.data) F(get(src)); }
+    static void destroy(DelegateBuffer &buffer) { get(buffer).~F(); }
+    /** @return 0 if the buffer can be copied bitwise and needs no destruction */
+    static const DelegateOps* ops(){
+        static const DelegateOps o = { &copy, &destroy };
+        return boost::has_trivial_copy<F>::value && boost::has_trivial_destructor<F>::value ? 0 : &o;
+    }
+};
+template<typename F> struct DelegateManager<F, false>{ // on the heap
+    static F& get(DelegateBuffer &buffer) { return *static_cast<F*>(buffer.object); }
+    static const F& get(const DelegateBuffer &buffer) { return *static_cast<const F*>(buffer.object); }
+    static void create(DelegateBuffer &buffer, const F &f) { buffer.object = new F(f); }
+    static void copy(DelegateBuffer &dst, const DelegateBuffer &src) { dst.object = new F(get(src)); }
+    static void destroy(DelegateBuffer &buffer) { delete static_cast<F*>(buffer.object); }
+    static const DelegateOps* ops(){
+        static const DelegateOps o = { &copy, &destroy };
+        return &o;
+    }
+};
+
+template<typename X, typename M> struct MemberBinding{
+    X *object;
+    M member;
+};
+
+/** storage and lifetime of the callable, the invoker is kept type-erased */
+class DelegateBase{
+    typedef void (DelegateBase::*SafeBool)() const;
+    void safe_bool() const {}
+protected:
+    typedef void (*GenericInvoker)();
+    mutable DelegateBuffer buffer_;
+    GenericInvoker invoker_;
+    const DelegateOps *ops_; ///< 0 for callables that are copied bitwise
+
+    DelegateBase() : invoker_(0), ops_(0) {}
+    DelegateBase(const DelegateBase &other) : invoker_(0), ops_(0) {
+        assign(other);
+    }
+    DelegateBase& operator=(const DelegateBase &other){
+        if(this != &other){
+            clear();
+            assign(other);
+        }
+        return *this;
+    }
+    ~DelegateBase(){
+        clear();
+    }
+    void assign(const DelegateBase &other){
+        if(other.ops_) other.ops_->copy(buffer_, other.buffer_);
+        else buffer_ = other.buffer_;
+        ops_ = other.ops_;
+        invoker_ = other.invoker_;
+    }
+    template<typename F> void create(const F &f, GenericInvoker invoker){
+        DelegateManager<F>::create(buffer_, f);
+        ops_ = DelegateManager<F>::ops();
+        invoker_ = invoker;
+    }
+public:
+    bool empty() const { return invoker_ == 0; }
+    void clear(){
+        if(ops_) ops_->destroy(buffer_);
+        ops_ = 0;
+        invoker_ = 0;
+    }
+    operator SafeBool() const { return invoker_ ? &DelegateBase::safe_bool : 0; }
+    bool operator!() const { return invoker_ == 0; }
+};
+
+} // namespace detail
+
+/**
+ * type-erased callables with the interface of fastdelegate::FastDelegateN:
+ * Delegate1<const Frame&>(object, &Class::member), Delegate1<const Frame&>(&function) or any copyable functor, e.g. a lambda or boost::bind.
+ * Callables of up to four pointers are stored inline, larger ones get allocated on the heap.
+ * Default-constructed delegates and those created from a null pointer are empty.
+ * Delegates cannot be compared.
+ */
+template<typename R = void> class Delegate0 : public detail::DelegateBase{
+    typedef R (*Invoker)(detail::DelegateBuffer &buffer);
+    template<typename F> static R invoke(detail::DelegateBuffer &buffer){
+        return detail::DelegateManager<F>::get(buffer)();
+    }
+    template<typename B> static R invokeMember(detail::DelegateBuffer &buffer){
+        B &b = detail::DelegateManager<B>::get(buffer);
+        return (b.object->*b.member)();
+    }
+public:
+    typedef R result_type;
+    Delegate0() {}
+    template<typename F> Delegate0(const F &f, typename boost::disable_if<boost::is_integral<F> >::type* = 0) { // 0 selects the function pointer overload
+        create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<F>)));
+    }
+    Delegate0(R (*f)()) {
+        if(f) create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<R (*)()>)));
+    }
+    template<typename X, typename Y> Delegate0(Y *object, R (X::*member)()) {
+        bindMember<X, R (X::*)()>(object, member);
+    }
+    template<typename X, typename Y> Delegate0(const Y *object, R (X::*member)() const) {
+        bindMember<const X, R (X::*)() const>(object, member);
+    }
+    R operator()() const {
+        return reinterpret_cast<Invoker>(invoker_)(buffer_);
+    }
+private:
+    template<typename X, typename M> void bindMember(X *object, M member){
+        detail::MemberBinding<X, M> b = { object, member };
+        create(b, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invokeMember<detail::MemberBinding<X, M> >)));
+    }
+};
+
+template<typename P1, typename R = void> class Delegate1 : public detail::DelegateBase{
+    typedef R (*Invoker)(detail::DelegateBuffer &buffer, P1 p1);
+    template<typename F> static R invoke(detail::DelegateBuffer &buffer, P1 p1){
+        return detail::DelegateManager<F>::get(buffer)(p1);
+    }
+    template<typename B> static R invokeMember(detail::DelegateBuffer &buffer, P1 p1){
+        B &b = detail::DelegateManager<B>::get(buffer);
+        return (b.object->*b.member)(p1);
+    }
+public:
+    typedef R result_type;
+    Delegate1() {}
+    template<typename F> Delegate1(const F &f, typename boost::disable_if<boost::is_integral<F> >::type* = 0) { // 0 selects the function pointer overload
+        create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<F>)));
+    }
+    Delegate1(R (*f)(P1)) {
+        if(f) create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<R (*)(P1)>)));
+    }
+    template<typename X, typename Y> Delegate1(Y *object, R (X::*member)(P1)) {
+        bindMember<X, R (X::*)(P1)>(object, member);
+    }
+    template<typename X, typename Y> Delegate1(const Y *object, R (X::*member)(P1) const) {
+        bindMember<const X, R (X::*)(P1) const>(object, member);
+    }
+    R operator()(P1 p1) const {
+        return reinterpret_cast<Invoker>(invoker_)(buffer_, p1);
+    }
+private:
+    template<typename X, typename M> void bindMember(X *object, M member){
+        detail::MemberBinding<X, M> b = { object, member };
+        create(b, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invokeMember<detail::MemberBinding<X, M> >)));
+    }
+};
+
+template<typename P1, typename P2, typename R = void> class Delegate2 : public detail::DelegateBase{
+    typedef R (*Invoker)(detail::DelegateBuffer &buffer, P1 p1, P2 p2);
+    template<typename F> static R invoke(detail::DelegateBuffer &buffer, P1 p1, P2 p2){
+        return detail::DelegateManager<F>::get(buffer)(p1, p2);
+    }
+    template<typename B> static R invokeMember(detail::DelegateBuffer &buffer, P1 p1, P2 p2){
+        B &b = detail::DelegateManager<B>::get(buffer);
+        return (b.object->*b.member)(p1, p2);
+    }
+public:
+    typedef R result_type;
+    Delegate2() {}
+    template<typename F> Delegate2(const F &f, typename boost::disable_if<boost::is_integral<F> >::type* = 0) { // 0 selects the function pointer overload
+        create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<F>)));
+    }
+    Delegate2(R (*f)(P1, P2)) {
+        if(f) create(f, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invoke<R (*)(P1, P2)>)));
+    }
+    template<typename X, typename Y> Delegate2(Y *object, R (X::*member)(P1, P2)) {
+        bindMember<X, R (X::*)(P1, P2)>(object, member);
+    }
+    template<typename X, typename Y> Delegate2(const Y *object, R (X::*member)(P1, P2) const) {
+        bindMember<const X, R (X::*)(P1, P2) const>(object, member);
+    }
+    R operator()(P1 p1, P2 p2) const {
+        return reinterpret_cast<Invoker>(invoker_)(buffer_, p1, p2);
+    }
+private:
+    template<typename X, typename M> void bindMember(X *object, M member){
+        detail::MemberBinding<X, M> b = { object, member };
+        create(b, reinterpret_cast<GenericInvoker>(static_cast<Invoker>(&invokeMember<detail::MemberBinding<X, M> >)));
+    }
+};
+
+} // namespace can
+#endif
@@ -3,21 +3,35 @@
 
 #include <socketcan_interface/interface.h>
 #include <list>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/utility.hpp>
 #include <boost/foreach.hpp>
+#include <boost/intrusive/list.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/pool/pool_alloc.hpp>
 #include <boost/weak_ptr.hpp>
 
 namespace can{
 
+namespace detail{
+/** listeners get allocated from a process-wide pool, so creating and destroying them does not hit the heap */
+template<typename T> struct ListenerAllocator{
+    typedef boost::fast_pool_allocator<T> type;
+};
+}
+
 template< typename Listener > class SimpleDispatcher{
 public:
     typedef typename Listener::Callable Callable;
     typedef typename Listener::Type Type;
 protected:
     class DispatcherBase : boost::noncopyable{
-        class GuardedListener: public Listener{
+        typedef boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::normal_link> > Hook;
+        class GuardedListener: public Listener, public Hook{
             boost::weak_ptr<DispatcherBase> guard_;
         public:
             GuardedListener(boost::shared_ptr<DispatcherBase> g, const Callable &callable): Listener(callable), guard_(g){}
@@ -28,19 +42,20 @@ protected:
                 }
             }
         };
-        
+        typedef boost::intrusive::list<GuardedListener, boost::intrusive::base_hook<Hook> > List; // does not touch the listeners on destruction
+
         boost::mutex &mutex_;
-        std::list< Listener* > listeners_;
+        List listeners_;
     public:
         DispatcherBase(boost::mutex &mutex) : mutex_(mutex) {}
         void dispatch_nolock(const Type &obj) const{
-           for(typename std::list<Listener* >::const_iterator it=listeners_.begin(); it != listeners_.end(); ++it){
-               (**it)(obj);
+           for(typename List::const_iterator it=listeners_.begin(); it != listeners_.end(); ++it){
+               (*it)(obj);
             }
         }
-        void remove(Listener *d){
+        void remove(GuardedListener *d){
             boost::mutex::scoped_lock lock(mutex_);
-            listeners_.remove(d);
+            listeners_.erase(listeners_.iterator_to(*d));
         }
         size_t numListeners(){
             boost::mutex::scoped_lock lock(mutex_);
@@ -48,8 +63,8 @@ protected:
         }
 
         static typename Listener::Ptr createListener(boost::shared_ptr<DispatcherBase> dispatcher, const  Callable &callable){
-            boost::shared_ptr<Listener > l(new GuardedListener(dispatcher,callable));
-            dispatcher->listeners_.push_back(l.get());
+            boost::shared_ptr<GuardedListener> l = boost::allocate_shared<GuardedListener>(typename detail::ListenerAllocator<GuardedListener>::type(), dispatcher, callable);
+            dispatcher->listeners_.push_back(*l);
             return l;
         }
     };
@@ -91,5 +106,254 @@ public:
     operator typename BaseClass::Callable() { return typename BaseClass::Callable(this,&FilteredDispatcher::dispatch); }
 };
 
+/**
+ * dispatcher for frames, listeners are looked up in a flat table for standard IDs and in a hash map for all other headers.
+ * Listeners are linked into their lists intrusively, readers follow the links without locking,
+ * writers wait until no reader can be at a removed listener before it gets destroyed.
+ * Readers are counted per epoch, so a writer only waits for the readers that entered before it and cannot be starved.
+ * So dispatch neither locks nor allocates, adding and removing listeners takes constant time.
+ * Listeners must not be created or destroyed from within a dispatch call.
+ */
+template<typename Listener> class TableDispatcher : boost::noncopyable{
+public:
+    typedef typename Listener::Callable Callable;
+    typedef typename Listener::Type Type;
+    typedef Delegate0<> ChangeDelegate;
+    static const unsigned int TABLE_SIZE = 2048; // all 11-bit identifiers
+protected:
+    class Core;
+    class GuardedListener: public Listener{
+        friend class Core;
+        boost::weak_ptr<Core> guard_;
+        const unsigned int key_;
+        const bool filtered_;
+        boost::atomic<GuardedListener*> next_; ///< followed by readers
+        GuardedListener *prev_; ///< only used by writers, the head points to the tail
+    public:
+        GuardedListener(boost::shared_ptr<Core> g, const Callable &callable): Listener(callable), guard_(g), key_(0), filtered_(false), next_(0), prev_(0) {}
+        GuardedListener(boost::shared_ptr<Core> g, const unsigned int key, const Callable &callable): Listener(callable), guard_(g), key_(key), filtered_(true), next_(0), prev_(0) {}
+        virtual ~GuardedListener() {
+            boost::shared_ptr<Core> c = guard_.lock();
+            if(c){
+                if(filtered_) c->remove(key_, this);
+                else c->remove(this);
+            }
+        }
+    };
+    class Core : boost::noncopyable{
+        typedef boost::atomic<GuardedListener*> Slot; ///< head of a list
+        typedef boost::unordered_map<unsigned int, Slot*> Map;
+
+        boost::mutex mutex_; // serializes writers only
+        boost::atomic<unsigned int> epoch_; ///< advanced by each writer
+        boost::atomic<unsigned int> readers_[2]; ///< readers that entered in an even or odd epoch
+        Slot all_;
+        Slot table_[TABLE_SIZE];
+        boost::atomic<const Map*> map_;
+        ChangeDelegate on_change_;
+
+        void changed(){ // must not be called with mutex_ locked
+            ChangeDelegate d;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                d = on_change_;
+            }
+            if(d) d();
+        }
+        static void call(const GuardedListener *l, const Type &obj){
+            for(; l; l = l->next_){
+                (*l)(obj);
+            }
+        }
+        static size_t count(const GuardedListener *l){
+            size_t num = 0;
+            for(; l; l = l->next_) ++num;
+            return num;
+        }
+        static void link(Slot &slot, GuardedListener *l){ // append, readers see l once it is linked to its predecessor
+            GuardedListener *head = slot;
+            l->next_ = 0;
+            if(!head){
+                l->prev_ = l;
+                slot = l;
+            }else{
+                GuardedListener *tail = head->prev_;
+                l->prev_ = tail;
+                head->prev_ = l;
+                tail->next_ = l;
+            }
+        }
+        static void unlink(Slot &slot, GuardedListener *l){ // l keeps its next_ for readers that are still at it
+            GuardedListener *head = slot;
+            GuardedListener *next = l->next_;
+            if(l == head){
+                if(next) next->prev_ = l->prev_;
+                slot = next;
+            }else{
+                l->prev_->next_ = next;
+                if(next) next->prev_ = l->prev_;
+                else head->prev_ = l->prev_;
+            }
+        }
+        unsigned int enter(){ // @return counter of the reader, it is valid only if the epoch did not change meanwhile
+            for(;;){
+                unsigned int e = epoch_;
+                ++readers_[e & 1];
+                if(epoch_ == e) return e & 1;
+                --readers_[e & 1];
+            }
+        }
+        void leave(unsigned int i){
+            --readers_[i];
+        }
+        void synchronize(){ // wait until no reader can be at an unlinked listener or a replaced map
+            // new readers count in the other epoch, so only the readers that entered before have to be waited for
+            unsigned int e = epoch_;
+            epoch_ = e + 1;
+            while(readers_[e & 1] != 0) boost::this_thread::yield();
+        }
+        void publish(const Map *m){
+            const Map *old = map_.exchange(m);
+            synchronize();
+            delete old;
+        }
+        Slot* find(unsigned int key){
+            if(key < TABLE_SIZE) return &table_[key];
+            const Map *m = map_;
+            typename Map::const_iterator it = m->find(key);
+            return it != m->end() ? it->second : 0;
+        }
+    public:
+        Core() : epoch_(0), all_(0), map_(new Map()) {
+            readers_[0] = 0;
+            readers_[1] = 0;
+            for(unsigned int i = 0; i < TABLE_SIZE; ++i) table_[i] = 0;
+        }
+        ~Core(){ // remaining listeners cannot reach the core anymore
+            const Map *m = map_;
+            for(typename Map::const_iterator it = m->begin(); it != m->end(); ++it) delete it->second;
+            delete m;
+        }
+        bool hasListeners(unsigned int key){
+            unsigned int r = enter();
+            Slot *s = find(key);
+            bool res = all_ || (s && *s);
+            leave(r);
+            return res;
+        }
+        void dispatch(const Type &obj){
+            unsigned int r = enter();
+            Slot *s = find(obj);
+            if(s) call(*s, obj);
+            call(all_, obj);
+            leave(r);
+        }
+        void add(GuardedListener *l){
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                link(all_, l);
+            }
+            changed();
+        }
+        void add(unsigned int key, GuardedListener *l){
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                Slot *s = find(key);
+                if(!s){
+                    s = new Slot(0);
+                    Map *n = new Map(*map_.load());
+                    (*n)[key] = s;
+                    publish(n);
+                }
+                link(*s, l);
+            }
+            changed();
+        }
+        void remove(GuardedListener *l){
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                unlink(all_, l);
+                synchronize();
+            }
+            changed();
+        }
+        void remove(unsigned int key, GuardedListener *l){
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                Slot *s = find(key);
+                unlink(*s, l);
+                if(key >= TABLE_SIZE && !*s){
+                    Map *n = new Map(*map_.load());
+                    n->erase(key);
+                    publish(n);
+                    delete s;
+                }else{
+                    synchronize();
+                }
+            }
+            changed();
+        }
+        void setChangeDelegate(const ChangeDelegate &d){
+            boost::mutex::scoped_lock lock(mutex_);
+            on_change_ = d;
+        }
+        bool getKeys(std::vector<unsigned int> &keys){
+            boost::mutex::scoped_lock lock(mutex_);
+            if(all_) return false;
+            for(unsigned int i = 0; i < TABLE_SIZE; ++i){
+                if(table_[i]) keys.push_back(i);
+            }
+            const Map *m = map_;
+            for(typename Map::const_iterator it = m->begin(); it != m->end(); ++it) keys.push_back(it->first);
+            return true;
+        }
+        size_t numListeners(){
+            boost::mutex::scoped_lock lock(mutex_);
+            size_t num = count(all_);
+            for(unsigned int i = 0; i < TABLE_SIZE; ++i) num += count(table_[i]);
+            const Map *m = map_;
+            for(typename Map::const_iterator it = m->begin(); it != m->end(); ++it) num += count(*it->second);
+            return num;
+        }
+    };
+    typedef typename detail::ListenerAllocator<GuardedListener>::type Allocator;
+    boost::shared_ptr<Core> core_;
+public:
+    TableDispatcher() : core_(new Core()) {}
+    typename Listener::Ptr createListener(const Callable &callable){
+        boost::shared_ptr<GuardedListener> l = boost::allocate_shared<GuardedListener>(Allocator(), core_, callable);
+        core_->add(l.get());
+        return l;
+    }
+    typename Listener::Ptr createListener(const unsigned int &key, const Callable &callable){
+        boost::shared_ptr<GuardedListener> l = boost::allocate_shared<GuardedListener>(Allocator(), core_, key, callable);
+        core_->add(key, l.get());
+        return l;
+    }
+    void dispatch(const Type &obj){
+        core_->dispatch(obj);
+    }
+    size_t numListeners(){
+        return core_->numListeners();
+    }
+    /** set delegate that gets called after listeners were added or removed, must not add or remove listeners itself */
+    void setChangeDelegate(const ChangeDelegate &d){
+        core_->setChangeDelegate(d);
+    }
+    /** @return true if dispatch(key) would reach any listener */
+    bool hasListeners(const unsigned int &key){
+        return core_->hasListeners(key);
+    }
+    /**
+     * get all keys that have listeners attached
+     * @param[out] keys: keys get appended to this list
+     * @return false if there are catch-all listeners, i.e. all keys are of interest
+     */
+    bool getKeys(std::vector<unsigned int> &keys){
+        return core_->getKeys(keys);
+    }
+    operator Callable() { return Callable(this,&TableDispatcher::dispatch); }
+};
+
 } // namespace can
 #endif
@@ -4,32 +4,298 @@
 #include "interface.h"
 #include "dispatcher.h"
 #include "string.h"
-#include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_map.hpp>
+#include <set>
+#include <stdexcept>
+#include <vector>
 
 namespace can{
 
+/**
+ * scripted responder for tests: frames that are sent get answered with the responses of the matching exchange.
+ * Exact requests are looked up by their binary header and payload, requests with wildcards are matched per header in the order they were added.
+ * Responses without delay are dispatched from send(), delayed responses from a worker thread.
+ * Exchanges must not be modified while frames are sent.
+ */
 class DummyInterface : public CommInterface{
+public:
+    typedef Frame::TimePoint::duration Duration;
+
+    /** matches sent frames by header, length and payload, payload bits that are cleared in the mask are ignored */
+    struct Pattern{
+        Frame frame;
+        boost::array<unsigned char, Frame::MAX_FD_LEN> mask;
+
+        Pattern(const Frame &f = Frame()) : frame(f) { mask.fill(0xff); }
+        bool isExact() const {
+            for(unsigned char i = 0; i < frame.dlc; ++i){
+                if(mask[i] != 0xff) return false;
+            }
+            return true;
+        }
+        bool matches(const Frame &f) const {
+            if((unsigned int)f != (unsigned int)frame || f.dlc != frame.dlc || f.is_fd != frame.is_fd) return false;
+            for(unsigned char i = 0; i < f.dlc; ++i){
+                if((f.data[i] ^ frame.data[i]) & mask[i]) return false;
+            }
+            return true;
+        }
+        /**
+         * parse frame string, 'x' or '?' mark wildcard digits in the payload, e.g. "601#40xxxx00".
+         * Like in tostring the first byte does not need to be padded.
+         */
+        static bool parse(const std::string &s, Pattern &p){
+            size_t sep = s.find('#');
+            if(sep == std::string::npos) return false;
+            Header header = toheader(s.data(), sep);
+            if(!header.isValid()) return false;
+
+            Pattern res = Pattern(Frame(header));
+            std::string payload = s.substr(sep+1);
+            size_t max_len = Frame::MAX_LEN;
+            if(!payload.empty() && payload[0] == '#'){ // CAN FD
+                uint8_t flags;
+                if(payload.size() < 2 || !hex2dec(flags, payload[1])) return false;
+                res.frame.is_fd = 1;
+                res.frame.brs = (flags & 1) ? 1 : 0;
+                payload.erase(0, 2);
+                max_len = Frame::MAX_FD_LEN;
+            }
+            if(payload.size() % 2) payload.insert(0, "0");
+            if(payload.size() / 2 > max_len) return false;
+
+            for(size_t i = 0; i < payload.size(); ++i){
+                uint8_t d = 0, m = 0xf;
+                if(payload[i] == 'x' || payload[i] == 'X' || payload[i] == '?') m = 0;
+                else if(!hex2dec(d, payload[i])) return false;
+                unsigned int shift = (i % 2) ? 0 : 4;
+                if(shift){
+                    res.frame.data[i/2] = 0;
+                    res.mask[i/2] = 0;
+                }
+                res.frame.data[i/2] |= d << shift;
+                res.mask[i/2] |= m << shift;
+            }
+            res.frame.dlc = payload.size() / 2;
+            if(res.frame.is_fd){ // pad to next valid CAN FD length
+                unsigned char len = dlc2len(len2dlc(res.frame.dlc));
+                for(; res.frame.dlc < len; ++res.frame.dlc){
+                    res.frame.data[res.frame.dlc] = 0;
+                    res.mask[res.frame.dlc] = 0xff;
+                }
+            }
+            p = res;
+            return true;
+        }
+    };
+
+    struct Response{
+        Frame frame;
+        Duration delay; ///< delay after the request
+        Response(const Frame &f, const Duration &d) : frame(f), delay(d) {}
+    };
+
+    /**
+     * request with a sequence of response steps, each matching request advances to the next step.
+     * The last step is repeated, unless the exchange is cyclic, an empty step stops responding.
+     */
+    class Exchange{
+        friend class DummyInterface;
+        std::vector<std::vector<Response> > steps_;
+        size_t next_;
+        size_t count_;
+    public:
+        typedef boost::shared_ptr<Exchange> Ptr;
+        const Pattern pattern;
+        bool cyclic;
+
+        Exchange(const Pattern &p) : steps_(1), next_(0), count_(0), pattern(p), cyclic(false) {}
+
+        /** add response to the current step */
+        Exchange& respond(const Frame &f, const Duration &delay = Duration::zero()){
+            steps_.back().push_back(Response(f, delay));
+            return *this;
+        }
+        Exchange& respond(const std::string &f, const Duration &delay = Duration::zero()){
+            return respond(toframe(f), delay);
+        }
+        /** start next step, the following responses are sent for the next matching request */
+        Exchange& step(){
+            steps_.push_back(std::vector<Response>());
+            return *this;
+        }
+        /** @return number of matching requests */
+        size_t count() const { return count_; }
+    };
+
+private:
     typedef FilteredDispatcher<const unsigned int, CommInterface::FrameListener> FrameDispatcher;
-    typedef boost::unordered_multimap<std::string, Frame> Map;
+
+    /** binary lookup key of exact requests */
+    struct Key{
+        Frame frame;
+        Key(const Frame &f) : frame(f) {}
+        bool operator==(const Key &other) const {
+            return (unsigned int)frame == (unsigned int)other.frame && frame.dlc == other.frame.dlc && frame.is_fd == other.frame.is_fd
+                && std::equal(frame.data.begin(), frame.data.begin() + frame.dlc, other.frame.data.begin());
+        }
+    };
+    struct KeyHash{
+        size_t operator()(const Key &k) const {
+            size_t seed = (unsigned int)k.frame;
+            boost::hash_combine(seed, (k.frame.dlc << 1) | k.frame.is_fd);
+            boost::hash_range(seed, k.frame.data.begin(), k.frame.data.begin() + k.frame.dlc);
+            return seed;
+        }
+    };
+    typedef boost::unordered_map<Key, Exchange::Ptr, KeyHash> ExactMap;
+    typedef boost::unordered_map<unsigned int, std::vector<Exchange::Ptr> > MaskedMap;
+
+    struct Delayed{
+        Frame::TimePoint due;
+        boost::uint64_t seq;
+        Frame frame;
+        bool operator<(const Delayed &other) const { return due != other.due ? due < other.due : seq < other.seq; }
+    };
+
     FrameDispatcher frame_dispatcher_;
-    Map map_;
     const bool loopback_;
 
-    bool add_noconv(const std::string &k, const Frame &v, bool multi){
-        if(multi || map_.find(k) == map_.end()){
-              map_.insert( std::make_pair(boost::to_lower_copy(k), v));
-              return true;
+    boost::mutex mutex_;
+    ExactMap exact_;
+    MaskedMap masked_;
+    std::vector<Exchange::Ptr> exchanges_;
+
+    boost::condition_variable cond_;
+    std::multiset<Delayed> delayed_;
+    boost::uint64_t seq_;
+    bool running_;
+    boost::thread thread_;
+
+    Exchange::Ptr find(const Pattern &p){
+        if(p.isExact()){
+            ExactMap::iterator it = exact_.find(Key(p.frame));
+            return it != exact_.end() ? it->second : Exchange::Ptr();
+        }
+        MaskedMap::iterator it = masked_.find(p.frame);
+        if(it != masked_.end()){
+            for(std::vector<Exchange::Ptr>::iterator e = it->second.begin(); e != it->second.end(); ++e){
+                if((*e)->pattern.frame.dlc == p.frame.dlc && (*e)->pattern.mask == p.mask && (*e)->pattern.matches(p.frame)) return *e;
+            }
+        }
+        return Exchange::Ptr();
+    }
+    Exchange::Ptr lookup(const Frame &msg){
+        if(!exact_.empty()){
+            ExactMap::iterator it = exact_.find(Key(msg));
+            if(it != exact_.end()) return it->second;
+        }
+        MaskedMap::iterator it = masked_.find(msg);
+        if(it != masked_.end()){
+            for(std::vector<Exchange::Ptr>::iterator e = it->second.begin(); e != it->second.end(); ++e){
+                if((*e)->pattern.matches(msg)) return *e;
+            }
+        }
+        return Exchange::Ptr();
+    }
+    bool add_noconv(const Pattern &p, const Frame &v, bool multi){
+        boost::mutex::scoped_lock lock(mutex_);
+        Exchange::Ptr e = find(p);
+        if(e && !multi) return false;
+        if(!e) e = insert(p);
+        e->respond(v);
+        return true;
+    }
+    Exchange::Ptr insert(const Pattern &p){
+        Exchange::Ptr e = boost::make_shared<Exchange>(p);
+        if(p.isExact()) exact_[Key(p.frame)] = e;
+        else masked_[p.frame].push_back(e);
+        exchanges_.push_back(e);
+        return e;
+    }
+    void schedule(const Frame &f, const Duration &delay){
+        Delayed d;
+        d.due = Frame::TimePoint::clock::now() + delay;
+        d.seq = seq_++;
+        d.frame = f;
+        delayed_.insert(d);
+        if(!running_){
+            running_ = true;
+            thread_ = boost::thread(&DummyInterface::run, this);
+        }
+        cond_.notify_one();
+    }
+    void run(){
+        boost::mutex::scoped_lock lock(mutex_);
+        while(running_){
+            if(delayed_.empty()){
+                cond_.wait(lock);
+            }else if(delayed_.begin()->due <= Frame::TimePoint::clock::now()){
+                Frame f = delayed_.begin()->frame;
+                delayed_.erase(delayed_.begin());
+                lock.unlock();
+                frame_dispatcher_.dispatch(f);
+                lock.lock();
+            }else{
+                cond_.wait_until(lock, delayed_.begin()->due);
+            }
         }
-        return false;
     }
 public:
-    DummyInterface(bool loopback) : loopback_(loopback) {}
+    DummyInterface(bool loopback) : loopback_(loopback), seq_(0), running_(false) {}
+    virtual ~DummyInterface(){
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            running_ = false;
+        }
+        cond_.notify_one();
+        if(thread_.joinable()) thread_.join();
+    }
 
+    /**
+     * get exchange for the request pattern, it gets created if needed
+     * @return reference that stays valid until clear() is called
+     */
+    Exchange& expect(const Pattern &p){
+        boost::mutex::scoped_lock lock(mutex_);
+        Exchange::Ptr e = find(p);
+        if(!e) e = insert(p);
+        return *e;
+    }
+    /** @throws std::invalid_argument if the pattern cannot be parsed */
+    Exchange& expect(const std::string &p){
+        Pattern pattern;
+        if(!Pattern::parse(p, pattern)) throw std::invalid_argument("invalid pattern: " + p);
+        return expect(pattern);
+    }
+    /** restart all exchanges with their first step */
+    void rewind(){
+        boost::mutex::scoped_lock lock(mutex_);
+        for(std::vector<Exchange::Ptr>::iterator it = exchanges_.begin(); it != exchanges_.end(); ++it){
+            (*it)->next_ = 0;
+            (*it)->count_ = 0;
+        }
+    }
+    void clear(){
+        boost::mutex::scoped_lock lock(mutex_);
+        exact_.clear();
+        masked_.clear();
+        exchanges_.clear();
+        delayed_.clear();
+    }
+
+    /** add response, string keys may contain wildcards, see Pattern::parse */
     bool add(const std::string &k, const Frame &v, bool multi){
-        return add_noconv(boost::to_lower_copy(k), v, multi);
+        Pattern p;
+        return Pattern::parse(k, p) && add_noconv(p, v, multi);
     }
     bool add(const Frame &k, const Frame &v, bool multi){
-        return add_noconv(tostring(k,true), v, multi);
+        return add_noconv(Pattern(k), v, multi);
     }
     bool add(const std::string &k, const std::string &v, bool multi){
         return add(k, toframe(v), multi);
@@ -39,13 +305,25 @@ public:
     }
     virtual bool send(const Frame & msg){
         if(loopback_) frame_dispatcher_.dispatch(msg);
-        try{
-            std::pair <Map::iterator, Map::iterator> r = map_.equal_range(tostring(msg, true));
-            for (Map::iterator it=r.first; it!=r.second; ++it){
-                frame_dispatcher_.dispatch(it->second);
+
+        Exchange::Ptr e; // keeps responses alive while dispatching
+        const std::vector<Response> *responses = 0;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            e = lookup(msg);
+            if(!e) return true;
+
+            ++e->count_;
+            responses = &e->steps_[e->next_];
+            if(e->next_ + 1 < e->steps_.size()) ++e->next_;
+            else if(e->cyclic) e->next_ = 0;
+
+            for(std::vector<Response>::const_iterator it = responses->begin(); it != responses->end(); ++it){
+                if(it->delay > Duration::zero()) schedule(it->frame, it->delay);
             }
         }
-        catch(const std::out_of_range &e){
+        for(std::vector<Response>::const_iterator it = responses->begin(); it != responses->end(); ++it){
+            if(it->delay <= Duration::zero()) frame_dispatcher_.dispatch(it->frame);
         }
         return true;
     }
@@ -4,8 +4,10 @@
 #include <boost/array.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/chrono/system_clocks.hpp>
 
-#include "FastDelegate.h"
+#include <socketcan_interface/settings.h>
+#include <socketcan_interface/delegates.h>
 
 namespace can{
 
@@ -52,14 +54,37 @@ struct ErrorHeader : public Header{
 
     
     
+/** @return number of data bytes for the given DLC code (0-15), CAN FD mapping is used above 8 */
+inline unsigned char dlc2len(unsigned char dlc){
+    static const unsigned char lens[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+    return lens[dlc & 0xf];
+}
+
+/** @return smallest DLC code that can hold len data bytes */
+inline unsigned char len2dlc(unsigned char len){
+    unsigned char dlc = 0;
+    while(dlc < 15 && dlc2len(dlc) < len) ++dlc;
+    return dlc;
+}
+
 /** reprentation of a CAN frame */   
 struct Frame: public Header{
-    boost::array<unsigned char, 8> data; ///< array for 8 data bytes with bounds checking
-    unsigned char dlc; ///< len of data
+    typedef boost::chrono::high_resolution_clock::time_point TimePoint;
+    enum{
+        MAX_LEN = 8, ///< maximum payload of classic frames
+        MAX_FD_LEN = 64 ///< maximum payload of CAN FD frames
+    };
+
+    boost::array<unsigned char, MAX_FD_LEN> data; ///< array for up to 64 data bytes with bounds checking
+    unsigned char dlc; ///< len of data in bytes, for CAN FD frames one of the lengths defined by dlc2len
+    unsigned char is_fd:1; ///< frame uses CAN FD format
+    unsigned char brs:1; ///< CAN FD bit rate switch
+    TimePoint stamp; ///< reception time on the bus (if provided by driver), zero if unknown
     
     /** check if frame header and length are valid*/
     bool isValid(){
-        return (dlc <= 8)  &&  Header::isValid();
+        if(is_fd) return (dlc <= MAX_FD_LEN) && dlc2len(len2dlc(dlc)) == dlc && !is_rtr && Header::isValid();
+        return (dlc <= MAX_LEN)  &&  Header::isValid();
     }
     /** 
      * constructor with default parameters
@@ -68,8 +93,8 @@ struct Frame: public Header{
      * @param[in] extended: uses 29 bit identifier, defaults to false
      * @param[in] rtr: is rtr frame, defaults to false
      */
-    Frame() : Header(), dlc(0) {}
-    Frame(const Header &h, unsigned char l = 0) : Header(h), dlc(l) {}
+    Frame() : Header(), dlc(0), is_fd(0), brs(0) {}
+    Frame(const Header &h, unsigned char l = 0) : Header(h), dlc(l), is_fd(0), brs(0) {}
 };
 
 /** extended error information */
@@ -80,8 +105,14 @@ public:
     } driver_state;
     boost::system::error_code error_code; ///< device access error
     unsigned int internal_error; ///< driver specific error 
+    unsigned int rx_overruns; ///< number of received frames that were dropped, because dispatching could not keep up
+    enum ControllerState{
+        unknown_controller_state, error_active, error_warning, error_passive, bus_off, stopped
+    } controller_state; ///< only known if the driver can query the controller
+    unsigned int tx_error_counter; ///< transmit error counter of the controller
+    unsigned int rx_error_counter; ///< receive error counter of the controller
     
-    State() : driver_state(closed), internal_error(0) {}
+    State() : driver_state(closed), internal_error(0), rx_overruns(0), controller_state(unknown_controller_state), tx_error_counter(0), rx_error_counter(0) {}
     virtual bool isReady() const { return driver_state == ready; }
     virtual ~State() {}
 };
@@ -101,7 +132,7 @@ public:
 
 class StateInterface{
 public:
-    typedef fastdelegate::FastDelegate1<const State&> StateDelegate;
+    typedef Delegate1<const State&> StateDelegate;
     typedef Listener<const StateDelegate, const State&> StateListener;
 
     /**
@@ -115,9 +146,24 @@ public:
     virtual ~StateInterface() {}
 };
 
+/** dispatch class of a frame listener, drivers may dispatch each class by its own thread */
+enum DispatchClass{
+    realtime_dispatch, ///< time-critical listeners, e.g. PDO and NMT (default)
+    background_dispatch ///< listeners that might block or take long, e.g. SDO and EMCY
+};
+
+/** transmit priority class of a frame, drivers with a transmit queue send higher classes first */
+enum TxClass{
+    tx_sync, ///< SYNC and NMT (highest priority)
+    tx_rpdo, ///< process data
+    tx_sdo, ///< service data
+    tx_other, ///< all other frames
+    NUM_TX_CLASSES
+};
+
 class CommInterface{
 public:
-    typedef fastdelegate::FastDelegate1<const Frame&> FrameDelegate;
+    typedef Delegate1<const Frame&> FrameDelegate;
     typedef Listener<const FrameDelegate, const Frame&> FrameListener;
 
     /**
@@ -144,10 +190,26 @@ public:
      * @return managed pointer to listener
      */
     virtual FrameListener::Ptr createMsgListener(const Frame::Header&, const FrameDelegate &delegate) = 0;
+
+    /**
+     * acquire a listener for all messages in the given dispatch class, defaults to createMsgListener(delegate)
+     */
+    virtual FrameListener::Ptr createMsgListener(const FrameDelegate &delegate, DispatchClass dispatch_class) {
+        return createMsgListener(delegate);
+    }
+
+    /**
+     * acquire a listener for messages with demanded ID in the given dispatch class, defaults to createMsgListener(header, delegate)
+     */
+    virtual FrameListener::Ptr createMsgListener(const Frame::Header& header, const FrameDelegate &delegate, DispatchClass dispatch_class) {
+        return createMsgListener(header, delegate);
+    }
     
     virtual ~CommInterface() {}
 };
 
+struct Statistics;
+
 class DriverInterface : public CommInterface, public StateInterface {
 public:
     /**
@@ -158,6 +220,16 @@ public:
      * @return true if device was initialized succesfully, false otherwise
      */
     virtual bool init(const std::string &device, bool loopback) = 0;
+
+    /**
+     * initialize interface with driver-specific settings, unknown settings are ignored
+     * 
+     * @param[in] device: driver-specific device name/path
+     * @param[in] loopback: loop-back own messages
+     * @param[in] settings: driver-specific settings
+     * @return true if device was initialized succesfully, false otherwise
+     */
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings) { return init(device, loopback); }
     
     /**
      * Recover interface after errors and emergency stops
@@ -183,6 +255,28 @@ public:
     virtual bool doesLoopBack() const = 0;
     
     virtual void run()  = 0;
+
+    /**
+     * start a transmit batch, frames sent from the calling thread get queued until commitBatch is called.
+     * Frames from other threads are not affected.
+     * 
+     * @return true if a batch was started, false if batching is not supported or another batch is active
+     */
+    virtual bool beginBatch() { return false; }
+
+    /**
+     * send all frames that were queued since beginBatch
+     *
+     * @return true if all frames were sent succesfully, otherwise false
+     */
+    virtual bool commitBatch() { return true; }
+
+    /**
+     * get frame counters, bus load and dispatch statistics, see socketcan_interface/statistics.h
+     *
+     * @return true if statistics are supported by the driver, false otherwise
+     */
+    virtual bool getStatistics(Statistics &stats) { return false; }
     
     virtual ~DriverInterface() {}
 };
@@ -0,0 +1,320 @@
+#ifndef H_CAN_NETLINK
+#define H_CAN_NETLINK
+
+#include <boost/system/error_code.hpp>
+#include <boost/utility.hpp>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/can/netlink.h>
+
+namespace can{
+
+/** configuration and state of a network interface as reported by the kernel */
+struct CANLinkInfo{
+    bool is_can; ///< link kind is "can", the CAN specific fields are only valid for these devices (not for vcan)
+    bool up;
+    unsigned int txqueuelen;
+    unsigned int bitrate;
+    unsigned int sample_point; ///< in tenths of a percent
+    unsigned int data_bitrate; ///< CAN FD data phase, 0 if not configured
+    unsigned int data_sample_point;
+    bool fd; ///< CAN FD mode is enabled
+    unsigned int restart_ms; ///< automatic restart after bus-off, 0 if disabled
+    int state; ///< enum can_state, -1 if unknown
+    unsigned int tx_errors, rx_errors; ///< error counters of the controller
+    struct can_device_stats stats; ///< zero if not reported by the driver
+
+    CANLinkInfo() : is_can(false), up(false), txqueuelen(0), bitrate(0), sample_point(0), data_bitrate(0), data_sample_point(0),
+        fd(false), restart_ms(0), state(-1), tx_errors(0), rx_errors(0)
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+};
+
+/** requested configuration of a CAN network interface, the default values keep the current settings */
+struct CANLinkConfig{
+    unsigned int bitrate; ///< 0: keep
+    unsigned int sample_point; ///< in tenths of a percent, 0: chosen by the kernel
+    unsigned int data_bitrate; ///< enables CAN FD mode, 0: keep
+    unsigned int data_sample_point;
+    int restart_ms; ///< -1: keep, 0: disable
+    int txqueuelen; ///< -1: keep
+
+    CANLinkConfig() : bitrate(0), sample_point(0), data_bitrate(0), data_sample_point(0), restart_ms(-1), txqueuelen(-1) {}
+
+    /** @return true if info satisfies all requested values, bit rates and sample points within the tolerance of the kernel's bit timing calculation */
+    bool matches(const CANLinkInfo &info) const{
+        if(txqueuelen >= 0 && info.txqueuelen != (unsigned int)txqueuelen) return false;
+        if(!info.is_can) return true; // virtual devices have no bit timing
+        if(bitrate && !near(info.bitrate, bitrate, bitrate / 20)) return false; // kernel accepts up to 5% error
+        if(sample_point && !near(info.sample_point, sample_point, 50)) return false;
+        if(data_bitrate && (!info.fd || !near(info.data_bitrate, data_bitrate, data_bitrate / 20))) return false;
+        if(data_sample_point && !near(info.data_sample_point, data_sample_point, 50)) return false;
+        if(restart_ms >= 0 && info.restart_ms != (unsigned int)restart_ms) return false;
+        return true;
+    }
+private:
+    static bool near(unsigned int actual, unsigned int requested, unsigned int tolerance){
+        return actual + tolerance >= requested && actual <= requested + tolerance;
+    }
+};
+
+/**
+ * minimal rtnetlink client for the configuration of SocketCAN network interfaces,
+ * changing the configuration needs CAP_NET_ADMIN.
+ */
+class CANNetlink : boost::noncopyable{
+    int fd_;
+    unsigned int seq_;
+
+    struct Request{
+        struct nlmsghdr header;
+        struct ifinfomsg info;
+        char attributes[512];
+    };
+
+    template<typename T> static bool getAttribute(struct rtattr *rta, T &value){
+        if(RTA_PAYLOAD(rta) < sizeof(T)) return false;
+        memcpy(&value, RTA_DATA(rta), sizeof(T));
+        return true;
+    }
+    static void parseCANData(struct rtattr *data, CANLinkInfo &info){
+        int len = RTA_PAYLOAD(data);
+        for(struct rtattr *rta = reinterpret_cast<struct rtattr*>(RTA_DATA(data)); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)){
+            switch(rta->rta_type){
+            case IFLA_CAN_BITTIMING: {
+                struct can_bittiming bt;
+                if(getAttribute(rta, bt)){
+                    info.bitrate = bt.bitrate;
+                    info.sample_point = bt.sample_point;
+                }
+                break;
+            }
+            case IFLA_CAN_DATA_BITTIMING: {
+                struct can_bittiming bt;
+                if(getAttribute(rta, bt)){
+                    info.data_bitrate = bt.bitrate;
+                    info.data_sample_point = bt.sample_point;
+                }
+                break;
+            }
+            case IFLA_CAN_CTRLMODE: {
+                struct can_ctrlmode cm;
+                if(getAttribute(rta, cm)) info.fd = cm.flags & CAN_CTRLMODE_FD;
+                break;
+            }
+            case IFLA_CAN_RESTART_MS: getAttribute(rta, info.restart_ms); break;
+            case IFLA_CAN_STATE: {
+                __u32 state;
+                if(getAttribute(rta, state)) info.state = state;
+                break;
+            }
+            case IFLA_CAN_BERR_COUNTER: {
+                struct can_berr_counter berr;
+                if(getAttribute(rta, berr)){
+                    info.tx_errors = berr.txerr;
+                    info.rx_errors = berr.rxerr;
+                }
+                break;
+            }
+            }
+        }
+    }
+    static void parseLink(struct nlmsghdr *msg, CANLinkInfo &info){
+        struct ifinfomsg *ifi = reinterpret_cast<struct ifinfomsg*>(NLMSG_DATA(msg));
+        info.up = ifi->ifi_flags & IFF_UP;
+        int len = IFLA_PAYLOAD(msg);
+        for(struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)){
+            if(rta->rta_type == IFLA_TXQLEN){
+                getAttribute(rta, info.txqueuelen);
+            }else if(rta->rta_type == IFLA_LINKINFO){
+                int linkinfo_len = RTA_PAYLOAD(rta);
+                for(struct rtattr *li = reinterpret_cast<struct rtattr*>(RTA_DATA(rta)); RTA_OK(li, linkinfo_len); li = RTA_NEXT(li, linkinfo_len)){
+                    if(li->rta_type == IFLA_INFO_KIND){
+                        info.is_can = RTA_PAYLOAD(li) >= 3 && strncmp(reinterpret_cast<const char*>(RTA_DATA(li)), "can", RTA_PAYLOAD(li)) == 0;
+                    }else if(li->rta_type == IFLA_INFO_DATA){
+                        parseCANData(li, info);
+                    }else if(li->rta_type == IFLA_INFO_XSTATS){
+                        getAttribute(li, info.stats);
+                    }
+                }
+            }
+        }
+    }
+
+    static struct rtattr* addAttribute(Request &req, unsigned short type, const void *data, size_t len){
+        size_t rta_len = RTA_LENGTH(len);
+        if(NLMSG_ALIGN(req.header.nlmsg_len) + RTA_ALIGN(rta_len) > sizeof(req)) return 0;
+        struct rtattr *rta = reinterpret_cast<struct rtattr*>(reinterpret_cast<char*>(&req) + NLMSG_ALIGN(req.header.nlmsg_len));
+        rta->rta_type = type;
+        rta->rta_len = rta_len;
+        if(len) memcpy(RTA_DATA(rta), data, len);
+        req.header.nlmsg_len = NLMSG_ALIGN(req.header.nlmsg_len) + RTA_ALIGN(rta_len);
+        return rta;
+    }
+    /** close nested attribute that was started with addAttribute(req, type, 0, 0) */
+    static void endNested(Request &req, struct rtattr *nested){
+        nested->rta_len = reinterpret_cast<char*>(&req) + req.header.nlmsg_len - reinterpret_cast<char*>(nested);
+    }
+
+    bool begin(Request &req, const std::string &device, boost::system::error_code &ec){
+        memset(&req, 0, sizeof(req));
+        req.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+        req.header.nlmsg_type = RTM_NEWLINK;
+        req.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+        req.header.nlmsg_seq = ++seq_;
+        req.info.ifi_family = AF_UNSPEC;
+        req.info.ifi_index = if_nametoindex(device.c_str());
+        if(req.info.ifi_index == 0){
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return false;
+        }
+        return true;
+    }
+
+    /** send request and wait for the acknowledgement, or for the link message if info is given */
+    bool transact(Request &req, boost::system::error_code &ec, CANLinkInfo *info = 0){
+        if(fd_ < 0){
+            ec = boost::system::error_code(EBADF, boost::system::system_category());
+            return false;
+        }
+        struct sockaddr_nl kernel;
+        memset(&kernel, 0, sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+        if(sendto(fd_, &req, req.header.nlmsg_len, 0, reinterpret_cast<struct sockaddr*>(&kernel), sizeof(kernel)) < 0){
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return false;
+        }
+        char buffer[4096];
+        for(;;){
+            ssize_t len = recv(fd_, buffer, sizeof(buffer), 0);
+            if(len < 0){
+                if(errno == EINTR) continue;
+                ec = boost::system::error_code(errno, boost::system::system_category());
+                return false;
+            }
+            for(struct nlmsghdr *msg = reinterpret_cast<struct nlmsghdr*>(buffer); NLMSG_OK(msg, (unsigned int)len); msg = NLMSG_NEXT(msg, len)){
+                if(msg->nlmsg_seq != req.header.nlmsg_seq) continue;
+                if(info && msg->nlmsg_type == RTM_NEWLINK){
+                    parseLink(msg, *info);
+                    ec = boost::system::error_code();
+                    return true;
+                }
+                if(msg->nlmsg_type != NLMSG_ERROR) continue;
+                const struct nlmsgerr *err = reinterpret_cast<const struct nlmsgerr*>(NLMSG_DATA(msg));
+                ec = boost::system::error_code(-err->error, boost::system::system_category());
+                return err->error == 0;
+            }
+        }
+    }
+public:
+    CANNetlink() : fd_(socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)), seq_(0) {
+        if(fd_ >= 0){
+            struct timeval timeout = {1, 0}; // do not hang if the kernel does not answer
+            setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+    }
+    ~CANNetlink(){
+        if(fd_ >= 0) close(fd_);
+    }
+
+    /** read configuration, controller state and error counters of the interface */
+    bool query(const std::string &device, CANLinkInfo &info, boost::system::error_code &ec){
+        Request req;
+        if(!begin(req, device, ec)) return false;
+        req.header.nlmsg_type = RTM_GETLINK;
+        req.header.nlmsg_flags = NLM_F_REQUEST;
+        info = CANLinkInfo();
+        return transact(req, ec, &info);
+    }
+
+    /** set the interface up or down, like 'ip link set DEVICE up' */
+    bool setUp(const std::string &device, bool up, boost::system::error_code &ec){
+        Request req;
+        if(!begin(req, device, ec)) return false;
+        req.info.ifi_change = IFF_UP;
+        req.info.ifi_flags = up ? IFF_UP : 0;
+        return transact(req, ec);
+    }
+
+    /**
+     * apply the configuration if the interface does not match it yet, like 'ip link set DEVICE type can bitrate ...'.
+     * CAN interfaces are set down for the change and up again afterwards, nothing is changed if the interface matches already.
+     */
+    bool configure(const std::string &device, const CANLinkConfig &config, boost::system::error_code &ec){
+        CANLinkInfo info;
+        if(!query(device, info, ec)) return false;
+        if(config.matches(info)) return true;
+
+        Request req;
+        if(!begin(req, device, ec)) return false;
+        if(config.txqueuelen >= 0){
+            __u32 txqueuelen = config.txqueuelen;
+            addAttribute(req, IFLA_TXQLEN, &txqueuelen, sizeof(txqueuelen));
+        }
+        if(info.is_can){
+            struct rtattr *linkinfo = addAttribute(req, IFLA_LINKINFO, 0, 0);
+            addAttribute(req, IFLA_INFO_KIND, "can", 3);
+            struct rtattr *data = addAttribute(req, IFLA_INFO_DATA, 0, 0);
+            if(config.bitrate){
+                struct can_bittiming bt;
+                memset(&bt, 0, sizeof(bt));
+                bt.bitrate = config.bitrate;
+                bt.sample_point = config.sample_point;
+                addAttribute(req, IFLA_CAN_BITTIMING, &bt, sizeof(bt));
+            }
+            if(config.data_bitrate){
+                struct can_bittiming bt;
+                memset(&bt, 0, sizeof(bt));
+                bt.bitrate = config.data_bitrate;
+                bt.sample_point = config.data_sample_point;
+                addAttribute(req, IFLA_CAN_DATA_BITTIMING, &bt, sizeof(bt));
+                struct can_ctrlmode cm = { CAN_CTRLMODE_FD, CAN_CTRLMODE_FD };
+                addAttribute(req, IFLA_CAN_CTRLMODE, &cm, sizeof(cm));
+            }
+            if(config.restart_ms >= 0){
+                __u32 restart_ms = config.restart_ms;
+                addAttribute(req, IFLA_CAN_RESTART_MS, &restart_ms, sizeof(restart_ms));
+            }
+            endNested(req, data);
+            endNested(req, linkinfo);
+        }
+
+        if(!info.is_can) return transact(req, ec);
+
+        if(info.up && !setUp(device, false, ec)) return false; // bit timing cannot be changed while the interface is up
+        bool ok = transact(req, ec);
+        boost::system::error_code up_ec;
+        if(!setUp(device, true, up_ec) && ok){
+            ec = up_ec;
+            return false;
+        }
+        return ok;
+    }
+
+    /** restart the controller after bus-off, like 'ip link set DEVICE type can restart' */
+    bool restart(const std::string &device, boost::system::error_code &ec){
+        Request req;
+        if(!begin(req, device, ec)) return false;
+
+        struct rtattr *linkinfo = addAttribute(req, IFLA_LINKINFO, 0, 0);
+        addAttribute(req, IFLA_INFO_KIND, "can", 3);
+        struct rtattr *data = addAttribute(req, IFLA_INFO_DATA, 0, 0);
+        __u32 restart = 1;
+        addAttribute(req, IFLA_CAN_RESTART, &restart, sizeof(restart));
+        endNested(req, data);
+        endNested(req, linkinfo);
+
+        return transact(req, ec);
+    }
+};
+
+} // namespace can
+#endif
@@ -0,0 +1,108 @@
+#ifndef H_CAN_REACTOR
+#define H_CAN_REACTOR
+
+#include <socketcan_interface/interface.h>
+#include <socketcan_interface/thread_config.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace can{
+
+/**
+ * threads that are shared by several drivers: IO threads that serve all sockets with a single io_service (epoll instance)
+ * and one dispatch thread per DispatchClass.
+ * Drivers keep a shared pointer, the threads stop once the last driver is destroyed.
+ * Handlers of different drivers might run concurrently if more than one IO thread is used,
+ * a listener that blocks delays the listeners of the same dispatch class of all drivers.
+ */
+class Reactor : boost::noncopyable{
+public:
+    static const size_t NUM_DISPATCH_CLASSES = background_dispatch + 1;
+private:
+    boost::asio::io_service io_service_;
+    boost::asio::io_service dispatch_services_[NUM_DISPATCH_CLASSES];
+    boost::scoped_ptr<boost::asio::io_service::work> works_[NUM_DISPATCH_CLASSES + 1];
+    boost::mutex mutex_;
+    boost::thread_group threads_;
+    size_t num_threads_;
+    const std::string name_;
+
+    static void run(boost::asio::io_service *io_service, const ThreadConfig &config, const std::string &name){
+        if(!name.empty()) config.apply(name);
+        boost::system::error_code ec;
+        io_service->run(ec);
+    }
+    static void apply(const ThreadConfig &config, const std::string &name){
+        config.apply(name);
+    }
+public:
+    typedef boost::shared_ptr<Reactor> Ptr;
+
+    /**
+     * @param[in] num_threads: number of IO threads to start
+     * @param[in] config: gets applied to the IO threads
+     * @param[in] name: name prefix of the threads for ThreadConfig::getStatus, no configuration gets applied if empty
+     */
+    Reactor(size_t num_threads = 1, const ThreadConfig &config = ThreadConfig(), const std::string &name = "reactor")
+    : num_threads_(0), name_(name)
+    {
+        works_[NUM_DISPATCH_CLASSES].reset(new boost::asio::io_service::work(io_service_));
+        static const char* names[NUM_DISPATCH_CLASSES] = { "realtime", "background" };
+        for(size_t i = 0; i < NUM_DISPATCH_CLASSES; ++i){
+            works_[i].reset(new boost::asio::io_service::work(dispatch_services_[i]));
+            threads_.create_thread(boost::bind(&Reactor::run, &dispatch_services_[i], ThreadConfig(), name_.empty() ? name_ : name_ + "/" + names[i]));
+        }
+        reserveThreads(num_threads, config);
+    }
+    ~Reactor(){
+        io_service_.stop();
+        for(size_t i = 0; i < NUM_DISPATCH_CLASSES; ++i) dispatch_services_[i].stop();
+        threads_.join_all();
+    }
+
+    boost::asio::io_service& getIOService() { return io_service_; }
+
+    /** @return io_service that is run by the dispatch thread of the given class */
+    boost::asio::io_service& getDispatchService(DispatchClass dispatch_class) { return dispatch_services_[dispatch_class]; }
+
+    size_t getNumThreads(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return num_threads_;
+    }
+
+    /** start additional IO threads with the given configuration until at least num threads are running */
+    void reserveThreads(size_t num, const ThreadConfig &config = ThreadConfig()){
+        boost::mutex::scoped_lock lock(mutex_);
+        for(; num_threads_ < num; ++num_threads_){
+            std::string name = name_.empty() ? name_ : name_ + "/" + boost::lexical_cast<std::string>(num_threads_);
+            threads_.create_thread(boost::bind(&Reactor::run, &io_service_, config, name));
+        }
+    }
+
+    /** apply configuration to the dispatch thread of the given class, the last call wins */
+    void configureDispatchThread(DispatchClass dispatch_class, const ThreadConfig &config, const std::string &name){
+        dispatch_services_[dispatch_class].post(boost::bind(&Reactor::apply, config, name));
+    }
+
+    /** process-wide reactor with one IO thread, gets created on first use and destroyed if it is not used anymore */
+    static Ptr getShared(){
+        static boost::mutex mutex;
+        static boost::weak_ptr<Reactor> shared;
+        boost::mutex::scoped_lock lock(mutex);
+        Ptr reactor = shared.lock();
+        if(!reactor){
+            reactor.reset(new Reactor(1));
+            shared = reactor;
+        }
+        return reactor;
+    }
+};
+
+} // namespace can
+#endif
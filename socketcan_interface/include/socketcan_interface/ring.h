@@ -0,0 +1,64 @@
+#ifndef H_CAN_RING
+#define H_CAN_RING
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/utility.hpp>
+
+namespace can{
+
+/**
+ * preallocated single-producer single-consumer ring buffer.
+ * The producer fills a slot in-place (reserve, commit), the consumer reads it in-place (front, pop),
+ * so passing an element does not allocate or copy.
+ */
+template<typename T> class SPSCRing : boost::noncopyable{
+    std::vector<T> buffer_;
+    const size_t mask_;
+    boost::atomic<size_t> head_; ///< next slot to be written, owned by producer
+    boost::atomic<size_t> tail_; ///< next slot to be read, owned by consumer
+
+    static size_t round_up(size_t size){
+        size_t s = 1;
+        while(s < size) s <<= 1;
+        return s;
+    }
+public:
+    /**
+     * @param[in] size: minimum number of elements, gets rounded up to the next power of two
+     */
+    SPSCRing(size_t size) : buffer_(round_up(size)), mask_(buffer_.size() - 1), head_(0), tail_(0) {}
+
+    size_t capacity() const { return buffer_.size(); }
+    /** @return number of elements, might be outdated if called from other threads than producer and consumer */
+    size_t size() const {
+        size_t tail = tail_.load(boost::memory_order_acquire); // read tail first, so head cannot be behind
+        return head_.load(boost::memory_order_acquire) - tail;
+    }
+    bool empty() const { return head_.load(boost::memory_order_acquire) == tail_.load(boost::memory_order_acquire); }
+
+    /** @return pointer to the next free slot or 0 if ring is full, must be followed by commit() */
+    T* reserve(){
+        size_t head = head_.load(boost::memory_order_relaxed);
+        if(head - tail_.load(boost::memory_order_acquire) == buffer_.size()) return 0;
+        return &buffer_[head & mask_];
+    }
+    /** publish the slot that was returned by reserve() */
+    void commit(){
+        head_.store(head_.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+    }
+
+    /** @return pointer to the oldest element or 0 if ring is empty, must be followed by pop() */
+    T* front(){
+        size_t tail = tail_.load(boost::memory_order_relaxed);
+        if(head_.load(boost::memory_order_acquire) == tail) return 0;
+        return &buffer_[tail & mask_];
+    }
+    /** release the slot that was returned by front() */
+    void pop(){
+        tail_.store(tail_.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+    }
+};
+
+} // namespace can
+#endif
@@ -0,0 +1,52 @@
+#ifndef H_CAN_SETTINGS
+#define H_CAN_SETTINGS
+
+#include <map>
+#include <string>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace can{
+
+/** interface for key-value settings, e.g. driver options from the parameter server */
+class Settings
+{
+public:
+    typedef boost::shared_ptr<const Settings> ConstPtr;
+
+    template <typename T> T get_optional(const std::string &n, const T& def) const {
+        std::string repr;
+        if(!getRepr(n, repr)){
+            return def;
+        }
+        return boost::lexical_cast<T>(repr);
+    }
+    template <typename T> bool get(const std::string &n, T& val) const {
+        std::string repr;
+        if(!getRepr(n, repr)) return false;
+        val =  boost::lexical_cast<T>(repr);
+        return true;
+    }
+    virtual ~Settings() {}
+private:
+    virtual bool getRepr(const std::string &n, std::string & repr) const = 0;
+};
+
+/** settings from a string map, e.g. for command line tools */
+class SettingsMap : public Settings
+{
+    std::map<std::string, std::string> values_;
+    virtual bool getRepr(const std::string &n, std::string & repr) const {
+        std::map<std::string, std::string>::const_iterator it = values_.find(n);
+        if(it == values_.end()) return false;
+        repr = it->second;
+        return true;
+    }
+public:
+    template <typename T> void set(const std::string &n, const T& val) {
+        values_[n] = boost::lexical_cast<std::string>(val);
+    }
+};
+
+} // namespace can
+#endif
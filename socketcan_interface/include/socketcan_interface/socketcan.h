@@ -2,16 +2,26 @@
 #define H_SOCKETCAN_DRIVER
 
 #include <socketcan_interface/asio_base.h>
+#include <socketcan_interface/tx_queue.h>
+#include <socketcan_interface/netlink.h>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <vector>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <net/if.h>
  
 #include <linux/can.h>
 #include <linux/can/raw.h>
 #include <linux/can/error.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
 
 #include <socketcan_interface/dispatcher.h>
 
@@ -21,20 +31,150 @@ class SocketCANInterface : public AsioDriver<boost::asio::posix::stream_descript
     typedef AsioDriver<boost::asio::posix::stream_descriptor> BaseClass;
     bool loopback_;
 public:    
-    SocketCANInterface()
-    : loopback_(false)
-    {}
+    enum TimestampMode{
+        no_timestamps, software_timestamps, hardware_timestamps
+    };
+    enum LinkMode{
+        link_none, ///< do not touch the network interface
+        link_verify, ///< fail if the network interface does not match the configuration
+        link_apply ///< configure the network interface via netlink, needs CAP_NET_ADMIN
+    };
+
+    /**
+     * @param[in] rx_batch: maximum number of frames that get read per wakeup, defaults to 32
+     * @param[in] tx_batch: maximum number of frames that get written per system call, defaults to 32
+     * @param[in] reactor: serve the socket by shared IO threads, run() only waits for shutdown then
+     */
+    SocketCANInterface(size_t rx_batch = 32, size_t tx_batch = 32, const Reactor::Ptr &reactor = Reactor::Ptr())
+    : BaseClass(1024, reactor), loopback_(false), fd_(false), timestamps_(no_timestamps), link_mode_(link_none), link_state_(false), link_update_pending_(false),
+      rx_frames_(std::max<size_t>(rx_batch, 1)), rx_iovecs_(rx_frames_.size()), rx_msgs_(rx_frames_.size()), rx_control_(rx_frames_.size() * controlSize()),
+      tx_waiting_(false), tx_timer_(BaseClass::io_service_),
+      recovery_(false), recovery_restart_(true), recovery_min_delay_(boost::posix_time::milliseconds(10)), recovery_max_delay_(boost::posix_time::seconds(1)),
+      recovery_timer_(BaseClass::io_service_), recovering_(false), bus_off_(false), recovery_delay_(recovery_min_delay_)
+    {
+        for(size_t i = 0; i < rx_frames_.size(); ++i){
+            rx_iovecs_[i].iov_base = &rx_frames_[i];
+            rx_iovecs_[i].iov_len = sizeof(canfd_frame); // classic frames are shorter (CAN_MTU)
+            memset(&rx_msgs_[i], 0, sizeof(struct mmsghdr));
+            rx_msgs_[i].msg_hdr.msg_iov = &rx_iovecs_[i];
+            rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+        tx_batch = std::max<size_t>(tx_batch, 1);
+        tx_pending_.resize(tx_batch);
+        tx_classes_.resize(tx_batch);
+        tx_frames_.resize(tx_batch);
+        tx_iovecs_.resize(tx_batch);
+        tx_msgs_.resize(tx_batch);
+        for(size_t i = 0; i < tx_batch; ++i){
+            tx_iovecs_[i].iov_base = &tx_frames_[i];
+            memset(&tx_msgs_[i], 0, sizeof(struct mmsghdr));
+            tx_msgs_[i].msg_hdr.msg_iov = &tx_iovecs_[i];
+            tx_msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+    virtual ~SocketCANInterface(){
+        shutdown();
+        stopLinkThread();
+        BaseClass::waitForHandlers(); // handlers call into this class
+    }
     
     virtual bool doesLoopBack() const{
         return loopback_;
     }
 
+    /**
+     * supported settings:
+     * - timestamps: "none" (default), "software" (kernel reception time) or "hardware" (controller time, needs CAP_NET_ADMIN,
+     *   falls back to kernel time with a warning if the device does not support it)
+     * - fd: enable CAN FD frames (defaults to false), the network interface must be configured for CAN FD
+     * - realtime_thread_{policy,priority,cpus}, background_thread_{policy,priority,cpus}: dispatch thread configuration, see ThreadConfig::read
+     * - bitrate: nominal bit rate of the bus, needed for the bus load in getStatistics (defaults to 0, read from CAN devices)
+     * - link_config: "none" (default), "verify" or "apply" (needs CAP_NET_ADMIN) the following settings of the network interface,
+     *   see CANLinkConfig. Only given settings are checked, virtual devices only support txqueuelen:
+     *   bitrate, sample_point (e.g. 0.875), data_bitrate and data_sample_point (enable CAN FD mode), restart_ms, txqueuelen.
+     *   Controller state and error counters are only reported with "verify" or "apply"
+     * - statistics_window: minimum length of the statistics window in seconds (defaults to 1.0)
+     * - tx_{sync,rpdo,sdo,other}_queue_{size,policy}, tx_queue_timeout: transmit queue configuration, see TxQueue::read
+     * - recovery: get ready again automatically after error frames, keeping socket and listeners (defaults to false)
+     * - recovery_min_delay, recovery_max_delay: delay in seconds before the driver gets ready again,
+     *   it doubles for errors that occur within recovery_max_delay after the last recovery (defaults to 0.01 and 1.0)
+     * - recovery_restart: restart the controller via netlink after bus-off (defaults to true), needs CAP_NET_ADMIN.
+     *   Otherwise, or if this fails, the driver waits for the restart by the kernel (restart-ms)
+     */
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings){
+        fd_ = settings.get_optional<bool>("fd", false);
+        std::string timestamps = settings.get_optional<std::string>("timestamps", "none");
+        if(timestamps == "none"){
+            timestamps_ = no_timestamps;
+        }else if(timestamps == "software"){
+            timestamps_ = software_timestamps;
+        }else if(timestamps == "hardware"){
+            timestamps_ = hardware_timestamps;
+        }else{
+            LOG("unknown timestamp mode: " << timestamps);
+            return false;
+        }
+        ThreadConfig realtime, background;
+        if(!realtime.read(settings, "realtime_thread") || !background.read(settings, "background_thread")){
+            LOG("invalid dispatch thread configuration");
+            return false;
+        }
+        setDispatchThreadConfig(realtime_dispatch, realtime, device + "/realtime");
+        setDispatchThreadConfig(background_dispatch, background, device + "/background");
+
+        double window = settings.get_optional<double>("statistics_window", 1.0);
+        if(window <= 0){
+            LOG("statistics_window must be positive");
+            return false;
+        }
+        std::string link_mode = settings.get_optional<std::string>("link_config", "none");
+        if(link_mode == "none"){
+            link_mode_ = link_none;
+        }else if(link_mode == "verify"){
+            link_mode_ = link_verify;
+        }else if(link_mode == "apply"){
+            link_mode_ = link_apply;
+        }else{
+            LOG("unknown link_config mode: " << link_mode);
+            return false;
+        }
+        link_config_ = CANLinkConfig();
+        link_config_.bitrate = settings.get_optional<unsigned int>("bitrate", 0);
+        link_config_.sample_point = settings.get_optional<double>("sample_point", 0) * 1000 + 0.5;
+        link_config_.data_bitrate = settings.get_optional<unsigned int>("data_bitrate", 0);
+        link_config_.data_sample_point = settings.get_optional<double>("data_sample_point", 0) * 1000 + 0.5;
+        link_config_.restart_ms = settings.get_optional<int>("restart_ms", -1);
+        link_config_.txqueuelen = settings.get_optional<int>("txqueuelen", -1);
+
+        statistics().setBitrate(link_config_.bitrate);
+        statistics().setWindow(boost::chrono::duration<double>(window));
+
+        if(!tx_queue_.read(settings)){
+            LOG("invalid transmit queue configuration");
+            return false;
+        }
+
+        double min_delay = settings.get_optional<double>("recovery_min_delay", 0.01);
+        double max_delay = settings.get_optional<double>("recovery_max_delay", 1.0);
+        if(min_delay <= 0 || max_delay < min_delay){
+            LOG("invalid recovery delays");
+            return false;
+        }
+        recovery_ = settings.get_optional<bool>("recovery", false);
+        recovery_restart_ = settings.get_optional<bool>("recovery_restart", true);
+        recovery_min_delay_ = boost::posix_time::microseconds(boost::int64_t(min_delay * 1e6));
+        recovery_max_delay_ = boost::posix_time::microseconds(boost::int64_t(max_delay * 1e6));
+        return init(device, loopback);
+    }
+
     virtual bool init(const std::string &device, bool loopback){
         State s = BaseClass::getState();
         if(s.driver_state == State::closed){
             device_ = device;
             loopback_ = loopback;
 
+            if(!setupLink()) return false;
+
             int sc = socket( PF_CAN, SOCK_RAW, CAN_RAW );
             if(sc < 0){
                 BaseClass::setErrorCode(boost::system::error_code(sc,boost::system::system_category()));
@@ -70,7 +210,42 @@ public:
                 close(sc);
                 return false;
             }
+
+            if(timestamps_ == software_timestamps){
+                int enable = 1;
+                ret = setsockopt(sc, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+            }else if(timestamps_ == hardware_timestamps){
+                int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+                if(enableHardwareTimestamps(sc, ifr)){
+                    flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+                }else{
+                    LOG("hardware timestamps are not available on " << device_ << ", using kernel timestamps: " << strerror(errno));
+                }
+                ret = setsockopt(sc, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+            }
+            if(ret != 0){
+                BaseClass::setErrorCode(boost::system::error_code(errno,boost::system::system_category()));
+                close(sc);
+                return false;
+            }
             
+            if(fd_){
+                int enable_fd = 1;
+                ret = setsockopt(sc, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable_fd, sizeof(enable_fd));
+                if(ret != 0){
+                    BaseClass::setErrorCode(boost::system::error_code(errno,boost::system::system_category()));
+                    close(sc);
+                    return false;
+                }
+            }
+
+            boost::mutex::scoped_lock filter_lock(filter_mutex_); // do not miss listener changes until socket is assigned
+            if(applyFilters(sc) != 0){
+                BaseClass::setErrorCode(boost::system::error_code(errno,boost::system::system_category()));
+                close(sc);
+                return false;
+            }
+
             if(loopback_){
                 int recv_own_msgs = 1; /* 0 = disabled (default), 1 = enabled */
                 ret = setsockopt(sc, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &recv_own_msgs, sizeof(recv_own_msgs));
@@ -95,6 +270,7 @@ public:
             
             boost::system::error_code ec;
             BaseClass::socket_.assign(sc,ec);
+            filter_lock.unlock();
             
             BaseClass::setErrorCode(ec);
             
@@ -102,6 +278,16 @@ public:
                 close(sc);
                 return false;
             }
+            {
+                boost::mutex::scoped_lock lock(send_mutex_);
+                tx_waiting_ = false; // handlers of the old socket might not have run
+            }
+            tx_queue_.open();
+            {
+                boost::mutex::scoped_lock lock(recovery_mutex_);
+                recovering_ = false;
+                bus_off_ = false;
+            }
             BaseClass::setInternalError(0);
             BaseClass::setDriverState(State::open);
             return true;
@@ -115,6 +301,27 @@ public:
         }
         return BaseClass::getState().isReady();
     }
+    virtual void shutdown(){
+        tx_queue_.close();
+        {
+            boost::mutex::scoped_lock lock(send_mutex_);
+            boost::system::error_code ec;
+            tx_timer_.cancel(ec);
+        }
+        {
+            boost::mutex::scoped_lock lock(recovery_mutex_);
+            recovering_ = false; // a pending restart does not start the timer again
+            boost::system::error_code ec;
+            recovery_timer_.cancel(ec);
+        }
+        BaseClass::shutdown();
+    }
+    virtual bool getStatistics(Statistics &stats){
+        updateLinkState(); // error counters change without error frames, diagnostics poll this, rate-limited
+        BaseClass::getStatistics(stats);
+        tx_queue_.getStatistics(stats);
+        return true;
+    }
     virtual bool translateError(unsigned int internal_error, std::string & str){
 
         bool ret = false;
@@ -154,67 +361,488 @@ public:
     }
 protected:
     std::string device_;
-    can_frame frame_;
+    bool fd_;
+    TimestampMode timestamps_;
+    LinkMode link_mode_;
+    CANLinkConfig link_config_;
+    bool link_state_; ///< controller state can be queried via netlink
+
+    boost::mutex link_mutex_; ///< protects the link thread and the members below
+    boost::asio::io_service link_service_; ///< runs netlink transactions that must not block the IO thread
+    boost::scoped_ptr<boost::asio::io_service::work> link_work_;
+    boost::thread link_thread_;
+    bool link_update_pending_; ///< an update of the link state was posted to the link thread
+    boost::chrono::steady_clock::time_point link_updated_at_;
+
+    static void runLinkThread(boost::asio::io_service *service){
+        boost::system::error_code ec;
+        service->run(ec);
+    }
+    /** run a netlink transaction on the link thread, the thread gets started on first use */
+    template<typename Task> void postLinkTask(const Task &task){
+        boost::mutex::scoped_lock lock(link_mutex_);
+        if(!link_work_){
+            link_service_.reset();
+            link_work_.reset(new boost::asio::io_service::work(link_service_));
+            link_thread_ = boost::thread(&SocketCANInterface::runLinkThread, &link_service_);
+        }
+        link_service_.post(task);
+    }
+    /** finish the pending netlink transactions, must not be called from the link thread */
+    void stopLinkThread(){
+        {
+            boost::mutex::scoped_lock lock(link_mutex_);
+            link_work_.reset();
+        }
+        if(link_thread_.joinable()) link_thread_.join();
+    }
+
+    /** verify or apply link_config_ according to link_mode_ */
+    bool setupLink(){
+        link_state_ = false;
+        if(link_mode_ == link_none) return true;
+
+        CANNetlink netlink;
+        boost::system::error_code ec;
+        if(link_mode_ == link_apply && !netlink.configure(device_, link_config_, ec)){
+            LOG("could not configure " << device_ << ": " << ec.message());
+            BaseClass::setErrorCode(ec);
+            return false;
+        }
+        CANLinkInfo info;
+        if(!netlink.query(device_, info, ec)){
+            LOG("could not query " << device_ << ", the link configuration cannot be verified: " << ec.message());
+            BaseClass::setErrorCode(ec);
+            return false;
+        }
+        if(!link_config_.matches(info)){
+            LOG(device_ << " does not match the configuration: bitrate " << info.bitrate << ", sample point " << info.sample_point
+                << ", data bitrate " << info.data_bitrate << ", data sample point " << info.data_sample_point
+                << ", restart-ms " << info.restart_ms << ", txqueuelen " << info.txqueuelen);
+            BaseClass::setErrorCode(boost::system::error_code(EINVAL, boost::system::system_category()));
+            return false;
+        }
+        if(info.is_can){
+            if(!link_config_.bitrate) statistics().setBitrate(info.bitrate);
+            setLinkState(info);
+            link_state_ = true;
+        }
+        return true;
+    }
+    /** query controller state and error counters, at most every 100 ms, only for CAN devices */
+    void updateLinkState(){
+        if(!link_state_) return;
+        boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        {
+            boost::mutex::scoped_lock lock(link_mutex_);
+            if(now - link_updated_at_ < boost::chrono::milliseconds(100)) return;
+            link_updated_at_ = now;
+        }
+        queryLinkState();
+    }
+    /** update the link state on the link thread, e.g. after error frames, requests are merged while one is pending */
+    void requestLinkState(){
+        if(!link_state_) return;
+        {
+            boost::mutex::scoped_lock lock(link_mutex_);
+            if(link_update_pending_) return;
+            link_update_pending_ = true;
+        }
+        postLinkTask(boost::bind(&SocketCANInterface::linkStateRequested, this));
+    }
+    void linkStateRequested(){
+        {
+            boost::mutex::scoped_lock lock(link_mutex_);
+            link_update_pending_ = false;
+            link_updated_at_ = boost::chrono::steady_clock::now();
+        }
+        queryLinkState();
+    }
+    void queryLinkState(){
+        CANLinkInfo info;
+        boost::system::error_code ec;
+        if(CANNetlink().query(device_, info, ec)) setLinkState(info);
+    }
+    void setLinkState(const CANLinkInfo &info){
+        static const State::ControllerState states[] = { // enum can_state
+            State::error_active, State::error_warning, State::error_passive, State::bus_off, State::stopped, State::stopped
+        };
+        State::ControllerState state = info.state >= 0 && info.state < int(sizeof(states)/sizeof(states[0])) ? states[info.state] : State::unknown_controller_state;
+        BaseClass::setControllerState(state, info.tx_errors, info.rx_errors);
+    }
+    std::vector<canfd_frame> rx_frames_;
+    std::vector<struct iovec> rx_iovecs_;
+    std::vector<struct mmsghdr> rx_msgs_;
+    std::vector<char> rx_control_; ///< ancillary data (timestamps) per received frame
+    std::vector<unsigned int> filter_keys_;
+    std::vector<struct can_filter> filters_;
+
+    /**
+     * derive filters_ from the IDs of the registered listeners
+     * @return false if filtering is not possible, e.g. because of catch-all listeners
+     */
+    bool buildFilters(){
+        filters_.clear();
+        if(BaseClass::getListenedKeys(filter_keys_)){
+            for(std::vector<unsigned int>::iterator it = filter_keys_.begin(); it != filter_keys_.end(); ++it){
+                if(*it & Header::ERROR_MASK) continue; // error frames are selected by CAN_RAW_ERR_FILTER
+                struct can_filter f;
+                f.can_id = *it; // header key uses the can_id flag layout
+                f.can_mask = ((*it & Header::EXTENDED_MASK) ? CAN_EFF_MASK : CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+                filters_.push_back(f);
+            }
+            return filters_.size() <= CAN_RAW_FILTER_MAX;
+        }
+        return false;
+    }
+    /** set CAN_RAW_FILTER according to the registered listeners */
+    int applyFilters(int sc){
+        if(buildFilters()){
+            return setsockopt(sc, SOL_CAN_RAW, CAN_RAW_FILTER, filters_.empty() ? 0 : &filters_.front(), filters_.size() * sizeof(struct can_filter));
+        }
+        struct can_filter all = {0, 0}; // receive everything
+        return setsockopt(sc, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all));
+    }
+    virtual void listenersChanged(){
+        boost::mutex::scoped_lock lock(filter_mutex_);
+        if(BaseClass::socket_.is_open() && applyFilters(BaseClass::socket_.native_handle()) != 0){
+            LOG("could not update CAN filters: " << errno);
+        }
+    }
+    TxQueue tx_queue_; ///< frames get sent in priority order, SYNC and NMT are not delayed by queued SDO traffic
+    bool tx_waiting_; ///< writer waits for the socket to become writable, protected by send_mutex_
+    boost::asio::deadline_timer tx_timer_;
+    std::vector<Frame> tx_pending_;
+    std::vector<TxClass> tx_classes_;
+    std::vector<canfd_frame> tx_frames_;
+    std::vector<struct iovec> tx_iovecs_;
+    std::vector<struct mmsghdr> tx_msgs_;
+
+    bool recovery_; ///< get ready again after error frames, see init
+    bool recovery_restart_;
+    boost::posix_time::time_duration recovery_min_delay_, recovery_max_delay_;
+    boost::mutex recovery_mutex_; ///< protects the recovery state below
+    boost::asio::deadline_timer recovery_timer_;
+    bool recovering_; ///< waiting for recovery_timer_, further errors do not notify
+    bool bus_off_; ///< controller needs a restart
+    boost::posix_time::time_duration recovery_delay_;
+    boost::chrono::steady_clock::time_point recovered_at_;
+
+    /**
+     * error frame was received, with recovery the driver gets ready again after a delay that grows while the errors persist.
+     * Listeners get notified without recovery_mutex_, they might call shutdown
+     */
+    void handleError(unsigned int error){
+        if(error & (CAN_ERR_CRTL | CAN_ERR_BUSOFF | CAN_ERR_RESTARTED)) requestLinkState(); // not on the IO thread
+        if(!recovery_){
+            LOG("error: " << error);
+            BaseClass::setInternalError(error);
+            BaseClass::setDriverState(State::open);
+            return;
+        }
+        boost::mutex::scoped_lock lock(recovery_mutex_);
+        if(error & CAN_ERR_BUSOFF){
+            bus_off_ = true;
+        }else if((error & CAN_ERR_RESTARTED) && bus_off_){ // restarted by the kernel
+            bus_off_ = false;
+            if(recovering_){
+                boost::system::error_code ec;
+                recovery_timer_.cancel(ec);
+                finishRecovery(lock);
+            }
+            return;
+        }
+        if(recovering_ || error == CAN_ERR_RESTARTED) return; // one notification per recovery, restarts are expected
+
+        boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if(now - recovered_at_ > boost::chrono::microseconds(recovery_max_delay_.total_microseconds())){
+            recovery_delay_ = recovery_min_delay_;
+        }else{
+            recovery_delay_ = std::min(recovery_delay_ * 2, recovery_max_delay_);
+        }
+        recovering_ = true;
+        lock.unlock();
+
+        LOG("error: " << error << ", recovering in " << recovery_delay_.total_milliseconds() << " ms");
+        BaseClass::setInternalError(error);
+        BaseClass::setDriverState(State::open);
+
+        lock.lock(); // start the timer after the notification, so the recovery cannot overtake it
+        if(recovering_) startRecoveryTimer();
+    }
+    /** recovery_mutex_ has to be locked */
+    void startRecoveryTimer(){
+        recovery_timer_.expires_from_now(recovery_delay_);
+        recovery_timer_.async_wait(BaseClass::track(boost::bind(&SocketCANInterface::recoveryTimeout, this, boost::asio::placeholders::error)));
+    }
+    void recoveryTimeout(const boost::system::error_code& error){
+        if(error) return; // cancelled
+        boost::mutex::scoped_lock lock(recovery_mutex_);
+        if(!recovering_) return;
+        if(bus_off_){
+            if(recovery_restart_){
+                postLinkTask(boost::bind(&SocketCANInterface::restartController, this)); // blocks, keep it off the IO thread
+            }else{
+                recovery_delay_ = std::min(recovery_delay_ * 2, recovery_max_delay_); // wait for the kernel to restart it
+                startRecoveryTimer();
+            }
+            return;
+        }
+        finishRecovery(lock);
+    }
+    /** restart the controller via netlink after bus-off, runs on the link thread */
+    void restartController(){
+        boost::system::error_code ec;
+        bool restarted = CANNetlink().restart(device_, ec);
+
+        boost::mutex::scoped_lock lock(recovery_mutex_);
+        if(!recovering_ || !bus_off_) return; // shut down or restarted by the kernel in the meantime
+        if(!restarted){
+            LOG("could not restart " << device_ << ": " << ec.message());
+            recovery_delay_ = std::min(recovery_delay_ * 2, recovery_max_delay_); // retry, the kernel might restart it
+            startRecoveryTimer();
+            return;
+        }
+        bus_off_ = false;
+        finishRecovery(lock);
+    }
+    /** lock has to hold recovery_mutex_, it gets released before the listeners are notified */
+    void finishRecovery(boost::mutex::scoped_lock &lock){
+        recovering_ = false;
+        recovered_at_ = boost::chrono::steady_clock::now();
+        lock.unlock();
+        if(BaseClass::getState().driver_state == State::open && BaseClass::socket_.is_open()){
+            LOG("recovered from errors");
+            BaseClass::setInternalError(0);
+            BaseClass::setDriverState(State::ready);
+        }
+    }
     
     virtual void triggerReadSome(){
         boost::mutex::scoped_lock lock(send_mutex_);
-        BaseClass::socket_.async_read_some(boost::asio::buffer(&frame_, sizeof(frame_)), boost::bind( &SocketCANInterface::readFrame,this, boost::asio::placeholders::error));
+        BaseClass::socket_.async_read_some(boost::asio::null_buffers(), BaseClass::track(boost::bind( &SocketCANInterface::readFrames,this, boost::asio::placeholders::error)));
     }
     
+    /** @return number of bytes to be written, CAN_MTU or CANFD_MTU */
+    size_t convertFrame(const Frame &in, canfd_frame &out){
+        memset(&out, 0, sizeof(out));
+        out.can_id = in.id | (in.is_extended?CAN_EFF_FLAG:0) | (in.is_rtr?CAN_RTR_FLAG:0);
+        out.len = std::min<unsigned char>(in.dlc, in.is_fd ? Frame::MAX_FD_LEN : Frame::MAX_LEN);
+        out.flags = (in.is_fd && in.brs) ? CANFD_BRS : 0;
+        
+        for(int i=0; i < out.len;++i)
+            out.data[i] = in.data[i];
+        return in.is_fd ? CANFD_MTU : CAN_MTU;
+    }
+
     virtual bool enqueue(const Frame & msg){
-        boost::mutex::scoped_lock lock(send_mutex_); //TODO: timed try lock
+        if(msg.is_fd && !fd_){
+            LOG("CAN FD is not enabled");
+            return false;
+        }
+        if(!tx_queue_.push(msg)) return false;
+        return flushTx(1);
+    }
 
-        can_frame frame = {0};
-        frame.can_id = msg.id | (msg.is_extended?CAN_EFF_FLAG:0) | (msg.is_rtr?CAN_RTR_FLAG:0);;
-        frame.can_dlc = msg.dlc;
-        
-        
-        for(int i=0; i < frame.can_dlc;++i)
-            frame.data[i] = msg.data[i];
-        
-        boost::system::error_code ec;
-        boost::asio::write(BaseClass::socket_, boost::asio::buffer(&frame, sizeof(frame)),boost::asio::transfer_all(), ec);
-        if(ec){
-            LOG("FAILED " << ec);
-            BaseClass::setErrorCode(ec);
-            BaseClass::setDriverState(State::open);
+    virtual bool enqueueBatch(const std::vector<Frame> & msgs){
+        if(!fd_){
+            for(size_t i = 0; i < msgs.size(); ++i){
+                if(msgs[i].is_fd){
+                    LOG("CAN FD is not enabled");
+                    return false;
+                }
+            }
+        }
+        bool ok = true;
+        size_t queued = 0;
+        for(size_t i = 0; i < msgs.size(); ++i){
+            if(tx_queue_.push(msgs[i])) ++queued;
+            else ok = false;
+        }
+        return flushTx(queued) && ok;
+    }
+
+    /**
+     * write queued frames in priority order until the socket would block,
+     * the remaining frames get written from the IO thread once the socket is writable again.
+     * On errors all queued frames are discarded and counted as failures, they would be stale after recovery
+     * @param[in] reported: number of queued frames that the caller counts as failures itself
+     * @return false on errors
+     */
+    bool flushTx(size_t reported = 0){
+        boost::mutex::scoped_lock lock(send_mutex_);
+        if(tx_waiting_) return true;
+
+        for(;;){
+            size_t num = tx_queue_.peek(&tx_pending_.front(), &tx_classes_.front(), tx_pending_.size());
+            if(num == 0) return true;
+
+            for(size_t i = 0; i < num; ++i){
+                tx_iovecs_[i].iov_len = convertFrame(tx_pending_[i], tx_frames_[i]);
+            }
+            int sent = sendmmsg(BaseClass::socket_.native_handle(), &tx_msgs_.front(), num, MSG_DONTWAIT);
+            if(sent > 0){
+                tx_queue_.pop(&tx_classes_.front(), sent);
+            }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+                tx_waiting_ = true;
+                BaseClass::socket_.async_write_some(boost::asio::null_buffers(), BaseClass::track(boost::bind(&SocketCANInterface::writable, this, boost::asio::placeholders::error)));
+                return true;
+            }else if(errno == ENOBUFS){ // device queue is full, this does not get reported by poll
+                tx_waiting_ = true;
+                tx_timer_.expires_from_now(boost::posix_time::milliseconds(1));
+                tx_timer_.async_wait(BaseClass::track(boost::bind(&SocketCANInterface::writable, this, boost::asio::placeholders::error)));
+                return true;
+            }else if(errno != EINTR){
+                boost::system::error_code ec(errno, boost::system::system_category());
+                size_t dropped = tx_queue_.clear(); // do not retry the failing frames with every flush
+                for(size_t i = reported; i < dropped; ++i) statistics().countTxFailure();
+                LOG("FAILED " << ec);
+                BaseClass::setErrorCode(ec);
+                BaseClass::setDriverState(State::open);
+                return false;
+            }
+        }
+    }
+    void writable(const boost::system::error_code& error){
+        {
+            boost::mutex::scoped_lock lock(send_mutex_);
+            tx_waiting_ = false;
+        }
+        if(!error) flushTx();
+    }
+    
+    /** turn on time stamping of all received frames in the device, needs CAP_NET_ADMIN and driver support */
+    static bool enableHardwareTimestamps(int sc, const struct ifreq &ifr){
+        struct hwtstamp_config config;
+        memset(&config, 0, sizeof(config));
+        config.tx_type = HWTSTAMP_TX_OFF;
+        config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+        struct ifreq req = ifr;
+        req.ifr_data = (char*) &config;
+        if(ioctl(sc, SIOCSHWTSTAMP, &req) != 0) return false;
+        if(config.rx_filter == HWTSTAMP_FILTER_NONE){ // device accepted the request, but stamps nothing
+            errno = EOPNOTSUPP;
             return false;
         }
-        
         return true;
     }
-    
-    void readFrame(const boost::system::error_code& error){
-        if(!error){
-            BaseClass::input_.dlc = frame_.can_dlc;
-            for(int i=0;i<frame_.can_dlc && i < 8; ++i){
-                BaseClass::input_.data[i] = frame_.data[i];
+
+    static size_t controlSize(){
+        return CMSG_SPACE(3 * sizeof(struct timespec)); // fits SCM_TIMESTAMPNS and SCM_TIMESTAMPING
+    }
+
+    /** read kernel timestamp (CLOCK_REALTIME) from ancillary data and map it to Frame::TimePoint */
+    static Frame::TimePoint readStamp(struct msghdr &hdr, const Frame::TimePoint &now, const struct timespec &real_now){
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)){
+            if(cmsg->cmsg_level != SOL_SOCKET) continue;
+
+            const struct timespec *ts = 0;
+            if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+                ts = (const struct timespec*) CMSG_DATA(cmsg);
+            }else if(cmsg->cmsg_type == SCM_TIMESTAMPING){
+                ts = (const struct timespec*) CMSG_DATA(cmsg); // [0]: software, [2]: hardware
+                if(ts[2].tv_sec != 0 || ts[2].tv_nsec != 0) ts += 2;
             }
-            
-            if(frame_.can_id & CAN_ERR_FLAG){ // error message
-                BaseClass::input_.id = frame_.can_id & CAN_EFF_MASK;
-                BaseClass::input_.is_error = 1;
+            if(ts){
+                boost::chrono::nanoseconds age((real_now.tv_sec - ts->tv_sec) * 1000000000LL + (real_now.tv_nsec - ts->tv_nsec));
+                if(age.count() < 0) age = boost::chrono::nanoseconds(0);
+                return now - boost::chrono::duration_cast<Frame::TimePoint::duration>(age);
+            }
+        }
+        return Frame::TimePoint();
+    }
 
-                LOG("error: " << BaseClass::input_.id);
-                BaseClass::setInternalError(BaseClass::input_.id);
-                BaseClass::setDriverState(State::open); // TODO: error reset?
+    void convertFrame(const canfd_frame &in, Frame &out, bool fd){
+        out.is_fd = fd ? 1 : 0;
+        out.brs = (fd && (in.flags & CANFD_BRS)) ? 1 : 0;
+        out.dlc = std::min<unsigned char>(in.len, fd ? Frame::MAX_FD_LEN : Frame::MAX_LEN);
+        for(int i=0;i<out.dlc; ++i){
+            out.data[i] = in.data[i];
+        }
+        
+        if(in.can_id & CAN_ERR_FLAG){ // error message
+            out.id = in.can_id & CAN_EFF_MASK;
+            out.is_error = 1;
+            out.is_extended = 0;
+            out.is_rtr = 0;
 
-            }else{
-                BaseClass::input_.is_extended = (frame_.can_id & CAN_EFF_FLAG) ? 1 :0;
-                BaseClass::input_.id = frame_.can_id & (BaseClass::input_.is_extended ? CAN_EFF_MASK : CAN_SFF_MASK);
-                BaseClass::input_.is_error = 0;
-                BaseClass::input_.is_rtr = (frame_.can_id & CAN_RTR_FLAG) ? 1 : 0;
+            handleError(out.id);
+
+        }else{
+            out.is_extended = (in.can_id & CAN_EFF_FLAG) ? 1 :0;
+            out.id = in.can_id & (out.is_extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+            out.is_error = 0;
+            out.is_rtr = (in.can_id & CAN_RTR_FLAG) ? 1 : 0;
+        }
+    }
+
+    void readFrames(const boost::system::error_code& error){
+        boost::system::error_code ec(error);
+        if(!ec){
+            if(timestamps_ != no_timestamps){
+                for(size_t i = 0; i < rx_msgs_.size(); ++i){ // gets overwritten by each call
+                    rx_msgs_[i].msg_hdr.msg_control = &rx_control_[i * controlSize()];
+                    rx_msgs_[i].msg_hdr.msg_controllen = controlSize();
+                }
+            }
+            // drain all pending frames with a single call, the socket got reported as readable
+            int num = recvmmsg(BaseClass::socket_.native_handle(), &rx_msgs_.front(), rx_msgs_.size(), MSG_DONTWAIT, 0);
+            if(num < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                ec = boost::system::error_code(errno, boost::system::system_category());
             }
 
+            Frame::TimePoint now;
+            struct timespec real_now;
+            if(num > 0 && timestamps_ != no_timestamps){ // sample both clocks once per batch
+                now = Frame::TimePoint::clock::now();
+                clock_gettime(CLOCK_REALTIME, &real_now);
+            }
+            for(int i = 0; i < num; ++i){
+                if(rx_msgs_[i].msg_len != CAN_MTU && rx_msgs_[i].msg_len != CANFD_MTU){ // truncated or not a CAN frame
+                    statistics().countRxInvalid();
+                    continue;
+                }
+                Frame &msg = BaseClass::reserveInput(); // convert in-place, no allocation
+                convertFrame(rx_frames_[i], msg, rx_msgs_[i].msg_len == CANFD_MTU);
+                msg.stamp = timestamps_ != no_timestamps ? readStamp(rx_msgs_[i].msg_hdr, now, real_now) : Frame::TimePoint();
+                BaseClass::commitInput(msg);
+            }
         }
-        BaseClass::frameReceived(error);
+        BaseClass::frameReceived(ec);
     }
 private:
     boost::mutex send_mutex_;
+    boost::mutex filter_mutex_;
 };
 
 typedef SocketCANInterface SocketCANDriver;
 
+/**
+ * SocketCANInterface that is served by the process-wide Reactor, so several buses share their IO and dispatch threads.
+ * run() does not process IO, it only waits for shutdown.
+ */
+class SharedSocketCANInterface : public SocketCANInterface{
+public:
+    SharedSocketCANInterface() : SocketCANInterface(32, 32, Reactor::getShared()) {}
+
+    using SocketCANInterface::init;
+    /**
+     * additional settings:
+     * - reactor_threads: minimum number of IO threads of the shared reactor (defaults to 1)
+     * - reactor_thread_{policy,priority,cpus}: configuration of IO threads that get started by this driver, see ThreadConfig::read
+     */
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings){
+        ThreadConfig config;
+        if(!config.read(settings, "reactor_thread")){
+            LOG("invalid reactor thread configuration");
+            return false;
+        }
+        getReactor()->reserveThreads(settings.get_optional<size_t>("reactor_threads", 1), config);
+        return SocketCANInterface::init(device, loopback, settings);
+    }
+};
+
 template <typename T> class ThreadedInterface;
 typedef ThreadedInterface<SocketCANInterface> ThreadedSocketCANInterface;
 
@@ -0,0 +1,224 @@
+#ifndef H_CAN_STATISTICS
+#define H_CAN_STATISTICS
+
+#include <socketcan_interface/interface.h>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+
+namespace can{
+
+namespace detail{
+/** counts bits including stuff bits and calculates the CRC-15 of classic CAN frames */
+struct BitStuffer{
+    unsigned int bits;
+    unsigned int run;
+    bool last;
+    boost::uint16_t crc;
+    BitStuffer() : bits(0), run(0), last(true), crc(0) {} // bus idle is recessive
+
+    void push(bool bit, bool update_crc = true){
+        if(update_crc){
+            bool crc_next = bit != bool((crc >> 14) & 1);
+            crc = (crc << 1) & 0x7fff;
+            if(crc_next) crc ^= 0x4599;
+        }
+        ++bits;
+        if(bit == last){
+            ++run;
+        }else{
+            last = bit;
+            run = 1;
+        }
+        if(run == 5){ // stuff bit of opposite level
+            ++bits;
+            last = !bit;
+            run = 1;
+        }
+    }
+    void pushBits(boost::uint32_t value, unsigned int num){
+        while(num--) push((value >> num) & 1);
+    }
+};
+}
+
+/**
+ * number of bits the frame occupies on the bus, including stuff bits, ACK, EOF and intermission.
+ * The result is exact for classic frames; for CAN FD frames it is an upper bound at nominal bit rate.
+ * Error frames are not counted.
+ */
+inline unsigned int frameBits(const Frame &msg){
+    if(msg.is_error) return 0;
+    unsigned int len = msg.is_rtr ? 0 : std::min<unsigned int>(msg.dlc, msg.is_fd ? Frame::MAX_FD_LEN : Frame::MAX_LEN);
+
+    if(msg.is_fd){
+        unsigned int bits = (msg.is_extended ? 48 : 29) + 8 * len + 4 + (len > 16 ? 21 : 17); // arbitration, control, data, stuff count and CRC
+        return bits + bits / 4 + 13; // at most one stuff bit per four bits
+    }
+
+    detail::BitStuffer s;
+    s.push(false); // SOF
+    if(msg.is_extended){
+        s.pushBits(msg.id >> 18, 11);
+        s.push(true); // SRR
+        s.push(true); // IDE
+        s.pushBits(msg.id & 0x3ffff, 18);
+        s.push(msg.is_rtr);
+        s.pushBits(0, 2); // r1, r0
+    }else{
+        s.pushBits(msg.id, 11);
+        s.push(msg.is_rtr);
+        s.pushBits(0, 2); // IDE, r0
+    }
+    s.pushBits(std::min<unsigned int>(msg.dlc, 15), 4);
+    for(unsigned int i = 0; i < len; ++i) s.pushBits(msg.data[i], 8);
+
+    boost::uint16_t crc = s.crc;
+    for(int i = 14; i >= 0; --i) s.push((crc >> i) & 1, false);
+
+    return s.bits + 13; // CRC delimiter, ACK slot and delimiter, EOF and intermission
+}
+
+/** snapshot of driver statistics, see DriverInterface::getStatistics */
+struct Statistics{
+    enum { NUM_ERROR_CLASSES = 16 };
+
+    boost::uint64_t rx_frames;
+    boost::uint64_t rx_bytes;
+    boost::uint64_t rx_invalid; ///< received datagrams that were skipped, because their length does not match a frame
+    boost::uint64_t tx_frames;
+    boost::uint64_t tx_bytes;
+    boost::uint64_t tx_failures; ///< frames that could not be sent
+    boost::uint64_t error_frames;
+    boost::uint64_t error_classes[NUM_ERROR_CLASSES]; ///< error frames per bit of the driver-specific error ID, see DriverInterface::translateError
+
+    unsigned int bitrate; ///< nominal bit rate, 0 if unknown
+    double window; ///< length of the last completed window in seconds, the rates below refer to it
+    double frame_rate; ///< received and sent frames per second
+    double bit_rate; ///< bits per second on the bus, see frameBits
+    double bus_load; ///< bit_rate relative to bitrate, 0 if the bitrate is unknown
+    double max_dispatch_latency; ///< maximum time in seconds from reading frames to the end of their dispatch
+
+    size_t queue_depth; ///< frames waiting for dispatch
+    size_t max_queue_depth; ///< since start
+
+    size_t tx_queue_depth[NUM_TX_CLASSES]; ///< frames waiting for transmission per TxClass, if the driver has a transmit queue
+    size_t max_tx_queue_depth[NUM_TX_CLASSES]; ///< since start
+    boost::uint64_t tx_dropped[NUM_TX_CLASSES]; ///< frames rejected because the class queue was full, included in tx_failures
+
+    Statistics() : rx_frames(0), rx_bytes(0), rx_invalid(0), tx_frames(0), tx_bytes(0), tx_failures(0), error_frames(0),
+        bitrate(0), window(0), frame_rate(0), bit_rate(0), bus_load(0), max_dispatch_latency(0), queue_depth(0), max_queue_depth(0)
+    {
+        std::fill(error_classes, error_classes + NUM_ERROR_CLASSES, 0);
+        std::fill(tx_queue_depth, tx_queue_depth + NUM_TX_CLASSES, 0);
+        std::fill(max_tx_queue_depth, max_tx_queue_depth + NUM_TX_CLASSES, 0);
+        std::fill(tx_dropped, tx_dropped + NUM_TX_CLASSES, 0);
+    }
+};
+
+/**
+ * lock-free frame counters for drivers.
+ * The counting functions are wait-free and may be called from any thread,
+ * rates are calculated by snapshot() over windows of at least the configured length.
+ */
+class StatisticsCounter : boost::noncopyable{
+    typedef boost::chrono::steady_clock clock;
+
+    boost::atomic<boost::uint64_t> rx_frames_, rx_bytes_, rx_invalid_, tx_frames_, tx_bytes_, tx_failures_, error_frames_, bits_;
+    boost::atomic<boost::uint64_t> error_classes_[Statistics::NUM_ERROR_CLASSES];
+    boost::atomic<boost::int64_t> max_latency_; ///< in ns, within current window
+    boost::atomic<unsigned int> bitrate_;
+
+    boost::mutex mutex_; ///< protects window state
+    clock::duration window_length_;
+    clock::time_point window_start_;
+    boost::uint64_t window_frames_, window_bits_;
+    double window_, frame_rate_, bit_rate_, max_dispatch_latency_;
+
+    static void add(boost::atomic<boost::uint64_t> &counter, boost::uint64_t val){
+        counter.fetch_add(val, boost::memory_order_relaxed);
+    }
+public:
+    StatisticsCounter()
+    : rx_frames_(0), rx_bytes_(0), rx_invalid_(0), tx_frames_(0), tx_bytes_(0), tx_failures_(0), error_frames_(0), bits_(0), max_latency_(0), bitrate_(0),
+      window_length_(boost::chrono::seconds(1)), window_start_(clock::now()), window_frames_(0), window_bits_(0),
+      window_(0), frame_rate_(0), bit_rate_(0), max_dispatch_latency_(0)
+    {
+        for(size_t i = 0; i < Statistics::NUM_ERROR_CLASSES; ++i) error_classes_[i] = 0;
+    }
+
+    void setBitrate(unsigned int bitrate){
+        bitrate_ = bitrate;
+    }
+    void setWindow(const boost::chrono::duration<double> &window){
+        boost::mutex::scoped_lock lock(mutex_);
+        window_length_ = boost::chrono::duration_cast<clock::duration>(window);
+    }
+
+    void countRx(const Frame &msg){
+        if(msg.is_error){
+            add(error_frames_, 1);
+            for(size_t i = 0; i < Statistics::NUM_ERROR_CLASSES; ++i){
+                if(msg.id & (1u << i)) add(error_classes_[i], 1);
+            }
+            return;
+        }
+        add(rx_frames_, 1);
+        add(rx_bytes_, msg.is_rtr ? 0 : msg.dlc);
+        add(bits_, frameBits(msg));
+    }
+    void countRxInvalid(){
+        add(rx_invalid_, 1);
+    }
+    void countTx(const Frame &msg){
+        add(tx_frames_, 1);
+        add(tx_bytes_, msg.is_rtr ? 0 : msg.dlc);
+        add(bits_, frameBits(msg));
+    }
+    void countTxFailure(){
+        add(tx_failures_, 1);
+    }
+    void updateLatency(const boost::chrono::nanoseconds &latency){
+        boost::int64_t ns = latency.count();
+        boost::int64_t max = max_latency_.load(boost::memory_order_relaxed);
+        while(ns > max && !max_latency_.compare_exchange_weak(max, ns, boost::memory_order_relaxed)) {}
+    }
+
+    /** fill counters, start a new window if the current one has elapsed */
+    void snapshot(Statistics &stats){
+        stats.rx_frames = rx_frames_.load(boost::memory_order_relaxed);
+        stats.rx_bytes = rx_bytes_.load(boost::memory_order_relaxed);
+        stats.rx_invalid = rx_invalid_.load(boost::memory_order_relaxed);
+        stats.tx_frames = tx_frames_.load(boost::memory_order_relaxed);
+        stats.tx_bytes = tx_bytes_.load(boost::memory_order_relaxed);
+        stats.tx_failures = tx_failures_.load(boost::memory_order_relaxed);
+        stats.error_frames = error_frames_.load(boost::memory_order_relaxed);
+        for(size_t i = 0; i < Statistics::NUM_ERROR_CLASSES; ++i) stats.error_classes[i] = error_classes_[i].load(boost::memory_order_relaxed);
+        stats.bitrate = bitrate_;
+
+        boost::uint64_t bits = bits_.load(boost::memory_order_relaxed);
+        boost::uint64_t frames = stats.rx_frames + stats.tx_frames;
+
+        boost::mutex::scoped_lock lock(mutex_);
+        clock::time_point now = clock::now();
+        if(now - window_start_ >= window_length_){
+            window_ = boost::chrono::duration<double>(now - window_start_).count();
+            frame_rate_ = (frames - window_frames_) / window_;
+            bit_rate_ = (bits - window_bits_) / window_;
+            max_dispatch_latency_ = max_latency_.exchange(0, boost::memory_order_relaxed) * 1e-9;
+            window_start_ = now;
+            window_frames_ = frames;
+            window_bits_ = bits;
+        }
+        stats.window = window_;
+        stats.frame_rate = frame_rate_;
+        stats.bit_rate = bit_rate_;
+        stats.bus_load = stats.bitrate ? bit_rate_ / stats.bitrate : 0;
+        stats.max_dispatch_latency = max_dispatch_latency_;
+    }
+};
+
+} // namespace can
+#endif
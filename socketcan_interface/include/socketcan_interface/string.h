@@ -2,130 +2,232 @@
 #define SOCKETCAN_INTERFACE_STRING_H
 
 #include "interface.h"
-#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string>
 
 namespace can{
 
-bool hex2dec(uint8_t &d, const char &h){
-    if( '0' <= h && h <='9') d = h - '0';
-    else if( 'a' <= h && h <='f') d = h - 'a' + 10;
-    else if( 'A' <= h && h <='F') d = h - 'A' + 10;
-    else return false;
+/**
+ * The codec works on caller-provided buffers and does not allocate,
+ * the std::string overloads are convenience wrappers with the same text format.
+ */
+enum{
+    HEADER_STRING_LEN = 8, ///< maximum length of an encoded header, without terminating zero
+    FRAME_STRING_LEN = HEADER_STRING_LEN + 3 + 2 * Frame::MAX_FD_LEN ///< maximum length of an encoded frame, without terminating zero
+};
+
+/** @return value of hex digit, -1 if invalid */
+inline int hexvalue(char h){
+    static const signed char table[256] = {
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+        -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+        -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+    };
+    return table[(unsigned char)h];
+}
+inline const char* hexdigits(bool lc){
+    return lc ? "0123456789abcdef" : "0123456789ABCDEF";
+}
+
+inline bool hex2dec(uint8_t &d, const char &h){
+    int v = hexvalue(h);
+    if(v < 0) return false;
+    d = v;
     return true;
 }
 
-bool hex2buffer(std::string &out, const std::string &in_raw, bool pad){
-    std::string in(in_raw);
-    if( (in.size() % 2) != 0){
-        if(pad) in.insert(0, "0");
-        else return false;
+/**
+ * decode hex string
+ * @param[out] out: buffer for at least (len+1)/2 bytes
+ * @param[out] out_len: number of decoded bytes
+ * @param[in] pad: accept odd number of digits by assuming a leading zero
+ */
+inline bool hex2buffer(uint8_t *out, size_t &out_len, const char *in, size_t len, bool pad){
+    size_t i = 0;
+    out_len = 0;
+    if(len % 2){
+        if(!pad) return false;
+        int lo = hexvalue(in[0]);
+        if(lo < 0) return false;
+        out[out_len++] = lo;
+        i = 1;
     }
-
-    out.resize(in.size()>>1);
-    for(size_t i=0; i < out.size(); ++i){
-        uint8_t hi, lo;
-
-       if(!hex2dec(hi, in[i<<1]) || !hex2dec(lo, in[(i<<1) +1])) return false;
-        out[i] = (hi << 4) | lo;
+    for(; i < len; i += 2){
+        int hi = hexvalue(in[i]), lo = hexvalue(in[i+1]);
+        if(hi < 0 || lo < 0) return false;
+        out[out_len++] = (hi << 4) | lo;
     }
-
-
     return true;
 }
-
-bool dec2hex(char &h, const uint8_t &d, bool lc){
-    if(d < 10) h = '0' + d;
-    else if (d < 16 && lc) h = 'a' + (d-10);
-    else if (d < 16 && !lc) h = 'A' + (d-10);
-    else return false;
+inline bool hex2buffer(std::string &out, const std::string &in, bool pad){
+    out.resize((in.size() + 1) / 2);
+    size_t len = 0;
+    if(!in.empty() && !hex2buffer(reinterpret_cast<uint8_t*>(&out[0]), len, in.data(), in.size(), pad)) return false;
+    out.resize(len);
     return true;
 }
 
-std::string byte2hex(const uint8_t &d, bool pad, bool lc){
-    uint8_t hi = d >> 4;
-    char c;
-    std::string s;
-    if(hi || pad){
-        dec2hex(c,hi,lc);
-        s +=c;
-    }
-    dec2hex(c,d & 0xf,lc);
-    s +=c;
-    return s;
+inline bool dec2hex(char &h, const uint8_t &d, bool lc){
+    if(d >= 16) return false;
+    h = hexdigits(lc)[d];
+    return true;
 }
 
+/** @return end of written digits */
+inline char* byte2hex(char *out, uint8_t d, bool pad, bool lc){
+    const char *digits = hexdigits(lc);
+    if((d >> 4) || pad) *out++ = digits[d >> 4];
+    *out++ = digits[d & 0xf];
+    return out;
+}
+inline std::string byte2hex(const uint8_t &d, bool pad, bool lc){
+    char buf[2];
+    return std::string(buf, byte2hex(buf, d, pad, lc));
+}
 
-std::string buffer2hex(const std::string &in, bool lc){
-    std::string s; s.reserve(in.size()*2);
-    for(size_t i=0; i < in.size(); ++i){
-        std::string b = byte2hex(in[i], i != 0 || 1 == in.size(), lc);
-        if(b.empty()) return b;
-        s += b;
+/**
+ * encode buffer as hex, all but the first byte are zero-padded (unless it is the only one)
+ * @return end of written digits
+ */
+inline char* buffer2hex(char *out, const uint8_t *in, size_t len, bool lc){
+    for(size_t i=0; i < len; ++i){
+        out = byte2hex(out, in[i], i != 0 || 1 == len, lc);
     }
+    return out;
+}
+inline std::string buffer2hex(const std::string &in, bool lc){
+    std::string s(in.size() * 2, '\0');
+    if(!in.empty()) s.resize(buffer2hex(&s[0], reinterpret_cast<const uint8_t*>(in.data()), in.size(), lc) - &s[0]);
     return s;
 }
 
-std::string tostring(const Header &h, bool lc){
-    std::string s; s.reserve(8);
-    std::stringstream buf;
-    buf << std::hex;
-    if(lc) buf << std::nouppercase;
-    else buf << std::uppercase;
-    buf << (int)h;
-    return buf.str();
+/**
+ * encode header as hex value (including the flag bits) without leading zeros
+ * @param[out] out: buffer for at least HEADER_STRING_LEN+1 characters
+ * @return length of string, excluding the terminating zero
+ */
+inline size_t tostring(char *out, const Header &h, bool lc){
+    const char *digits = hexdigits(lc);
+    unsigned int v = h;
+    char buf[HEADER_STRING_LEN];
+    char *b = buf;
+    do{
+        *b++ = digits[v & 0xf];
+        v >>= 4;
+    }while(v);
+    size_t len = b - buf;
+    while(b != buf) *out++ = *--b;
+    *out = '\0';
+    return len;
+}
+inline std::string tostring(const Header &h, bool lc){
+    char buf[HEADER_STRING_LEN + 1];
+    return std::string(buf, tostring(buf, h, lc));
 }
 
-Header toheader(const std::string &s){
-    if(s.empty() || s.size() > 4) return MsgHeader(0xfff); // invalid
+/** parse header from up to 4 characters of hex digits (with optional 0x prefix), parsing stops at the first invalid character */
+inline Header toheader(const char *s, size_t len){
+    if(len == 0 || len > 4) return MsgHeader(0xfff); // invalid
 
-    std::stringstream stream;
-    stream << std::hex << s;
+    size_t i = 0;
+    if(len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) i = 2;
     unsigned int h = 0;
-    stream >> h;
-
+    for(; i < len; ++i){
+        int v = hexvalue(s[i]);
+        if(v < 0) break;
+        h = (h << 4) | v;
+    }
     return Header(h & Header::ID_MASK, h & Header::EXTENDED_MASK, h & Header::RTR_MASK, h & Header::ERROR_MASK);
 }
+inline Header toheader(const std::string &s){
+    return toheader(s.data(), s.size());
+}
 
-std::string tostring(const Frame &f, bool lc){
-    std::string s;
-    s.resize(f.dlc);
-
-    for(uint8_t i = 0; i < f.dlc; ++i){
-        s[i] = f.data[i];
+/**
+ * encode frame in cansend notation: <header>#<data> or <header>##<flags><data> for CAN FD
+ * @param[out] out: buffer for at least FRAME_STRING_LEN+1 characters
+ * @return length of string, excluding the terminating zero
+ */
+inline size_t tostring(char *out, const Frame &f, bool lc){
+    char *p = out + tostring(out, (const Header &)f, lc);
+    *p++ = '#';
+    if(f.is_fd){ // cansend notation: ##<flags><data>, flags: 1 = bit rate switch
+        *p++ = '#';
+        *p++ = f.brs ? '1' : '0';
     }
-    return tostring((const Header &)f, lc) + '#' + buffer2hex(s, lc);
+    p = buffer2hex(p, f.data.data(), std::min<size_t>(f.dlc, Frame::MAX_FD_LEN), lc);
+    *p = '\0';
+    return p - out;
+}
+inline std::string tostring(const Frame &f, bool lc){
+    char buf[FRAME_STRING_LEN + 1];
+    return std::string(buf, tostring(buf, f, lc));
 }
 
-Frame toframe(const std::string &s){
-    size_t sep = s.find('#');
-    if(sep == std::string::npos) return MsgHeader(0xfff);
+inline Frame toframe(const char *s, size_t len){
+    const char *sep = static_cast<const char*>(memchr(s, '#', len));
+    if(!sep) return MsgHeader(0xfff);
 
-    Header header = toheader(s.substr(0, sep));
+    Header header = toheader(s, sep - s);
 
     Frame frame(header);
 
-    std::string buffer;
-    if(header.isValid() && hex2buffer(buffer, s.substr(sep+1), false)){
-        if(buffer.size() > 8) return MsgHeader(0xfff);
+    const char *payload = sep + 1;
+    size_t payload_len = len - (payload - s);
+    size_t max_len = Frame::MAX_LEN;
+    if(payload_len && payload[0] == '#'){ // CAN FD
+        uint8_t flags;
+        if(payload_len < 2 || !hex2dec(flags, payload[1])) return MsgHeader(0xfff);
+        frame.is_fd = 1;
+        frame.brs = (flags & 1) ? 1 : 0;
+        payload += 2;
+        payload_len -= 2;
+        max_len = Frame::MAX_FD_LEN;
+    }
 
-        for(size_t i=0; i < buffer.size(); ++i){
-            frame.data[i] = buffer[i];
+    if(header.isValid() && payload_len % 2 == 0){
+        if(payload_len / 2 > max_len){
+            for(size_t i = 0; i < payload_len; ++i){
+                if(hexvalue(payload[i]) < 0) return frame;
+            }
+            return MsgHeader(0xfff);
         }
 
-        frame.dlc = buffer.size();
+        size_t dlc = 0;
+        if(hex2buffer(frame.data.data(), dlc, payload, payload_len, false)){
+            frame.dlc = dlc;
+            if(frame.is_fd){ // pad to next valid CAN FD length
+                unsigned char len = dlc2len(len2dlc(frame.dlc));
+                for(; frame.dlc < len; ++frame.dlc) frame.data[frame.dlc] = 0;
+            }
+        }else{
+            frame.data.fill(0);
+        }
     }
     return frame;
 }
+inline Frame toframe(const std::string &s){
+    return toframe(s.data(), s.size());
+}
 
 }
 
-std::ostream& operator<<(std::ostream& stream,
+inline std::ostream& operator<<(std::ostream& stream,
                      const can::Header &h) {
-    return stream << can::tostring(h, true);
+    char buf[can::HEADER_STRING_LEN + 1];
+    return stream.write(buf, can::tostring(buf, h, true));
  }
-std::ostream& operator<<(std::ostream& stream,
+inline std::ostream& operator<<(std::ostream& stream,
                      const can::Frame &f) {
-    return stream << can::tostring(f, true);
+    char buf[can::FRAME_STRING_LEN + 1];
+    return stream.write(buf, can::tostring(buf, f, true));
  }
 
 #endif
@@ -0,0 +1,153 @@
+#ifndef H_CAN_THREAD_CONFIG
+#define H_CAN_THREAD_CONFIG
+
+#include <socketcan_interface/settings.h>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+namespace can{
+
+/** scheduling policy, priority and CPU affinity of a thread */
+class ThreadConfig{
+public:
+    struct Status{
+        bool ok; ///< requested configuration could be applied
+        std::string effective; ///< configuration that is in effect
+    };
+    typedef std::map<std::string, Status> StatusMap;
+
+    int policy; ///< SCHED_OTHER, SCHED_FIFO, SCHED_RR or -1 to keep the inherited policy
+    int priority; ///< static priority for SCHED_FIFO and SCHED_RR
+    std::vector<int> cpus; ///< CPUs to run on, empty to keep the inherited affinity
+
+    ThreadConfig() : policy(-1), priority(0) {}
+
+    static bool parsePolicy(const std::string &s, int &policy){
+        if(s == "other") policy = SCHED_OTHER;
+        else if(s == "fifo") policy = SCHED_FIFO;
+        else if(s == "rr") policy = SCHED_RR;
+        else return false;
+        return true;
+    }
+    static std::string policyName(int policy){
+        switch(policy){
+            case SCHED_OTHER: return "other";
+            case SCHED_FIFO: return "fifo";
+            case SCHED_RR: return "rr";
+            default: return "inherited";
+        }
+    }
+    /** parse CPU list like "0,2-3" */
+    static bool parseCPUs(const std::string &s, std::vector<int> &cpus){
+        cpus.clear();
+        std::stringstream sstr(s);
+        std::string range;
+        while(std::getline(sstr, range, ',')){
+            int first, last;
+            char dash;
+            std::stringstream rstr(range);
+            if(!(rstr >> first)) return false;
+            if(rstr >> dash){
+                if(dash != '-' || !(rstr >> last)) return false;
+            }else{
+                last = first;
+            }
+            if(first < 0 || last < first || last >= CPU_SETSIZE) return false;
+            for(int c = first; c <= last; ++c) cpus.push_back(c);
+        }
+        return true;
+    }
+
+    /**
+     * read settings <prefix>_policy ("other", "fifo" or "rr"), <prefix>_priority and <prefix>_cpus (e.g. "0,2-3")
+     * @return false if a setting could not be parsed
+     */
+    bool read(const Settings &settings, const std::string &prefix){
+        std::string s;
+        if(settings.get(prefix + "_policy", s) && !parsePolicy(s, policy)) return false;
+        priority = settings.get_optional(prefix + "_priority", priority);
+        if(settings.get(prefix + "_cpus", s) && !parseCPUs(s, cpus)) return false;
+        return true;
+    }
+
+    /**
+     * apply configuration to the calling thread and record the effective configuration for diagnostics
+     * @param[in] name: name of the thread, used as key in getStatus
+     * @return true if configuration was applied successfully
+     */
+    bool apply(const std::string &name) const {
+        bool ok = true;
+        if(policy >= 0){
+            struct sched_param param;
+            param.sched_priority = (policy == SCHED_FIFO || policy == SCHED_RR) ? priority : 0;
+            ok = pthread_setschedparam(pthread_self(), policy, &param) == 0 && ok;
+        }
+        if(!cpus.empty()){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(std::vector<int>::const_iterator it = cpus.begin(); it != cpus.end(); ++it) CPU_SET(*it, &set);
+            ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && ok;
+        }
+        Status status;
+        status.ok = ok;
+        status.effective = current().str();
+        boost::mutex::scoped_lock lock(registry().mutex);
+        registry().status[name] = status;
+        return ok;
+    }
+
+    /** @return effective configuration of the calling thread */
+    static ThreadConfig current(){
+        ThreadConfig config;
+        struct sched_param param;
+        if(pthread_getschedparam(pthread_self(), &config.policy, &param) == 0) config.priority = param.sched_priority;
+        cpu_set_t set;
+        if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0){
+            for(int c = 0; c < CPU_SETSIZE; ++c){
+                if(CPU_ISSET(c, &set)) config.cpus.push_back(c);
+            }
+        }
+        return config;
+    }
+
+    std::string str() const {
+        std::stringstream sstr;
+        sstr << policyName(policy);
+        if(policy == SCHED_FIFO || policy == SCHED_RR) sstr << ":" << priority;
+        if(!cpus.empty()){
+            sstr << " cpus=";
+            for(size_t i = 0; i < cpus.size(); ++i) sstr << (i ? "," : "") << cpus[i];
+        }
+        return sstr.str();
+    }
+
+    /** @return status of all threads that applied a configuration, by name */
+    static StatusMap getStatus(){
+        boost::mutex::scoped_lock lock(registry().mutex);
+        return registry().status;
+    }
+private:
+    struct Registry{
+        boost::mutex mutex;
+        StatusMap status;
+    };
+    static Registry& registry(){
+        static Registry r;
+        return r;
+    }
+};
+
+/** lock all current and future pages of the process into RAM */
+inline bool lockMemory(){
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+} // namespace can
+#endif
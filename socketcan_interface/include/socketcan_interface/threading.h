@@ -2,6 +2,7 @@
 #define H_CAN_THREADING_BASE
 
 #include <socketcan_interface/interface.h>
+#include <socketcan_interface/thread_config.h>
 #include <boost/thread/thread.hpp>
 #include <boost/bind.hpp>
 
@@ -44,10 +45,24 @@ public:
 
 template<typename WrappedInterface> class ThreadedInterface : public WrappedInterface{
     boost::shared_ptr<boost::thread> thread_;
+    ThreadConfig thread_config_;
+    std::string thread_name_;
     void run_thread(){
+        if(!thread_name_.empty()) thread_config_.apply(thread_name_);
         WrappedInterface::run();
     }
 public:
+    using WrappedInterface::init;
+    /**
+     * additional settings: thread_{policy,priority,cpus} configure the driver thread, see ThreadConfig::read
+     */
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings) {
+        if(!thread_){
+            if(!thread_config_.read(settings, "thread")) return false;
+            thread_name_ = device + "/driver";
+        }
+        return WrappedInterface::init(device, loopback, settings);
+    }
     virtual bool init(const std::string &device, bool loopback) {
         if(!thread_ && WrappedInterface::init(device, loopback)){
             thread_.reset(new boost::thread(&ThreadedInterface::run_thread, this));
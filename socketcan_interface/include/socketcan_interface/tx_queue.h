@@ -0,0 +1,194 @@
+#ifndef H_CAN_TX_QUEUE
+#define H_CAN_TX_QUEUE
+
+#include <socketcan_interface/interface.h>
+#include <socketcan_interface/settings.h>
+#include <socketcan_interface/statistics.h>
+#include <boost/circular_buffer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/chrono/system_clocks.hpp>
+
+namespace can{
+
+/** classify frame by the CANopen predefined connection set */
+inline TxClass txClass(const Frame &msg){
+    if(msg.is_extended || msg.is_error) return tx_other;
+    if(msg.id == 0x000 || msg.id == 0x080) return tx_sync; // NMT, SYNC
+    if(msg.id >= 0x180 && msg.id < 0x580) return tx_rpdo;
+    if(msg.id >= 0x580 && msg.id < 0x680) return tx_sdo;
+    return tx_other;
+}
+
+/**
+ * bounded transmit queue with one FIFO per TxClass.
+ * Producers push from any thread, a single writer takes frames in priority order with peek and pop.
+ * If the FIFO of a class is full, push either fails immediately (drop) or waits for space until the timeout (block).
+ */
+class TxQueue : boost::noncopyable{
+public:
+    enum Policy{
+        block, ///< wait for space, fail after timeout
+        drop ///< fail immediately
+    };
+private:
+    typedef boost::chrono::steady_clock clock;
+    struct Queue{
+        boost::circular_buffer<Frame> frames;
+        Policy policy;
+        size_t max_depth;
+        boost::uint64_t dropped;
+        Queue() : policy(block), max_depth(0), dropped(0) {}
+    };
+    Queue queues_[NUM_TX_CLASSES];
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    clock::duration timeout_;
+    bool open_;
+public:
+    /** defaults: SYNC/NMT 16 frames (drop), RPDO 256 (drop), SDO and others 256 (block), 100 ms timeout */
+    TxQueue() : timeout_(boost::chrono::milliseconds(100)), open_(true) {
+        configure(tx_sync, 16, drop);
+        configure(tx_rpdo, 256, drop);
+        configure(tx_sdo, 256, block);
+        configure(tx_other, 256, block);
+    }
+
+    /** set size and policy of a class, queued frames of that class are discarded */
+    void configure(TxClass c, size_t size, Policy policy){
+        boost::mutex::scoped_lock lock(mutex_);
+        queues_[c].frames.set_capacity(std::max<size_t>(size, 1));
+        queues_[c].frames.clear();
+        queues_[c].policy = policy;
+        cond_.notify_all();
+    }
+    void setTimeout(const boost::chrono::duration<double> &timeout){
+        boost::mutex::scoped_lock lock(mutex_);
+        timeout_ = boost::chrono::duration_cast<clock::duration>(timeout);
+    }
+
+    /**
+     * read the configuration from settings:
+     * - tx_{sync,rpdo,sdo,other}_queue_size: capacity of the class in frames
+     * - tx_{sync,rpdo,sdo,other}_queue_policy: "block" or "drop"
+     * - tx_queue_timeout: timeout in seconds for the block policy
+     * @return false if settings are invalid
+     */
+    bool read(const Settings &settings){
+        static const char* names[NUM_TX_CLASSES] = { "sync", "rpdo", "sdo", "other" };
+        for(size_t i = 0; i < NUM_TX_CLASSES; ++i){
+            std::string prefix = std::string("tx_") + names[i] + "_queue_";
+            size_t size;
+            std::string policy;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                size = queues_[i].frames.capacity();
+                policy = queues_[i].policy == block ? "block" : "drop";
+            }
+            size = settings.get_optional<size_t>(prefix + "size", size);
+            policy = settings.get_optional<std::string>(prefix + "policy", policy);
+            if(size == 0 || (policy != "block" && policy != "drop")) return false;
+            configure(TxClass(i), size, policy == "block" ? block : drop);
+        }
+        double timeout = settings.get_optional<double>("tx_queue_timeout", boost::chrono::duration<double>(timeout_).count());
+        if(timeout < 0) return false;
+        setTimeout(boost::chrono::duration<double>(timeout));
+        return true;
+    }
+
+    /** accept frames */
+    void open(){
+        boost::mutex::scoped_lock lock(mutex_);
+        open_ = true;
+    }
+    /** discard all frames, reject new ones and wake up blocked producers */
+    void close(){
+        boost::mutex::scoped_lock lock(mutex_);
+        open_ = false;
+        for(size_t i = 0; i < NUM_TX_CLASSES; ++i) queues_[i].frames.clear();
+        cond_.notify_all();
+    }
+
+    /** @return false if the frame was dropped or the queue is closed */
+    bool push(const Frame &msg, TxClass c){
+        boost::mutex::scoped_lock lock(mutex_);
+        Queue &q = queues_[c];
+        if(open_ && q.frames.full() && q.policy == block){
+            clock::time_point abs_time = clock::now() + timeout_;
+            while(open_ && q.frames.full()){
+                if(cond_.wait_until(lock, abs_time) == boost::cv_status::timeout) break;
+            }
+        }
+        if(!open_) return false;
+        if(q.frames.full()){
+            ++q.dropped;
+            return false;
+        }
+        q.frames.push_back(msg);
+        q.max_depth = std::max(q.max_depth, q.frames.size());
+        return true;
+    }
+    bool push(const Frame &msg){
+        return push(msg, txClass(msg));
+    }
+
+    /**
+     * copy the next frames in priority order without removing them, only to be called by the writer
+     * @return number of frames
+     */
+    size_t peek(Frame *frames, TxClass *classes, size_t max){
+        boost::mutex::scoped_lock lock(mutex_);
+        size_t num = 0;
+        for(size_t i = 0; i < NUM_TX_CLASSES && num < max; ++i){
+            boost::circular_buffer<Frame> &q = queues_[i].frames;
+            for(boost::circular_buffer<Frame>::iterator it = q.begin(); it != q.end() && num < max; ++it, ++num){
+                frames[num] = *it;
+                classes[num] = TxClass(i);
+            }
+        }
+        return num;
+    }
+    /** remove the first num frames that were returned by peek, producers only append, so these are still at the front */
+    void pop(const TxClass *classes, size_t num){
+        boost::mutex::scoped_lock lock(mutex_);
+        for(size_t i = 0; i < num; ++i){
+            if(!queues_[classes[i]].frames.empty()) queues_[classes[i]].frames.pop_front();
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * discard all frames, but keep accepting new ones
+     * @return number of discarded frames
+     */
+    size_t clear(){
+        boost::mutex::scoped_lock lock(mutex_);
+        size_t num = 0;
+        for(size_t i = 0; i < NUM_TX_CLASSES; ++i){
+            num += queues_[i].frames.size();
+            queues_[i].frames.clear();
+        }
+        cond_.notify_all();
+        return num;
+    }
+
+    bool empty(){
+        boost::mutex::scoped_lock lock(mutex_);
+        for(size_t i = 0; i < NUM_TX_CLASSES; ++i){
+            if(!queues_[i].frames.empty()) return false;
+        }
+        return true;
+    }
+
+    void getStatistics(Statistics &stats){
+        boost::mutex::scoped_lock lock(mutex_);
+        for(size_t i = 0; i < NUM_TX_CLASSES; ++i){
+            stats.tx_queue_depth[i] = queues_[i].frames.size();
+            stats.max_tx_queue_depth[i] = queues_[i].max_depth;
+            stats.tx_dropped[i] = queues_[i].dropped;
+        }
+    }
+};
+
+} // namespace can
+#endif
@@ -0,0 +1,363 @@
+#ifndef H_CAN_VIRTUAL_BUS
+#define H_CAN_VIRTUAL_BUS
+
+#include <socketcan_interface/interface.h>
+#include <socketcan_interface/dispatcher.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace can{
+
+/**
+ * in-process CAN bus with simulated timing, no CAN hardware or kernel support needed.
+ *
+ * Pending frames are transmitted one at a time in arbitration order (lowest identifier wins, ties in submission order),
+ * each frame occupies the bus for its nominal bit time (without stuff bits) plus the configured arbitration delay.
+ * Every attached port receives the frame stamped with the bus time at the end of the transmission.
+ *
+ * In wall-clock mode a bus thread transmits the frames, the bus time follows the real clock while the bus is idle
+ * and delivery is delayed until the frame has left the simulated wire, so an overloaded bus queues frames like a real one.
+ * In virtual mode there is no thread, the bus time only advances by step() and advance(), which makes runs fully reproducible.
+ */
+class VirtualBus : boost::noncopyable{
+public:
+    typedef boost::shared_ptr<VirtualBus> Ptr;
+    typedef Frame::TimePoint TimePoint;
+    typedef TimePoint::duration Duration;
+
+    /** participant on the bus */
+    class Port{
+    public:
+        /**
+         * gets called from the bus for every transmitted frame, must not attach or detach ports
+         * @param[in] own: frame was submitted by this port
+         */
+        virtual void deliver(const Frame &msg, bool own) = 0;
+        /** gets called after each transmission and periodically while the bus is idle, e.g. for heartbeats */
+        virtual void tick(const TimePoint &now) {}
+        virtual ~Port() {}
+    };
+
+    struct Stats{
+        size_t frames; ///< number of transmitted frames
+        boost::uint64_t bits; ///< sum of nominal frame lengths
+        Duration busy; ///< time the bus was occupied
+        Duration total_latency; ///< sum of submission to delivery times
+        Duration max_latency;
+        size_t max_pending; ///< maximum number of frames that waited for arbitration
+        Stats() : frames(0), bits(0), busy(Duration::zero()), total_latency(Duration::zero()), max_latency(Duration::zero()), max_pending(0) {}
+    };
+
+    /** nominal number of bits on the wire, CAN FD frames are timed like classic frames with the full payload at nominal bit rate */
+    static unsigned int frameBits(const Frame &msg){
+        unsigned int bits = msg.is_extended ? 67 : 47; // SOF, arbitration, control, CRC, ACK, EOF and intermission
+        if(!msg.is_rtr) bits += 8 * msg.dlc;
+        return bits;
+    }
+    /** @return arbitration priority, lower value wins */
+    static boost::uint32_t arbitrationKey(const Frame &msg){
+        if(msg.is_extended){ // base ID, SRR and IDE are recessive, followed by the ID extension and RTR
+            return ((msg.id >> 18) << 21) | (3u << 19) | ((msg.id & 0x3FFFF) << 1) | msg.is_rtr;
+        }
+        return (msg.id << 21) | (msg.is_rtr << 20); // RTR, IDE is dominant
+    }
+
+    /**
+     * @param[in] bitrate: nominal bit rate in bit/s
+     * @param[in] wall_clock: run a bus thread that follows the real clock, otherwise time is advanced by step() and advance() only
+     */
+    VirtualBus(unsigned int bitrate = 1000000, bool wall_clock = true)
+    : bitrate_(bitrate), arbitration_delay_(Duration::zero()), wall_clock_(wall_clock), running_(wall_clock), seq_(0),
+      now_(wall_clock ? TimePoint::clock::now() : TimePoint())
+    {
+        if(wall_clock_) thread_ = boost::thread(&VirtualBus::run, this);
+    }
+    ~VirtualBus(){
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            running_ = false;
+        }
+        cond_.notify_one();
+        if(thread_.joinable()) thread_.join();
+    }
+
+    /** get bus by name, it gets created in wall-clock mode on first use and lives as long as it is referenced */
+    static Ptr get(const std::string &name){
+        static boost::mutex mutex;
+        static std::map<std::string, boost::weak_ptr<VirtualBus> > buses;
+        boost::mutex::scoped_lock lock(mutex);
+        Ptr bus = buses[name].lock();
+        if(!bus){
+            bus = boost::make_shared<VirtualBus>();
+            buses[name] = bus;
+        }
+        return bus;
+    }
+
+    void setBitrate(unsigned int bitrate){
+        boost::mutex::scoped_lock lock(mutex_);
+        bitrate_ = bitrate;
+    }
+    /** additional idle time before each frame, e.g. to model controller latencies */
+    void setArbitrationDelay(const Duration &delay){
+        boost::mutex::scoped_lock lock(mutex_);
+        arbitration_delay_ = delay;
+    }
+
+    void attach(Port *port){
+        boost::mutex::scoped_lock lock(ports_mutex_);
+        if(std::find(ports_.begin(), ports_.end(), port) == ports_.end()) ports_.push_back(port);
+    }
+    void detach(Port *port){
+        boost::mutex::scoped_lock lock(ports_mutex_);
+        ports_.erase(std::remove(ports_.begin(), ports_.end(), port), ports_.end());
+    }
+
+    /** queue frame for arbitration */
+    void submit(const Frame &msg, Port *sender){
+        boost::mutex::scoped_lock lock(mutex_);
+        Pending p;
+        p.msg = msg;
+        p.sender = sender;
+        p.key = arbitrationKey(msg);
+        p.seq = seq_++;
+        p.submitted = wall_clock_ ? TimePoint::clock::now() : now_;
+        pending_.insert(p);
+        stats_.max_pending = std::max(stats_.max_pending, pending_.size());
+        lock.unlock();
+        cond_.notify_one();
+    }
+
+    /** @return current bus time */
+    TimePoint now(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return now_;
+    }
+    Stats getStats(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return stats_;
+    }
+    void resetStats(){
+        boost::mutex::scoped_lock lock(mutex_);
+        stats_ = Stats();
+    }
+
+    /**
+     * transmit the frame that wins arbitration, only for virtual mode
+     * @return false if no frame was pending
+     */
+    bool step(){
+        Pending p;
+        if(!transmit(p)) return false;
+        deliver(p);
+        return true;
+    }
+    /** transmit pending frames for the given bus time, only for virtual mode */
+    void advance(const Duration &duration){
+        TimePoint end;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            end = now_ + duration;
+        }
+        Pending p;
+        while(transmit(p, end)) deliver(p);
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if(now_ < end) now_ = end;
+        }
+        tick(end);
+    }
+private:
+    struct Pending{
+        Frame msg;
+        Port *sender;
+        boost::uint32_t key;
+        boost::uint64_t seq;
+        TimePoint submitted;
+        bool operator<(const Pending &other) const {
+            return key != other.key ? key < other.key : seq < other.seq;
+        }
+    };
+
+    /** pick winner, advance bus time and update statistics */
+    bool transmit(Pending &p, const TimePoint &limit = TimePoint::max()){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(pending_.empty()) return false;
+        const Pending &winner = *pending_.begin();
+        // back-to-back frames follow the bus time, so processing delays of the bus thread do not add up
+        TimePoint start = std::max(now_ + arbitration_delay_, winner.submitted);
+        if(start >= limit) return false;
+
+        p = winner;
+        pending_.erase(pending_.begin());
+
+        unsigned int bits = frameBits(p.msg);
+        Duration duration = boost::chrono::duration_cast<Duration>(boost::chrono::nanoseconds(boost::uint64_t(bits) * 1000000000 / bitrate_));
+        now_ = start + duration;
+        p.msg.stamp = now_;
+
+        Duration latency = now_ - p.submitted;
+        ++stats_.frames;
+        stats_.bits += bits;
+        stats_.busy += duration;
+        stats_.total_latency += latency;
+        stats_.max_latency = std::max(stats_.max_latency, latency);
+        return true;
+    }
+    void deliver(const Pending &p){
+        {
+            boost::mutex::scoped_lock lock(ports_mutex_);
+            for(std::vector<Port*>::iterator it = ports_.begin(); it != ports_.end(); ++it){
+                (*it)->deliver(p.msg, *it == p.sender);
+            }
+        }
+        tick(p.msg.stamp);
+    }
+    void tick(const TimePoint &now){
+        boost::mutex::scoped_lock lock(ports_mutex_);
+        for(std::vector<Port*>::iterator it = ports_.begin(); it != ports_.end(); ++it){
+            (*it)->tick(now);
+        }
+    }
+    void run(){
+        boost::mutex::scoped_lock lock(mutex_);
+        while(running_){
+            if(pending_.empty()){
+                if(!cond_.timed_wait(lock, boost::posix_time::milliseconds(1))){
+                    now_ = std::max(now_, TimePoint::clock::now());
+                    TimePoint now = now_;
+                    lock.unlock();
+                    tick(now);
+                    lock.lock();
+                }
+                continue;
+            }
+            lock.unlock();
+            Pending p;
+            if(transmit(p)){
+                boost::this_thread::sleep_until(p.msg.stamp); // frame is on the wire
+                deliver(p);
+            }
+            lock.lock();
+        }
+    }
+
+    boost::mutex mutex_; ///< protects pending frames, time and statistics
+    boost::condition_variable cond_;
+    unsigned int bitrate_;
+    Duration arbitration_delay_;
+    const bool wall_clock_;
+    bool running_;
+    boost::uint64_t seq_;
+    TimePoint now_;
+    std::multiset<Pending> pending_;
+    Stats stats_;
+
+    boost::mutex ports_mutex_; ///< held while delivering
+    std::vector<Port*> ports_;
+
+    boost::thread thread_;
+};
+
+/**
+ * driver that is attached to a VirtualBus, the device name selects the bus.
+ * Supported settings: bitrate (in bit/s, applied to the bus)
+ */
+class VirtualInterface : public DriverInterface, public VirtualBus::Port{
+    typedef TableDispatcher<CommInterface::FrameListener> FrameDispatcher;
+    typedef SimpleDispatcher<StateInterface::StateListener> StateDispatcher;
+    FrameDispatcher frame_dispatcher_;
+    StateDispatcher state_dispatcher_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    State state_;
+    const VirtualBus::Ptr fixed_bus_;
+    VirtualBus::Ptr bus_;
+    std::string device_;
+    bool loopback_;
+
+    void setDriverState(State::DriverState s){
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_.driver_state != s){
+            state_.driver_state = s;
+            state_dispatcher_.dispatch(state_);
+        }
+        lock.unlock();
+        cond_.notify_all();
+    }
+public:
+    VirtualInterface() : loopback_(false) {}
+    /** attach to the given bus instead of a named one */
+    VirtualInterface(const VirtualBus::Ptr &bus) : fixed_bus_(bus), loopback_(false) {}
+    virtual ~VirtualInterface() { shutdown(); }
+
+    virtual bool init(const std::string &device, bool loopback, const Settings &settings){
+        unsigned int bitrate = settings.get_optional<unsigned int>("bitrate", 0);
+        if(!init(device, loopback)) return false;
+        if(bitrate) bus_->setBitrate(bitrate);
+        return true;
+    }
+    virtual bool init(const std::string &device, bool loopback){
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if(state_.driver_state != State::closed) return false;
+            bus_ = fixed_bus_ ? fixed_bus_ : VirtualBus::get(device);
+            device_ = device;
+            loopback_ = loopback;
+        }
+        bus_->attach(this);
+        setDriverState(State::ready);
+        return true;
+    }
+    virtual bool recover(){
+        if(getState().driver_state == State::closed && bus_) return init(device_, loopback_);
+        return getState().isReady();
+    }
+    virtual State getState(){
+        boost::mutex::scoped_lock lock(mutex_);
+        return state_;
+    }
+    virtual void shutdown(){
+        if(bus_) bus_->detach(this);
+        setDriverState(State::closed);
+    }
+    virtual bool translateError(unsigned int internal_error, std::string & str) { return false; }
+    virtual bool doesLoopBack() const { return loopback_; }
+    /** frames are delivered by the bus, so this just blocks until shutdown */
+    virtual void run(){
+        boost::mutex::scoped_lock lock(mutex_);
+        while(state_.driver_state == State::ready) cond_.wait(lock);
+    }
+
+    virtual bool send(const Frame & msg){
+        if(!getState().isReady()) return false;
+        bus_->submit(msg, this);
+        return true;
+    }
+    virtual void deliver(const Frame &msg, bool own){
+        if(!own || loopback_) frame_dispatcher_.dispatch(msg);
+    }
+
+    virtual FrameListener::Ptr createMsgListener(const FrameDelegate &delegate){
+        return frame_dispatcher_.createListener(delegate);
+    }
+    virtual FrameListener::Ptr createMsgListener(const Frame::Header&h , const FrameDelegate &delegate){
+        return frame_dispatcher_.createListener(h, delegate);
+    }
+    virtual StateListener::Ptr createStateListener(const StateDelegate &delegate){
+        return state_dispatcher_.createListener(delegate);
+    }
+    const VirtualBus::Ptr& getBus() const { return bus_; }
+};
+
+} // namespace can
+#endif
@@ -0,0 +1,449 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <socketcan_interface/FastDelegate.h>
+#include <socketcan_interface/socketcan.h>
+#include <socketcan_interface/threading.h>
+#include <socketcan_interface/string.h>
+#include <socketcan_interface/reactor.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace can;
+
+class CountingInterface : public ThreadedInterface<SocketCANInterface>{
+public:
+    boost::atomic<size_t> wakeups; ///< every wakeup issues exactly one read call
+    CountingInterface(size_t rx_batch) : ThreadedInterface<SocketCANInterface>(rx_batch), wakeups(0) {}
+protected:
+    virtual void triggerReadSome(){
+        ++wakeups;
+        SocketCANInterface::triggerReadSome();
+    }
+};
+
+class FrameCounter{
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    size_t count_;
+public:
+    FrameCounter() : count_(0) {}
+    void handle(const Frame &f){
+        boost::mutex::scoped_lock lock(mutex_);
+        ++count_;
+        lock.unlock();
+        cond_.notify_one();
+    }
+    bool wait(size_t num, const boost::posix_time::time_duration &timeout){
+        boost::mutex::scoped_lock lock(mutex_);
+        boost::system_time abs_time = boost::get_system_time() + timeout;
+        while(count_ < num){
+            if(!cond_.timed_wait(lock, abs_time)) return false;
+        }
+        return true;
+    }
+};
+
+void send_frames(const std::string &device, size_t num, size_t burst){
+    int sc = socket( PF_CAN, SOCK_RAW, CAN_RAW );
+    if(sc < 0) _exit(1);
+
+    struct ifreq ifr;
+    strcpy(ifr.ifr_name, device.c_str());
+    if(ioctl(sc, SIOCGIFINDEX, &ifr) != 0) _exit(1);
+
+    struct sockaddr_can addr = {0};
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if(bind( sc, (struct sockaddr*)&addr, sizeof(addr) ) != 0) _exit(1);
+
+    can_frame frame = {0};
+    frame.can_dlc = 8;
+    for(size_t i = 0; i < num; ++i){
+        frame.can_id = 0x181 + (i % burst); // one TPDO per simulated drive
+        memcpy(frame.data, &i, sizeof(uint32_t));
+        while(write(sc, &frame, sizeof(frame)) != sizeof(frame)){
+            if(errno != ENOBUFS && errno != EAGAIN) _exit(1);
+            usleep(100);
+        }
+        if((i % burst) == burst-1) usleep(50); // let the burst hit the bus
+    }
+    close(sc);
+    _exit(0);
+}
+
+double cpu_time(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+bool run_rx(const std::string &device, size_t num, size_t burst, size_t rx_batch){
+    CountingInterface driver(rx_batch);
+    FrameCounter counter;
+    CommInterface::FrameListener::Ptr listener = driver.createMsgListener(CommInterface::FrameDelegate(&counter, &FrameCounter::handle));
+
+    if(!driver.init(device, false)){
+        std::cout << "could not initialize " << device << std::endl;
+        return false;
+    }
+
+    size_t wakeups = driver.wakeups;
+    double start = cpu_time();
+
+    pid_t pid = fork();
+    if(pid == 0) send_frames(device, num, burst);
+
+    bool ok = counter.wait(num, boost::posix_time::seconds(10));
+    double cpu = cpu_time() - start;
+    wakeups = driver.wakeups - wakeups;
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    driver.shutdown();
+
+    if(!ok || status != 0){
+        std::cout << "batch " << rx_batch << ": not all frames were received" << std::endl;
+        return false;
+    }
+    std::cout << "batch " << rx_batch << ": " << num << " frames, "
+              << double(wakeups) / num << " read calls/frame, "
+              << cpu * 1e6 / num * 10000 << " us CPU/10k frames" << std::endl;
+    return true;
+}
+
+double wall_time(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Sink{
+    size_t count;
+    Sink() : count(0) {}
+    void handle(const Frame &f){ ++count; }
+};
+
+template<typename Dispatcher> double dispatch_ns(size_t listeners, size_t num){
+    Dispatcher dispatcher;
+    Sink sink;
+    std::vector<CommInterface::FrameListener::Ptr> registered;
+    std::vector<Frame> frames;
+
+    for(size_t i = 0; i < listeners; ++i){
+        registered.push_back(dispatcher.createListener(MsgHeader(0x181 + i), CommInterface::FrameDelegate(&sink, &Sink::handle)));
+        frames.push_back(Frame(MsgHeader(0x181 + i), 8));
+    }
+    frames.push_back(Frame(MsgHeader(0x80), 0)); // unknown ID, e.g. SYNC
+
+    double start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        dispatcher.dispatch(frames[i % frames.size()]);
+    }
+    return (wall_time() - start) * 1e9 / num;
+}
+
+/** create and destroy a listener while 16 others stay registered, like nodes do on every PDO init */
+template<typename Dispatcher> double listener_ns(size_t num){
+    Dispatcher dispatcher;
+    Sink sink;
+    std::vector<CommInterface::FrameListener::Ptr> registered;
+    for(size_t i = 0; i < 16; ++i){
+        registered.push_back(dispatcher.createListener(MsgHeader(0x181 + i), CommInterface::FrameDelegate(&sink, &Sink::handle)));
+    }
+    double start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        CommInterface::FrameListener::Ptr l = dispatcher.createListener(MsgHeader(0x181 + i % 16), CommInterface::FrameDelegate(&sink, &Sink::handle));
+    }
+    return (wall_time() - start) * 1e9 / num;
+}
+
+void run_dispatch(size_t num){
+    const size_t listeners[] = {1, 16, 128};
+    for(size_t i = 0; i < sizeof(listeners)/sizeof(listeners[0]); ++i){
+        std::cout << listeners[i] << " listeners: "
+                  << dispatch_ns<FilteredDispatcher<const unsigned int, CommInterface::FrameListener> >(listeners[i], num) << " ns/frame (FilteredDispatcher), "
+                  << dispatch_ns<TableDispatcher<CommInterface::FrameListener> >(listeners[i], num) << " ns/frame (TableDispatcher)" << std::endl;
+    }
+    std::cout << "create and destroy listener: "
+              << listener_ns<FilteredDispatcher<const unsigned int, CommInterface::FrameListener> >(num / 10) << " ns (FilteredDispatcher), "
+              << listener_ns<TableDispatcher<CommInterface::FrameListener> >(num / 10) << " ns (TableDispatcher)" << std::endl;
+}
+
+struct Accumulator{
+    size_t sum;
+    Accumulator() : sum(0) {}
+    void add(const Frame &f){ sum += f.dlc; }
+};
+/** functor with state, like a lambda with captures */
+struct WeightedAdd{
+    Accumulator *acc;
+    size_t weight;
+    void operator()(const Frame &f) const { acc->sum += f.dlc * weight; }
+};
+
+template<typename Delegate> double call_ns(const std::vector<Delegate> &delegates, size_t num){
+    Frame frame(MsgHeader(0x181), 8);
+    double start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        delegates[i % delegates.size()](frame);
+    }
+    return (wall_time() - start) * 1e9 / num;
+}
+
+void run_delegate(size_t num){
+    Accumulator acc[4];
+    std::vector<fastdelegate::FastDelegate1<const Frame&> > fast;
+    std::vector<CommInterface::FrameDelegate> member, functor, bound;
+    std::vector<boost::function<void(const Frame&)> > function;
+    for(size_t i = 0; i < 4; ++i){
+        WeightedAdd w = { &acc[i], i + 1 };
+        fast.push_back(fastdelegate::FastDelegate1<const Frame&>(&acc[i], &Accumulator::add));
+        member.push_back(CommInterface::FrameDelegate(&acc[i], &Accumulator::add));
+        functor.push_back(CommInterface::FrameDelegate(w));
+        bound.push_back(CommInterface::FrameDelegate(boost::bind(&Accumulator::add, &acc[i], _1)));
+        function.push_back(boost::bind(&Accumulator::add, &acc[i], _1));
+    }
+    std::cout << "call: " << call_ns(fast, num) << " ns (FastDelegate), "
+              << call_ns(member, num) << " ns (FrameDelegate, member), "
+              << call_ns(functor, num) << " ns (FrameDelegate, functor), "
+              << call_ns(bound, num) << " ns (FrameDelegate, boost::bind), "
+              << call_ns(function, num) << " ns (boost::function)" << std::endl;
+
+    num /= 10;
+    double start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        CommInterface::FrameDelegate copy(bound[i % bound.size()]);
+        if(!copy) return;
+    }
+    double copy_ns = (wall_time() - start) * 1e9 / num;
+    start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        boost::function<void(const Frame&)> copy(function[i % function.size()]);
+        if(!copy) return;
+    }
+    std::cout << "copy: " << copy_ns << " ns (FrameDelegate, boost::bind), " << (wall_time() - start) * 1e9 / num << " ns (boost::function)" << std::endl;
+    std::cout << "(" << acc[0].sum + acc[1].sum + acc[2].sum + acc[3].sum << ")" << std::endl;
+}
+
+void run_string(size_t num){
+    std::vector<Frame> frames;
+    std::vector<std::string> strings;
+    for(size_t i = 0; i < 16; ++i){
+        Frame f(MsgHeader(0x181 + i), i % 9);
+        for(size_t j = 0; j < f.dlc; ++j) f.data[j] = i * 17 + j;
+        frames.push_back(f);
+        strings.push_back(tostring(f, true));
+    }
+    Frame fd(MsgHeader(0x281), 64);
+    fd.is_fd = 1;
+    for(size_t j = 0; j < fd.dlc; ++j) fd.data[j] = j;
+    frames.push_back(fd);
+    strings.push_back(tostring(fd, true));
+
+    size_t check = 0;
+    double start = wall_time();
+    for(size_t i = 0; i < num; ++i) check += tostring(frames[i % frames.size()], true).size();
+    double encode_string = wall_time() - start;
+
+    char buf[FRAME_STRING_LEN + 1];
+    start = wall_time();
+    for(size_t i = 0; i < num; ++i) check += tostring(buf, frames[i % frames.size()], true);
+    double encode_buffer = wall_time() - start;
+
+    start = wall_time();
+    for(size_t i = 0; i < num; ++i) check += toframe(strings[i % strings.size()]).dlc;
+    double decode_string = wall_time() - start;
+
+    start = wall_time();
+    for(size_t i = 0; i < num; ++i){
+        const std::string &s = strings[i % strings.size()];
+        check += toframe(s.data(), s.size()).dlc;
+    }
+    double decode_buffer = wall_time() - start;
+
+    std::cout << "encode: " << num / encode_string << " frames/s (std::string), " << num / encode_buffer << " frames/s (buffer)" << std::endl;
+    std::cout << "decode: " << num / decode_string << " frames/s (std::string), " << num / decode_buffer << " frames/s (buffer)" << std::endl;
+    if(check == 0) std::cout << std::endl; // keep results alive
+}
+
+// SocketCANInterface on one end of a datagram socket pair, so no CAN device is needed
+class PairInterface : public SocketCANInterface{
+public:
+    int peer;
+    PairInterface(const Reactor::Ptr &reactor) : SocketCANInterface(32, 32, reactor), peer(-1) {}
+    bool open(){
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0) return false;
+        peer = sv[1];
+        boost::system::error_code ec;
+        socket_.assign(sv[0], ec);
+        if(ec) return false;
+        setDriverState(State::open);
+        return true;
+    }
+    virtual ~PairInterface(){
+        shutdown();
+        if(peer >= 0) close(peer);
+    }
+};
+
+uint64_t monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct LatencyMeter{ // only called by the realtime dispatch thread of one driver
+    boost::atomic<size_t> count;
+    double sum, max;
+    LatencyMeter() : count(0), sum(0), max(0) {}
+    void handle(const Frame &f){
+        uint64_t sent;
+        memcpy(&sent, &f.data[0], sizeof(sent));
+        double latency = (monotonic_ns() - sent) * 1e-3;
+        sum += latency;
+        max = std::max(max, latency);
+        ++count;
+    }
+};
+
+void send_cycles(int fd, size_t cycles, size_t burst){
+    can_frame frame = {0};
+    frame.can_dlc = 8;
+    for(size_t c = 0; c < cycles; ++c){
+        for(size_t i = 0; i < burst; ++i){
+            frame.can_id = 0x181 + i;
+            uint64_t now = monotonic_ns();
+            memcpy(frame.data, &now, sizeof(now));
+            if(write(fd, &frame, sizeof(frame)) != sizeof(frame)) _exit(1);
+        }
+        usleep(1000); // 1 kHz control cycle
+    }
+    _exit(0);
+}
+
+size_t count_threads(){
+    FILE *f = fopen("/proc/self/status", "r");
+    if(!f) return 0;
+    char line[256];
+    size_t threads = 0;
+    while(fgets(line, sizeof(line), f)){
+        if(sscanf(line, "Threads: %zu", &threads) == 1) break;
+    }
+    fclose(f);
+    return threads;
+}
+
+bool run_buses(size_t buses, bool shared, size_t cycles, size_t burst){
+    size_t idle_threads = count_threads();
+    Reactor::Ptr reactor;
+    if(shared) reactor.reset(new Reactor(1));
+
+    std::vector<boost::shared_ptr<PairInterface> > drivers;
+    std::vector<boost::shared_ptr<LatencyMeter> > meters;
+    std::vector<CommInterface::FrameListener::Ptr> listeners;
+    boost::thread_group threads;
+    for(size_t i = 0; i < buses; ++i){
+        drivers.push_back(boost::make_shared<PairInterface>(reactor));
+        meters.push_back(boost::make_shared<LatencyMeter>());
+        listeners.push_back(drivers[i]->createMsgListener(CommInterface::FrameDelegate(meters[i].get(), &LatencyMeter::handle)));
+        if(!drivers[i]->open()) return false;
+        threads.create_thread(boost::bind(&PairInterface::run, drivers[i].get()));
+        if(!StateWaiter::wait_for(State::ready, drivers[i].get(), boost::posix_time::seconds(1))) return false;
+    }
+    size_t driver_threads = count_threads() - idle_threads;
+
+    double start = cpu_time();
+    std::vector<pid_t> pids;
+    for(size_t i = 0; i < buses; ++i){
+        pid_t pid = fork();
+        if(pid == 0) send_cycles(drivers[i]->peer, cycles, burst);
+        pids.push_back(pid);
+    }
+    bool ok = true;
+    for(size_t i = 0; i < buses; ++i){
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if(status != 0) ok = false;
+    }
+    double sum = 0, max = 0;
+    for(size_t i = 0; i < buses; ++i){
+        for(int j = 0; j < 10000 && meters[i]->count < cycles * burst; ++j) usleep(1000);
+        if(meters[i]->count < cycles * burst) ok = false;
+        sum += meters[i]->sum;
+        max = std::max(max, meters[i]->max);
+    }
+    double cpu = cpu_time() - start;
+
+    for(size_t i = 0; i < buses; ++i) drivers[i]->shutdown();
+    threads.join_all();
+
+    if(!ok){
+        std::cout << buses << " buses: not all frames were received" << std::endl;
+        return false;
+    }
+    size_t frames = buses * cycles * burst;
+    std::cout << buses << " buses, " << (shared ? "shared reactor" : "thread per bus") << ": "
+              << driver_threads << " threads, "
+              << cpu * 1e6 / frames * 1000 << " us CPU/1k frames, latency "
+              << sum / frames << " us mean, " << max << " us max" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[]){
+
+    if(argc < 2){
+        std::cout << "usage: "<< argv[0] << " rx DEVICE [FRAMES [BURST [BATCH]]]" << std::endl;
+        std::cout << "       "<< argv[0] << " dispatch [FRAMES]" << std::endl;
+        std::cout << "       "<< argv[0] << " string [FRAMES]" << std::endl;
+        std::cout << "       "<< argv[0] << " delegate [CALLS]" << std::endl;
+        std::cout << "       "<< argv[0] << " buses [CYCLES [BURST]]" << std::endl;
+        return 1;
+    }
+    std::string mode(argv[1]);
+
+    if(mode == "dispatch"){
+        run_dispatch(argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 10000000);
+        return 0;
+    }
+
+    if(mode == "delegate"){
+        run_delegate(argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 100000000);
+        return 0;
+    }
+    if(mode == "string"){
+        run_string(argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 10000000);
+        return 0;
+    }
+
+    if(mode == "buses"){
+        size_t cycles = argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 2000;
+        size_t burst = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 8;
+        const size_t buses[] = {1, 2, 4};
+        for(size_t i = 0; i < sizeof(buses)/sizeof(buses[0]); ++i){
+            if(!run_buses(buses[i], false, cycles, burst) || !run_buses(buses[i], true, cycles, burst)) return 1;
+        }
+        return 0;
+    }
+
+    if(mode == "rx" && argc > 2){
+        size_t num = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 100000;
+        size_t burst = argc > 4 ? boost::lexical_cast<size_t>(argv[4]) : 8;
+
+        if(argc > 5) return run_rx(argv[2], num, burst, boost::lexical_cast<size_t>(argv[5])) ? 0 : 1;
+
+        return run_rx(argv[2], num, burst, 1) && run_rx(argv[2], num, burst, 32) ? 0 : 1;
+    }
+
+    std::cout << "unknown mode '" << mode << "'" << std::endl;
+    return 1;
+}
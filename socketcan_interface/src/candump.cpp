@@ -1,41 +1,60 @@
 #include <iostream>
+#include <cstdio>
+#include <csignal>
 #include <boost/unordered_set.hpp>
 
 #include <boost/make_shared.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 #include <pluginlib/class_loader.h>
 #include <socketcan_interface/socketcan.h>
+#include <socketcan_interface/capture.h>
+#include <socketcan_interface/settings.h>
 
 using namespace can;
 
-#include <iostream>
-
 void print_error(const State & s);
 
+char* print_hex(char *p, unsigned int val){
+    static const char digits[] = "0123456789abcdef";
+    char buf[8];
+    char *b = buf;
+    do{
+        *b++ = digits[val & 0xf];
+        val >>= 4;
+    }while(val);
+    while(b != buf) *p++ = *--b;
+    return p;
+}
+
 void print_frame(const Frame &f){
-    
-    if(f.is_error){
-        std::cout << "E " << std::hex << f.id << std::dec;
-    }else if(f.is_extended){
-        std::cout << "e " << std::hex << f.id << std::dec;
-    }else{
-        std::cout << "s " << std::hex << f.id << std::dec;
-    }
-    
-    std::cout << "\t";
-    
+    char line[8 + 1 + 3 + 3*Frame::MAX_FD_LEN + 2];
+    char *p = line;
+
+    *p++ = f.is_error ? 'E' : (f.is_extended ? 'e' : 's');
+    *p++ = ' ';
+    p = print_hex(p, f.id);
+    *p++ = '\t';
+
     if(f.is_rtr){
-        std::cout << "r";
+        *p++ = 'r';
     }else{
-        std::cout << (int) f.dlc << std::hex;
-        
+        p += sprintf(p, "%d", (int) f.dlc);
         for(int i=0; i < f.dlc; ++i){
-            std::cout << std::hex << " " << (int) f.data[i];
+            *p++ = ' ';
+            p = print_hex(p, f.data[i]);
         }
     }
-    
-    std::cout << std::dec << std::endl;
+    *p++ = '\n';
+    fwrite(line, 1, p - line, stdout); // line-buffered on terminals, block-buffered otherwise
 }
 
+CaptureWriter g_writer;
+void record_frame(const Frame &f){
+    if(!g_writer.write(f)){
+        std::cerr << "could not write frame" << std::endl;
+    }
+}
 
 boost::shared_ptr<class_loader::ClassLoader> g_loader;
 boost::shared_ptr<DriverInterface> g_driver;
@@ -46,11 +65,22 @@ void print_error(const State & s){
     std::cout << "ERROR: state=" << s.driver_state << " internal_error=" << s.internal_error << "('" << err << "') asio: " << s.error_code << std::endl;
 }
 
+void wait_for_signal(sigset_t sigset){
+    int sig = 0;
+    sigwait(&sigset, &sig);
+    g_driver->shutdown();
+}
 
 int main(int argc, char *argv[]){
-    
+    std::string capture;
+    if(argc > 2 && std::string(argv[1]) == "-w"){
+        capture = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
     if(argc != 2 && argc != 4){
-        std::cout << "usage: "<< argv[0] << " DEVICE [PLUGIN_PATH PLUGIN_NAME]" << std::endl;
+        std::cout << "usage: "<< argv[0] << " [-w CAPTURE_FILE] DEVICE [PLUGIN_PATH PLUGIN_NAME]" << std::endl;
         return 1;
     }
 
@@ -60,7 +90,7 @@ int main(int argc, char *argv[]){
             g_loader = boost::make_shared<class_loader::ClassLoader>(argv[2]);
             g_driver = g_loader->createInstance<DriverInterface>(argv[3]);
         }
-        
+
         catch(std::exception& ex)
         {
             std::cerr << boost::diagnostic_information(ex) << std::endl;;
@@ -69,23 +99,43 @@ int main(int argc, char *argv[]){
     }else{
         g_driver = boost::make_shared<SocketCANInterface>();
     }
-    
 
+    if(!capture.empty() && !g_writer.open(capture)){
+        std::cerr << "could not create " << capture << std::endl;
+        return 1;
+    }
 
-    CommInterface::FrameListener::Ptr frame_printer = g_driver->createMsgListener(print_frame);
+    CommInterface::FrameListener::Ptr frame_printer = g_driver->createMsgListener(capture.empty() ? print_frame : record_frame);
     StateInterface::StateListener::Ptr error_printer = g_driver->createStateListener(print_error);
-    
-    if(!g_driver->init(argv[1], false)){
+
+    SettingsMap settings;
+    if(!capture.empty()) settings.set("timestamps", "software"); // record the receive time of the kernel, not that of the dispatch
+    if(!g_driver->init(argv[1], false, settings)){
         print_error(g_driver->getState());
         return 1;
     }
 
+    // shut down on SIGINT and SIGTERM, so the output gets flushed and the capture gets closed properly
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigset, 0);
+    boost::thread signal_thread(wait_for_signal, sigset);
+
     g_driver->run();
-    
+
+    pthread_kill(signal_thread.native_handle(), SIGTERM); // driver might have stopped on its own
+    signal_thread.join();
+
     g_driver->shutdown();
+    g_writer.close();
+    fflush(stdout);
+    if(!capture.empty()) std::cerr << g_writer.getFrameCount() << " frames written to " << capture << std::endl;
+
     g_driver.reset();
     g_loader.reset();
-    
+
     return 0;
-    
-}
\ No newline at end of file
+
+}
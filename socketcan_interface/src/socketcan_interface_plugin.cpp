@@ -1,4 +1,9 @@
 #include <class_loader/class_loader.h> 
 #include <socketcan_interface/socketcan.h>
+#include <socketcan_interface/virtual_bus.h>
+#include <socketcan_interface/capture.h>
 
 CLASS_LOADER_REGISTER_CLASS(can::SocketCANInterface, can::DriverInterface);
+CLASS_LOADER_REGISTER_CLASS(can::SharedSocketCANInterface, can::DriverInterface);
+CLASS_LOADER_REGISTER_CLASS(can::VirtualInterface, can::DriverInterface);
+CLASS_LOADER_REGISTER_CLASS(can::ReplayInterface, can::DriverInterface);
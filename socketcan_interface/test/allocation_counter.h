@@ -0,0 +1,48 @@
+#ifndef SOCKETCAN_INTERFACE_TEST_ALLOCATION_COUNTER_H
+#define SOCKETCAN_INTERFACE_TEST_ALLOCATION_COUNTER_H
+
+// Replaces the global allocation functions to count heap allocations while the counter is armed.
+// Include it in exactly one translation unit of a test executable.
+
+#include <boost/atomic.hpp>
+#include <cstdlib>
+#include <new>
+
+boost::atomic<bool> g_count_allocations(false);
+boost::atomic<size_t> g_allocations(0);
+
+namespace{
+void* counted_malloc(size_t size){
+    if(g_count_allocations) ++g_allocations;
+    return malloc(size ? size : 1);
+}
+void* counted_new(size_t size){
+    void *p = counted_malloc(size);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+}
+
+void* operator new(size_t size){ return counted_new(size); }
+void* operator new[](size_t size){ return counted_new(size); }
+void* operator new(size_t size, const std::nothrow_t&) throw() { return counted_malloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) throw() { return counted_malloc(size); }
+
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+void operator delete(void *p, const std::nothrow_t&) throw() { free(p); }
+void operator delete[](void *p, const std::nothrow_t&) throw() { free(p); }
+#if __cpp_sized_deallocation
+void operator delete(void *p, size_t) throw() { free(p); }
+void operator delete[](void *p, size_t) throw() { free(p); }
+#endif
+
+/** counts the allocations during its lifetime */
+class AllocationCounter{
+public:
+    AllocationCounter() { g_allocations = 0; g_count_allocations = true; }
+    ~AllocationCounter() { g_count_allocations = false; }
+    size_t count() const { return g_allocations; }
+};
+
+#endif
@@ -0,0 +1,106 @@
+// Bring in my package's API, which is what I'm testing
+#include <socketcan_interface/capture.h>
+#include <boost/lexical_cast.hpp>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+class MapSettings : public can::Settings{
+public:
+    std::map<std::string, std::string> values;
+private:
+    virtual bool getRepr(const std::string &n, std::string & repr) const {
+        std::map<std::string, std::string>::const_iterator it = values.find(n);
+        if(it == values.end()) return false;
+        repr = it->second;
+        return true;
+    }
+};
+
+class CaptureTest : public ::testing::Test{
+public:
+    const std::string path;
+    std::vector<can::Frame> frames;
+    can::Frame::TimePoint start;
+    CaptureTest() : path("/tmp/socketcan_interface_test_capture_" + boost::lexical_cast<std::string>(getpid())) {}
+    ~CaptureTest() { unlink(path.c_str()); }
+
+    void record(size_t num, boost::uint32_t index_interval){
+        can::CaptureWriter writer(4096); // small chunks to test growing
+        ASSERT_TRUE(writer.open(path, index_interval));
+        start = can::Frame::TimePoint::clock::now();
+        for(size_t i = 0; i < num; ++i){
+            can::Frame f(i % 2 ? can::Header(can::ExtendedHeader(0x12345678)) : can::Header(can::MsgHeader(0x181)), 8);
+            if(i % 3 == 0){
+                f.is_fd = 1;
+                f.dlc = 64;
+            }
+            f.data.fill(0x55);
+            f.data[0] = i & 0xff;
+            f.stamp = start + boost::chrono::milliseconds(i);
+            ASSERT_TRUE(writer.write(f));
+            frames.push_back(f);
+        }
+        EXPECT_EQ(num, writer.getFrameCount());
+    }
+    void handle(const can::Frame &f){
+        frames.push_back(f);
+    }
+};
+
+TEST_F(CaptureTest, readBack)
+{
+    record(1000, 64);
+    can::CaptureReader reader;
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(1000u, reader.getFileHeader().frames);
+
+    can::Frame f;
+    for(size_t i = 0; i < frames.size(); ++i){
+        ASSERT_TRUE(reader.next(f));
+        EXPECT_EQ((unsigned int)frames[i], (unsigned int)f);
+        EXPECT_EQ(frames[i].dlc, f.dlc);
+        EXPECT_EQ(frames[i].is_fd, f.is_fd);
+        EXPECT_EQ(frames[i].data[0], f.data[0]);
+        EXPECT_EQ(frames[i].data[f.dlc-1], f.data[f.dlc-1]);
+        EXPECT_EQ(frames[i].stamp, f.stamp);
+    }
+    EXPECT_FALSE(reader.next(f));
+
+    reader.seek(start + boost::chrono::milliseconds(500));
+    ASSERT_TRUE(reader.next(f));
+    EXPECT_LE(f.stamp, start + boost::chrono::milliseconds(500));
+    EXPECT_GT(f.stamp, start + boost::chrono::milliseconds(500 - 64));
+}
+
+TEST_F(CaptureTest, replay)
+{
+    record(100, 16);
+    frames.clear();
+
+    can::ReplayInterface replay;
+    can::CommInterface::FrameListener::Ptr listener = replay.createMsgListener(can::CommInterface::FrameDelegate(this, &CaptureTest::handle));
+    EXPECT_FALSE(replay.init(path + ".missing", false));
+    ASSERT_TRUE(replay.init(path, false));
+    replay.run();
+    EXPECT_FALSE(replay.getState().isReady());
+    ASSERT_EQ(100u, frames.size());
+    EXPECT_EQ(99, frames.back().data[0]);
+    boost::chrono::milliseconds replay_time = boost::chrono::duration_cast<boost::chrono::milliseconds>(frames.back().stamp - frames.front().stamp);
+    EXPECT_GE(replay_time.count(), 98); // original timing
+
+    frames.clear();
+    MapSettings settings;
+    settings.values["speed"] = "0";
+    settings.values["start"] = "0.05";
+    ASSERT_TRUE(replay.init(path, false, settings));
+    replay.run();
+    ASSERT_EQ(50u, frames.size());
+    EXPECT_EQ(50, frames.front().data[0]);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+testing::InitGoogleTest(&argc, argv);
+return RUN_ALL_TESTS();
+}
@@ -0,0 +1,143 @@
+// Bring in my package's API, which is what I'm testing
+#include <socketcan_interface/delegates.h>
+#include <socketcan_interface/interface.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "allocation_counter.h"
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+struct Base{
+    int sum;
+    Base() : sum(0) {}
+    void add(int i) { sum += i; }
+    int get() const { return sum; }
+    int scaled(int a, int b) const { return sum * a + b; }
+};
+struct Derived : Base {};
+
+static int g_sum = 0;
+void addGlobal(int i) { g_sum += i; }
+
+struct SmallFunctor{
+    int *target;
+    int *other;
+    int factor;
+    void operator()(int i) const { *target += i * factor; }
+};
+
+struct LargeFunctor{
+    boost::shared_ptr<int> target;
+    int padding[16];
+    void operator()(int i) const { *target += i; }
+};
+
+TEST(DelegateTest, memberFunctions)
+{
+    Derived d;
+    can::Delegate1<int> add(&d, &Base::add);
+    add(2);
+    add(3);
+    EXPECT_EQ(5, d.sum);
+
+    const Derived &c = d;
+    can::Delegate0<int> get(&c, &Base::get);
+    EXPECT_EQ(5, get());
+
+    can::Delegate2<int, int, int> scaled(&d, &Base::scaled); // const member of a non-const object
+    EXPECT_EQ(12, scaled(2, 2));
+}
+
+TEST(DelegateTest, emptyAndFunctions)
+{
+    can::Delegate1<int> empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_FALSE(empty);
+    EXPECT_TRUE(!empty);
+
+    can::Delegate1<int> null(0);
+    EXPECT_TRUE(null.empty());
+
+    can::Delegate1<int> f(&addGlobal);
+    ASSERT_TRUE(f);
+    f(4);
+    EXPECT_EQ(4, g_sum);
+
+    can::Delegate1<int> copy(f);
+    f.clear();
+    EXPECT_TRUE(f.empty());
+    copy(1);
+    EXPECT_EQ(5, g_sum);
+
+    f = copy;
+    f(1);
+    EXPECT_EQ(6, g_sum);
+}
+
+TEST(DelegateTest, smallCallablesAreStoredInline)
+{
+    Base b;
+    int target = 0;
+    SmallFunctor small = { &target, 0, 3 };
+
+    AllocationCounter counter;
+    can::Delegate1<int> member(&b, &Base::add);
+    can::Delegate1<int> functor(small);
+    can::Delegate1<int> bound(boost::bind(&Base::add, &b, _1));
+    can::Delegate1<int> copy(bound);
+    member = functor;
+    member(1);
+    functor(1);
+    bound(2);
+    copy(2);
+    EXPECT_EQ(0u, counter.count());
+
+    EXPECT_EQ(6, target);
+    EXPECT_EQ(4, b.sum);
+}
+
+TEST(DelegateTest, largeCallablesAreCopied)
+{
+    LargeFunctor large;
+    large.target.reset(new int(0));
+    {
+        can::Delegate1<int> d(large);
+        EXPECT_EQ(2, large.target.use_count());
+        can::Delegate1<int> copy(d);
+        EXPECT_EQ(3, large.target.use_count());
+        d.clear();
+        EXPECT_EQ(2, large.target.use_count());
+        copy(7);
+        d = copy;
+        d(1);
+        EXPECT_EQ(3, large.target.use_count());
+    }
+    EXPECT_EQ(1, large.target.use_count());
+    EXPECT_EQ(8, *large.target);
+}
+
+#if __cplusplus >= 201103L
+TEST(DelegateTest, lambdas)
+{
+    int count = 0;
+    can::Frame last;
+    AllocationCounter counter;
+    can::CommInterface::FrameDelegate d = [&count, &last](const can::Frame &f){ ++count; last = f; };
+    d(can::Frame(can::MsgHeader(0x181), 2));
+    EXPECT_EQ(0u, counter.count());
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(0x181u, last.id);
+
+    can::Delegate0<bool> b = [&count]{ return count > 0; };
+    EXPECT_TRUE(b());
+}
+#endif
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
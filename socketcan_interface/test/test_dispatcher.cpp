@@ -0,0 +1,235 @@
+// Bring in my package's API, which is what I'm testing
+#include <socketcan_interface/dispatcher.h>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+typedef can::TableDispatcher<can::CommInterface::FrameListener> FrameDispatcher;
+typedef can::SimpleDispatcher<can::StateInterface::StateListener> StateDispatcher;
+
+struct FrameCounter{
+    boost::atomic<size_t> num;
+    FrameCounter() : num(0) {}
+    void count(const can::Frame &f) { ++num; }
+    can::CommInterface::FrameDelegate delegate() { return can::CommInterface::FrameDelegate(this, &FrameCounter::count); }
+};
+
+struct StateCounter{
+    boost::atomic<size_t> num;
+    StateCounter() : num(0) {}
+    void count(const can::State &s) { ++num; }
+    can::StateInterface::StateDelegate delegate() { return can::StateInterface::StateDelegate(this, &StateCounter::count); }
+};
+
+struct OrderRecorder{
+    std::vector<int> calls;
+    void first(const can::Frame &f) { calls.push_back(1); }
+    void second(const can::Frame &f) { calls.push_back(2); }
+    void third(const can::Frame &f) { calls.push_back(3); }
+};
+
+TEST(DispatcherTest, tableListenersKeepOrderOnRemoval)
+{
+    FrameDispatcher dispatcher;
+    OrderRecorder rec;
+    can::Frame frame(can::MsgHeader(0x181));
+    can::CommInterface::FrameListener::Ptr l1 = dispatcher.createListener(frame, can::CommInterface::FrameDelegate(&rec, &OrderRecorder::first));
+    can::CommInterface::FrameListener::Ptr l2 = dispatcher.createListener(frame, can::CommInterface::FrameDelegate(&rec, &OrderRecorder::second));
+    can::CommInterface::FrameListener::Ptr l3 = dispatcher.createListener(frame, can::CommInterface::FrameDelegate(&rec, &OrderRecorder::third));
+    EXPECT_EQ(3u, dispatcher.numListeners());
+
+    l2.reset();
+    dispatcher.dispatch(frame);
+    l1.reset();
+    dispatcher.dispatch(frame);
+    l2 = dispatcher.createListener(frame, can::CommInterface::FrameDelegate(&rec, &OrderRecorder::second));
+    dispatcher.dispatch(frame);
+    l3.reset();
+    dispatcher.dispatch(frame);
+
+    int expected[] = { 1, 3, 3, 3, 2, 2 };
+    EXPECT_EQ(std::vector<int>(expected, expected + sizeof(expected)/sizeof(expected[0])), rec.calls);
+    EXPECT_EQ(1u, dispatcher.numListeners());
+}
+
+TEST(DispatcherTest, extendedKeysGetRemoved)
+{
+    FrameDispatcher dispatcher;
+    FrameCounter counter;
+    can::Header ext(0x1234567, true, false, false);
+    can::CommInterface::FrameListener::Ptr l1 = dispatcher.createListener(ext, counter.delegate());
+    can::CommInterface::FrameListener::Ptr l2 = dispatcher.createListener(ext, counter.delegate());
+
+    std::vector<unsigned int> keys;
+    EXPECT_TRUE(dispatcher.getKeys(keys));
+    ASSERT_EQ(1u, keys.size());
+    EXPECT_EQ(unsigned(ext), keys[0]);
+
+    dispatcher.dispatch(can::Frame(ext));
+    EXPECT_EQ(2u, counter.num);
+
+    l1.reset();
+    l2.reset();
+    keys.clear();
+    EXPECT_TRUE(dispatcher.getKeys(keys));
+    EXPECT_TRUE(keys.empty());
+    EXPECT_FALSE(dispatcher.hasListeners(ext));
+    dispatcher.dispatch(can::Frame(ext));
+    EXPECT_EQ(2u, counter.num);
+}
+
+TEST(DispatcherTest, listenersMayOutliveDispatcher)
+{
+    FrameCounter counter;
+    StateCounter states;
+    can::CommInterface::FrameListener::Ptr frame_listener;
+    can::StateInterface::StateListener::Ptr state_listener;
+    {
+        FrameDispatcher frames;
+        StateDispatcher dispatcher;
+        frame_listener = frames.createListener(can::MsgHeader(0x181), counter.delegate());
+        state_listener = dispatcher.createListener(states.delegate());
+    }
+    frame_listener.reset();
+    state_listener.reset();
+}
+
+template<typename Dispatcher, typename Counter, typename Key> void churn(Dispatcher &dispatcher, Counter &counter, const Key &key, boost::atomic<bool> &running){
+    while(running){
+        typename Dispatcher::Callable callable = counter.delegate();
+        typename Dispatcher::Callable other = counter.delegate();
+        boost::shared_ptr<const void> l1 = dispatcher.createListener(key, callable);
+        boost::shared_ptr<const void> l2 = dispatcher.createListener(other);
+        boost::shared_ptr<const void> l3 = dispatcher.createListener(key, callable);
+        l1.reset(); // remove from the front
+        l3.reset(); // and from the back
+    }
+}
+
+template<typename Dispatcher, typename Counter> void churnAll(Dispatcher &dispatcher, Counter &counter, boost::atomic<bool> &running){
+    while(running){
+        boost::shared_ptr<const void> l1 = dispatcher.createListener(counter.delegate());
+        boost::shared_ptr<const void> l2 = dispatcher.createListener(counter.delegate());
+        l1.reset();
+    }
+}
+
+TEST(DispatcherTest, tableAddRemoveDuringDispatch)
+{
+    FrameDispatcher dispatcher;
+    FrameCounter permanent, churned;
+    can::Frame std_frame(can::MsgHeader(0x181));
+    can::Frame ext_frame(can::Header(0x1234567, true, false, false));
+    can::CommInterface::FrameListener::Ptr l1 = dispatcher.createListener(std_frame, permanent.delegate());
+    can::CommInterface::FrameListener::Ptr l2 = dispatcher.createListener(ext_frame, permanent.delegate());
+
+    boost::atomic<bool> running(true);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&churn<FrameDispatcher, FrameCounter, unsigned int>, boost::ref(dispatcher), boost::ref(churned), (unsigned int)std_frame, boost::ref(running)));
+    threads.create_thread(boost::bind(&churn<FrameDispatcher, FrameCounter, unsigned int>, boost::ref(dispatcher), boost::ref(churned), (unsigned int)ext_frame, boost::ref(running)));
+
+    const size_t num = 200000;
+    for(size_t i = 0; i < num; ++i){
+        dispatcher.dispatch(i % 2 ? ext_frame : std_frame);
+    }
+    running = false;
+    threads.join_all();
+
+    EXPECT_EQ(num, permanent.num); // no listener got skipped while others were unlinked
+    EXPECT_EQ(2u, dispatcher.numListeners());
+}
+
+class BlockingListener{
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    bool entered_, released_;
+public:
+    BlockingListener() : entered_(false), released_(false) {}
+    void handle(const can::Frame &f){
+        boost::mutex::scoped_lock lock(mutex_);
+        entered_ = true;
+        cond_.notify_all();
+        while(!released_) cond_.wait(lock);
+    }
+    bool waitEntered(){
+        boost::mutex::scoped_lock lock(mutex_);
+        boost::chrono::steady_clock::time_point abs_time = boost::chrono::steady_clock::now() + boost::chrono::seconds(1);
+        while(!entered_){
+            if(cond_.wait_until(lock, abs_time) == boost::cv_status::timeout) break;
+        }
+        return entered_;
+    }
+    void release(){
+        boost::mutex::scoped_lock lock(mutex_);
+        released_ = true;
+        cond_.notify_all();
+    }
+    can::CommInterface::FrameDelegate delegate() { return can::CommInterface::FrameDelegate(this, &BlockingListener::handle); }
+};
+
+void resetListener(can::CommInterface::FrameListener::Ptr &l){
+    l.reset();
+}
+
+TEST(DispatcherTest, removeWaitsOnlyForEarlierReaders)
+{
+    FrameDispatcher dispatcher;
+    BlockingListener before, after;
+    FrameCounter counter;
+    can::Frame frame_before(can::MsgHeader(0x181)), frame_after(can::MsgHeader(0x182));
+    can::CommInterface::FrameListener::Ptr l1 = dispatcher.createListener(frame_before, before.delegate());
+    can::CommInterface::FrameListener::Ptr l2 = dispatcher.createListener(frame_after, after.delegate());
+    can::CommInterface::FrameListener::Ptr removed = dispatcher.createListener(can::MsgHeader(0x183), counter.delegate());
+
+    boost::thread reader_before(boost::bind(&FrameDispatcher::dispatch, &dispatcher, frame_before));
+    ASSERT_TRUE(before.waitEntered());
+
+    boost::thread writer(boost::bind(&resetListener, boost::ref(removed))); // has to wait for reader_before
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    boost::thread reader_after(boost::bind(&FrameDispatcher::dispatch, &dispatcher, frame_after));
+    EXPECT_TRUE(after.waitEntered());
+    EXPECT_FALSE(writer.try_join_for(boost::chrono::milliseconds(10)));
+
+    before.release();
+    EXPECT_TRUE(writer.try_join_for(boost::chrono::seconds(1))); // while reader_after is still in dispatch
+
+    after.release();
+    reader_before.join();
+    reader_after.join();
+    writer.join();
+    EXPECT_EQ(2u, dispatcher.numListeners());
+}
+
+TEST(DispatcherTest, simpleAddRemoveDuringDispatch)
+{
+    StateDispatcher dispatcher;
+    StateCounter permanent, churned;
+    can::StateInterface::StateListener::Ptr l = dispatcher.createListener(permanent.delegate());
+
+    boost::atomic<bool> running(true);
+    boost::thread_group threads;
+    for(int i = 0; i < 2; ++i){
+        threads.create_thread(boost::bind(&churnAll<StateDispatcher, StateCounter>, boost::ref(dispatcher), boost::ref(churned), boost::ref(running)));
+    }
+
+    const size_t num = 100000;
+    can::State s;
+    for(size_t i = 0; i < num; ++i){
+        dispatcher.dispatch(s);
+    }
+    running = false;
+    threads.join_all();
+
+    EXPECT_EQ(num, permanent.num);
+    EXPECT_EQ(1u, dispatcher.numListeners());
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
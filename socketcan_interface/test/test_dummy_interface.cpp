@@ -1,18 +1,35 @@
 // Bring in my package's API, which is what I'm testing
 #include <socketcan_interface/dispatcher.h>
 #include <socketcan_interface/dummy.h>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 // Bring in gtest
 #include <gtest/gtest.h>
 
 class DummyInterfaceTest : public ::testing::Test{
 public:
+    boost::mutex mutex; // delayed responses arrive on the worker thread
+    boost::condition_variable cond;
     std::list<std::string> responses;
     can::DummyInterface dummy;
     DummyInterfaceTest() : dummy(true), listener(dummy.createMsgListener(can::CommInterface::FrameDelegate(this, &DummyInterfaceTest::handle ))) { }
 
    void handle(const can::Frame &f){
-        responses.push_back(can::tostring(f, true));
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            responses.push_back(can::tostring(f, true));
+        }
+        cond.notify_all();
+    }
+    /** @return false if less than num responses were received within the timeout */
+    bool waitForResponses(size_t num, const boost::chrono::milliseconds &timeout){
+        boost::mutex::scoped_lock lock(mutex);
+        boost::chrono::steady_clock::time_point abs_time = boost::chrono::steady_clock::now() + timeout;
+        while(responses.size() < num){
+            if(cond.wait_until(lock, abs_time) == boost::cv_status::timeout) return responses.size() >= num;
+        }
+        return true;
     }
     can::CommInterface::FrameListener::Ptr listener;
 };
@@ -31,6 +48,128 @@ TEST_F(DummyInterfaceTest, testCase1)
     EXPECT_EQ(expected, responses);
 }
 
+TEST_F(DummyInterfaceTest, patterns)
+{
+    EXPECT_TRUE(dummy.add("601#4000100000000000", "581#4300100092010000", false));
+    EXPECT_FALSE(dummy.add("601#4000100000000000", "581#00", false));
+    EXPECT_TRUE(dummy.add("601#40xxxx??00000000", "581#8000000000000206", false)); // any other object
+    EXPECT_TRUE(dummy.add("181#102", "281#00", false)); // first byte unpadded, like tostring
+
+    std::list<std::string> expected;
+
+    dummy.send(can::toframe("601#4000100000000000"));
+    expected.push_back("601#4000100000000000");
+    expected.push_back("581#4300100092010000");
+    dummy.send(can::toframe("601#4017100000000000"));
+    expected.push_back("601#4017100000000000");
+    expected.push_back("581#8000000000000206");
+    dummy.send(can::toframe("601#2317100000000000"));
+    expected.push_back("601#2317100000000000");
+    dummy.send(can::toframe("181#0102"));
+    expected.push_back("181#102");
+    expected.push_back("281#00");
+
+    EXPECT_EQ(expected, responses);
+}
+
+TEST_F(DummyInterfaceTest, sequence)
+{
+    can::DummyInterface::Exchange &e = dummy.expect("0#8101");
+    e.respond("701#00").respond("701#7f").step().respond("701#05").step();
+
+    std::list<std::string> expected;
+    for(int i = 0; i < 3; ++i) dummy.send(can::toframe("0#8101"));
+    expected.push_back("0#8101");
+    expected.push_back("701#00");
+    expected.push_back("701#7f");
+    expected.push_back("0#8101");
+    expected.push_back("701#05");
+    expected.push_back("0#8101"); // empty step
+    EXPECT_EQ(expected, responses);
+    EXPECT_EQ(3u, e.count());
+
+    dummy.rewind();
+    responses.clear();
+    e.cyclic = true;
+    dummy.send(can::toframe("0#8101"));
+    EXPECT_EQ(3u, responses.size());
+    EXPECT_EQ(1u, e.count());
+}
+
+TEST_F(DummyInterfaceTest, delay)
+{
+    dummy.expect("80#").respond("181#11", boost::chrono::milliseconds(20)).respond("182#22");
+    can::Frame::TimePoint start = can::Frame::TimePoint::clock::now();
+    dummy.send(can::toframe("80#"));
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        EXPECT_EQ(2u, responses.size()); // request and the immediate response
+    }
+
+    ASSERT_TRUE(waitForResponses(3, boost::chrono::seconds(1)));
+    EXPECT_GE(can::Frame::TimePoint::clock::now() - start, boost::chrono::milliseconds(20));
+    boost::mutex::scoped_lock lock(mutex);
+    EXPECT_EQ(3u, responses.size());
+    EXPECT_EQ("181#11", responses.back());
+}
+
+TEST(StringTest, canFDNotation)
+{
+    can::Frame f = can::toframe("123##1" + std::string(22, 'a'));
+    EXPECT_TRUE(f.isValid());
+    EXPECT_TRUE(f.is_fd);
+    EXPECT_TRUE(f.brs);
+    EXPECT_EQ(12, f.dlc); // padded to the next valid length
+    EXPECT_EQ(0xaa, f.data[10]);
+    EXPECT_EQ(0, f.data[11]);
+
+    EXPECT_EQ("123##1" + std::string(22, 'a') + "00" , can::tostring(f, true));
+    EXPECT_EQ("123##0ff", can::tostring(can::toframe("123##0ff"), true));
+    EXPECT_EQ("123#ff", can::tostring(can::toframe("123#ff"), true));
+
+    EXPECT_FALSE(can::toframe("123#" + std::string(18, '0')).isValid());
+    EXPECT_TRUE(can::toframe("123##0" + std::string(128, '0')).isValid());
+    EXPECT_FALSE(can::toframe("123##0" + std::string(130, '0')).isValid());
+
+    EXPECT_EQ(64, can::dlc2len(15));
+    EXPECT_EQ(9, can::len2dlc(9));
+    EXPECT_EQ(13, can::len2dlc(25));
+}
+
+TEST(StringTest, bufferCodec)
+{
+    char buf[can::FRAME_STRING_LEN + 1];
+    can::Frame f = can::toframe("181#0102aB");
+    ASSERT_TRUE(f.isValid());
+    EXPECT_EQ(3, f.dlc);
+    EXPECT_EQ(0xab, f.data[2]);
+
+    EXPECT_EQ(9u, can::tostring(buf, f, true));
+    EXPECT_STREQ("181#102ab", buf); // first byte is not padded
+    EXPECT_EQ(can::tostring(f, false), std::string(buf, can::tostring(buf, f, false)));
+
+    EXPECT_EQ(3u, can::tostring(buf, can::Header(can::MsgHeader(0x7ff)), false));
+    EXPECT_STREQ("7FF", buf);
+    EXPECT_EQ(8u, can::tostring(buf, can::Header(can::ExtendedHeader(0x1fffffff)), true));
+    EXPECT_STREQ("9fffffff", buf);
+
+    f = can::toframe("0x12#");
+    EXPECT_EQ(0x12u, f.id);
+    EXPECT_FALSE(can::toframe("12345#").isValid());
+    EXPECT_EQ(0, can::toframe("123#123").dlc);
+    EXPECT_EQ(0, can::toframe("123#1x").dlc);
+
+    can::Frame fd(can::MsgHeader(0x123), 64);
+    fd.is_fd = 1;
+    fd.brs = 1;
+    fd.data.fill(0xff);
+    size_t len = can::tostring(buf, fd, true);
+    EXPECT_EQ(can::FRAME_STRING_LEN - 5, len); // three header digits
+    can::Frame back = can::toframe(buf, len);
+    EXPECT_TRUE(back.is_fd && back.brs);
+    EXPECT_EQ(64, back.dlc);
+    EXPECT_EQ(0xff, back.data[63]);
+}
 
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv){
@@ -0,0 +1,719 @@
+// Bring in my package's API, which is what I'm testing
+#include <socketcan_interface/socketcan.h>
+#include <socketcan_interface/threading.h>
+#include <socketcan_interface/string.h>
+#include <socketcan_interface/thread_config.h>
+#include <socketcan_interface/statistics.h>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <map>
+#include <unistd.h>
+
+#include "allocation_counter.h"
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+// SocketCANInterface on one end of a datagram socket pair, so no CAN device is needed
+class PairedInterface : public can::SocketCANInterface{
+    boost::thread thread_;
+    boost::mutex filter_mutex;
+public:
+    int peer;
+    PairedInterface(const can::Reactor::Ptr &reactor = can::Reactor::Ptr()) : can::SocketCANInterface(32, 32, reactor), peer(-1), filtered(false) {}
+    bool open(bool stamped = false){
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0) return false;
+        peer = sv[1];
+        if(stamped){
+            int enable = 1;
+            if(setsockopt(sv[0], SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0) return false;
+            timestamps_ = software_timestamps;
+        }
+        boost::system::error_code ec;
+        socket_.assign(sv[0], ec);
+        if(ec) return false;
+        setDriverState(can::State::open);
+        thread_ = boost::thread(&PairedInterface::run, this);
+        return can::StateWaiter::wait_for(can::State::ready, this, boost::posix_time::seconds(1));
+    }
+    bool write(const can_frame &frame){
+        return ::write(peer, &frame, sizeof(frame)) == sizeof(frame);
+    }
+    bool write(const canfd_frame &frame){
+        return ::write(peer, &frame, sizeof(frame)) == sizeof(frame);
+    }
+    void enableFD() { fd_ = true; }
+    void enableRecovery(const boost::posix_time::time_duration &min_delay, const boost::posix_time::time_duration &max_delay){
+        recovery_ = true;
+        recovery_min_delay_ = min_delay;
+        recovery_max_delay_ = max_delay;
+    }
+    bool limitSendBuffer(){
+        int size = 4096; // kernel minimum, only a few frames fit
+        return setsockopt(socket_.native_handle(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0;
+    }
+    can::TxQueue& txQueue() { return tx_queue_; }
+    bool filtered;
+    std::vector<struct can_filter> filters(){
+        boost::mutex::scoped_lock lock(filter_mutex);
+        return filters_;
+    }
+    virtual void listenersChanged(){ // CAN_RAW_FILTER cannot be set on the socket pair
+        boost::mutex::scoped_lock lock(filter_mutex);
+        filtered = buildFilters();
+    }
+    virtual ~PairedInterface(){
+        shutdown();
+        if(thread_.joinable()) thread_.join();
+        if(peer >= 0) close(peer);
+    }
+};
+
+class SocketCANTest : public ::testing::Test{
+public:
+    PairedInterface driver;
+    boost::atomic<size_t> received;
+    boost::mutex blocker;
+    can::Frame last;
+    SocketCANTest() : received(0), listener(driver.createMsgListener(can::CommInterface::FrameDelegate(this, &SocketCANTest::handle))) {}
+
+    void handle(const can::Frame &f){
+        boost::mutex::scoped_lock lock(blocker);
+        last = f;
+        ++received;
+    }
+    bool send(size_t num){
+        can_frame frame = {0};
+        frame.can_dlc = 8;
+        for(size_t i = 0; i < num; ++i){
+            frame.can_id = 0x181 + (i % 8);
+            if(!driver.write(frame)) return false;
+        }
+        return true;
+    }
+    bool wait(size_t num){
+        for(int i = 0; i < 10000 && received < num; ++i) usleep(1000);
+        return received >= num;
+    }
+    can::CommInterface::FrameListener::Ptr listener;
+};
+
+TEST_F(SocketCANTest, noAllocationPerFrame)
+{
+    ASSERT_TRUE(driver.open());
+
+    ASSERT_TRUE(send(100)); // warm up
+    ASSERT_TRUE(wait(100));
+
+    bool ok;
+    size_t allocations;
+    {
+        AllocationCounter counter;
+        ok = send(10000) && wait(10100);
+        allocations = counter.count();
+    }
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(0u, allocations);
+    EXPECT_EQ(0u, driver.getState().rx_overruns);
+}
+
+TEST_F(SocketCANTest, overrunsGetCounted)
+{
+    ASSERT_TRUE(driver.open());
+    {
+        boost::mutex::scoped_lock lock(blocker); // stall dispatching, reader keeps draining the socket
+        ASSERT_TRUE(send(2000));
+        for(int i = 0; i < 10000 && driver.getState().rx_overruns + 1024 < 2000 - 1; ++i) usleep(1000);
+    }
+    can::State s = driver.getState();
+    EXPECT_GT(s.rx_overruns, 0u);
+    EXPECT_TRUE(wait(2000 - s.rx_overruns));
+    EXPECT_TRUE(s.isReady());
+}
+
+TEST_F(SocketCANTest, invalidLengthsGetSkipped)
+{
+    ASSERT_TRUE(driver.open());
+    can_frame frame = {0};
+    frame.can_id = 0x181;
+    frame.can_dlc = 8;
+    ASSERT_EQ(10, ::write(driver.peer, &frame, 10));
+    frame.can_id = 0x182;
+    ASSERT_TRUE(driver.write(frame));
+    ASSERT_TRUE(wait(1));
+
+    usleep(10000);
+    EXPECT_EQ(1u, received);
+    EXPECT_EQ(0x182u, last.id);
+    can::Statistics stats;
+    ASSERT_TRUE(driver.getStatistics(stats));
+    EXPECT_EQ(1u, stats.rx_invalid);
+    EXPECT_EQ(1u, stats.rx_frames);
+}
+
+TEST_F(SocketCANTest, receptionTimestamps)
+{
+    ASSERT_TRUE(driver.open(true));
+
+    can::Frame::TimePoint before = can::Frame::TimePoint::clock::now();
+    ASSERT_TRUE(send(1));
+    ASSERT_TRUE(wait(1));
+
+    boost::mutex::scoped_lock lock(blocker);
+    EXPECT_NE(can::Frame::TimePoint(), last.stamp);
+    EXPECT_LE(before - boost::chrono::milliseconds(1), last.stamp); // allow for clock sampling jitter
+    EXPECT_GE(can::Frame::TimePoint::clock::now(), last.stamp);
+}
+
+TEST_F(SocketCANTest, filtersFollowListeners)
+{
+    EXPECT_FALSE(driver.filtered); // fixture listener is catch-all
+    listener.reset();
+
+    EXPECT_TRUE(driver.filtered);
+    EXPECT_EQ(0u, driver.filters().size());
+
+    can::CommInterface::FrameListener::Ptr std_listener = driver.createMsgListener(can::MsgHeader(0x181), can::CommInterface::FrameDelegate(this, &SocketCANTest::handle));
+    can::CommInterface::FrameListener::Ptr ext_listener = driver.createMsgListener(can::ExtendedHeader(0x12345), can::CommInterface::FrameDelegate(this, &SocketCANTest::handle));
+    can::CommInterface::FrameListener::Ptr err_listener = driver.createMsgListener(can::ErrorHeader(), can::CommInterface::FrameDelegate(this, &SocketCANTest::handle));
+
+    std::vector<struct can_filter> filters = driver.filters();
+    ASSERT_EQ(2u, filters.size());
+    EXPECT_EQ(0x181u, filters[0].can_id);
+    EXPECT_EQ(CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG, filters[0].can_mask);
+    EXPECT_EQ(0x12345u | CAN_EFF_FLAG, filters[1].can_id);
+    EXPECT_EQ(CAN_EFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG, filters[1].can_mask);
+
+    can::CommInterface::FrameListener::Ptr all_listener = driver.createMsgListener(can::CommInterface::FrameDelegate(this, &SocketCANTest::handle));
+    EXPECT_FALSE(driver.filtered);
+
+    all_listener.reset();
+    std_listener.reset();
+    EXPECT_TRUE(driver.filtered);
+    EXPECT_EQ(1u, driver.filters().size());
+}
+
+TEST_F(SocketCANTest, canFDFrames)
+{
+    ASSERT_TRUE(driver.open());
+
+    canfd_frame frame = {0};
+    frame.can_id = 0x181;
+    frame.len = 64;
+    frame.flags = CANFD_BRS;
+    frame.data[63] = 0x42;
+    ASSERT_TRUE(driver.write(frame));
+    ASSERT_TRUE(wait(1));
+    {
+        boost::mutex::scoped_lock lock(blocker);
+        EXPECT_TRUE(last.is_fd);
+        EXPECT_TRUE(last.brs);
+        EXPECT_EQ(64, last.dlc);
+        EXPECT_EQ(0x42, last.data[63]);
+    }
+
+    can::Frame fd = can::toframe("201##1" + std::string(32, '1'));
+    EXPECT_FALSE(driver.send(fd)); // not enabled
+    driver.enableFD();
+    ASSERT_TRUE(driver.send(fd));
+    ASSERT_TRUE(driver.send(can::toframe("202#11")));
+
+    canfd_frame out;
+    ASSERT_EQ(CANFD_MTU, read(driver.peer, &out, sizeof(out)));
+    EXPECT_EQ(0x201u, out.can_id);
+    EXPECT_EQ(16, out.len);
+    EXPECT_EQ(CANFD_BRS, out.flags);
+    EXPECT_EQ(0x11, out.data[15]);
+
+    ASSERT_EQ(CAN_MTU, read(driver.peer, &out, sizeof(out)));
+    EXPECT_EQ(0x202u, out.can_id);
+}
+
+class LatencyHistogram{
+public:
+    static const size_t NUM_BUCKETS = 6;
+    static unsigned int limit_us(size_t i) { static const unsigned int limits[NUM_BUCKETS-1] = {100, 1000, 5000, 10000, 20000}; return limits[i]; }
+    boost::atomic<size_t> buckets[NUM_BUCKETS];
+    boost::atomic<size_t> count;
+    LatencyHistogram() : count(0) { for(size_t i = 0; i < NUM_BUCKETS; ++i) buckets[i] = 0; }
+    void handle(const can::Frame &f){
+        boost::chrono::microseconds latency = boost::chrono::duration_cast<boost::chrono::microseconds>(can::Frame::TimePoint::clock::now() - f.stamp);
+        size_t i = 0;
+        while(i < NUM_BUCKETS-1 && latency.count() >= limit_us(i)) ++i;
+        ++buckets[i];
+        ++count;
+    }
+    void print(){
+        for(size_t i = 0; i < NUM_BUCKETS; ++i){
+            if(i < NUM_BUCKETS-1) std::cout << "< " << limit_us(i) << " us: ";
+            else std::cout << ">= " << limit_us(i-1) << " us: ";
+            std::cout << buckets[i] << std::endl;
+        }
+    }
+};
+
+struct SlowListener{
+    boost::atomic<size_t> count;
+    SlowListener() : count(0) {}
+    void handle(const can::Frame &f){
+        usleep(20000);
+        ++count;
+    }
+};
+
+TEST_F(SocketCANTest, backgroundListenersDoNotDelayRealtime)
+{
+    ASSERT_TRUE(driver.open(true));
+    listener.reset();
+
+    LatencyHistogram histogram;
+    SlowListener slow;
+    can::CommInterface::FrameListener::Ptr rt_listener = driver.createMsgListener(can::MsgHeader(0x181), can::CommInterface::FrameDelegate(&histogram, &LatencyHistogram::handle));
+    can::CommInterface::FrameListener::Ptr bg_listener = driver.createMsgListener(can::MsgHeader(0x581), can::CommInterface::FrameDelegate(&slow, &SlowListener::handle), can::background_dispatch);
+
+    can_frame pdo = {0}, sdo = {0};
+    pdo.can_id = 0x181;
+    pdo.can_dlc = 8;
+    sdo.can_id = 0x581;
+    sdo.can_dlc = 8;
+    for(size_t i = 0; i < 200; ++i){
+        if((i % 10) == 0){
+            ASSERT_TRUE(driver.write(sdo));
+        }
+        ASSERT_TRUE(driver.write(pdo));
+        usleep(500);
+    }
+    for(int i = 0; i < 10000 && (histogram.count < 200 || slow.count < 20); ++i) usleep(1000);
+    ASSERT_EQ(200u, histogram.count);
+    EXPECT_EQ(20u, slow.count);
+
+    histogram.print();
+    EXPECT_EQ(0u, histogram.buckets[LatencyHistogram::NUM_BUCKETS-1]); // never waited for the slow listener
+}
+
+TEST_F(SocketCANTest, statisticsCountFrames)
+{
+    ASSERT_TRUE(driver.open());
+
+    ASSERT_TRUE(send(100));
+    ASSERT_TRUE(wait(100));
+    EXPECT_TRUE(driver.send(can::Frame(can::MsgHeader(0x201), 2)));
+
+    can_frame error = {0};
+    error.can_id = CAN_ERR_FLAG | CAN_ERR_BUSOFF;
+    ASSERT_TRUE(driver.write(error));
+    ASSERT_TRUE(wait(101));
+
+    can::Statistics stats;
+    ASSERT_TRUE(driver.getStatistics(stats));
+    EXPECT_EQ(100u, stats.rx_frames);
+    EXPECT_EQ(800u, stats.rx_bytes);
+    EXPECT_EQ(1u, stats.tx_frames);
+    EXPECT_EQ(2u, stats.tx_bytes);
+    EXPECT_EQ(0u, stats.tx_failures);
+    EXPECT_EQ(1u, stats.error_frames);
+    EXPECT_EQ(1u, stats.error_classes[6]); // CAN_ERR_BUSOFF
+    EXPECT_GE(stats.max_queue_depth, 1u);
+    EXPECT_EQ(0u, stats.bitrate);
+    EXPECT_EQ(0, stats.bus_load);
+}
+
+TEST_F(SocketCANTest, syncOvertakesQueuedSDOs)
+{
+    ASSERT_TRUE(driver.open());
+    ASSERT_TRUE(driver.limitSendBuffer()); // peer does not read yet, so the socket blocks soon
+    driver.txQueue().configure(can::tx_sync, 2, can::TxQueue::drop);
+
+    can::Frame sdo(can::MsgHeader(0x601), 8);
+    for(int i = 0; i < 100; ++i) ASSERT_TRUE(driver.send(sdo));
+
+    can::Statistics stats;
+    ASSERT_TRUE(driver.getStatistics(stats));
+    size_t queued = stats.tx_queue_depth[can::tx_sdo];
+    ASSERT_GT(queued, 0u);
+
+    for(int i = 0; i < 5; ++i){
+        EXPECT_EQ(i < 2, driver.send(can::Frame(can::MsgHeader(0x80))));
+    }
+
+    struct timeval timeout = {1, 0};
+    ASSERT_EQ(0, setsockopt(driver.peer, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+    std::vector<canid_t> ids;
+    for(int i = 0; i < 102; ++i){
+        canfd_frame frame;
+        ASSERT_EQ(CAN_MTU, read(driver.peer, &frame, sizeof(frame)));
+        ids.push_back(frame.can_id);
+    }
+    size_t first_sync = std::find(ids.begin(), ids.end(), 0x80) - ids.begin();
+    EXPECT_EQ(100 - queued, first_sync); // only frames that were handed to the kernel before
+    ASSERT_LT(first_sync + 1, ids.size());
+    EXPECT_EQ(0x80u, ids[first_sync + 1]);
+    EXPECT_EQ(2, std::count(ids.begin(), ids.end(), 0x80));
+
+    ASSERT_TRUE(driver.getStatistics(stats));
+    EXPECT_EQ(3u, stats.tx_dropped[can::tx_sync]);
+    EXPECT_EQ(3u, stats.tx_failures);
+    EXPECT_EQ(102u, stats.tx_frames);
+    EXPECT_EQ(2u, stats.max_tx_queue_depth[can::tx_sync]);
+    for(int i = 0; i < 1000 && !driver.txQueue().empty(); ++i) usleep(1000);
+    EXPECT_TRUE(driver.txQueue().empty());
+}
+
+TEST_F(SocketCANTest, sendErrorDiscardsFrames)
+{
+    ASSERT_TRUE(driver.open());
+    close(driver.peer); // sending fails now
+    driver.peer = -1;
+
+    EXPECT_FALSE(driver.send(can::Frame(can::MsgHeader(0x201), 2)));
+    EXPECT_EQ(can::State::open, driver.getState().driver_state);
+    EXPECT_TRUE(driver.txQueue().empty());
+
+    can::Statistics stats;
+    ASSERT_TRUE(driver.getStatistics(stats));
+    EXPECT_EQ(1u, stats.tx_failures); // counted once
+    EXPECT_EQ(0u, stats.tx_frames);
+}
+
+TEST_F(SocketCANTest, sendErrorDiscardsQueuedFrames)
+{
+    ASSERT_TRUE(driver.open());
+    ASSERT_TRUE(driver.limitSendBuffer()); // peer does not read, so frames stay queued
+
+    can::Frame sdo(can::MsgHeader(0x601), 8);
+    for(int i = 0; i < 100; ++i) ASSERT_TRUE(driver.send(sdo));
+    can::Statistics stats;
+    ASSERT_TRUE(driver.getStatistics(stats));
+    size_t queued = stats.tx_queue_depth[can::tx_sdo];
+    ASSERT_GT(queued, 0u);
+
+    close(driver.peer); // socket gets writable, the next write fails
+    driver.peer = -1;
+    EXPECT_TRUE(can::StateWaiter::wait_for(can::State::open, &driver, boost::posix_time::seconds(1)));
+    EXPECT_TRUE(driver.txQueue().empty()); // nothing stale is left for the time after recovery
+
+    ASSERT_TRUE(driver.getStatistics(stats));
+    EXPECT_EQ(queued, stats.tx_failures);
+    EXPECT_EQ(100u, stats.tx_frames); // accepted before
+}
+
+struct BatchSender{
+    can::DriverInterface &driver;
+    bool committed;
+    BatchSender(can::DriverInterface &d) : driver(d), committed(false) {}
+    void run(){
+        if(!driver.beginBatch()) return;
+        driver.send(can::Frame(can::MsgHeader(0x601), 8));
+        committed = driver.commitBatch();
+    }
+};
+
+TEST_F(SocketCANTest, blockedBatchDoesNotDelaySync)
+{
+    ASSERT_TRUE(driver.open());
+    ASSERT_TRUE(driver.limitSendBuffer()); // peer does not read, so the SDO queue fills up
+    driver.txQueue().configure(can::tx_sdo, 4, can::TxQueue::block);
+    driver.txQueue().setTimeout(boost::chrono::seconds(1));
+
+    can::Statistics stats;
+    for(int i = 0; i < 1000 && stats.tx_queue_depth[can::tx_sdo] < 4; ++i){
+        ASSERT_TRUE(driver.send(can::Frame(can::MsgHeader(0x601), 8)));
+        ASSERT_TRUE(driver.getStatistics(stats));
+    }
+    ASSERT_EQ(4u, stats.tx_queue_depth[can::tx_sdo]);
+
+    BatchSender sender(driver);
+    boost::thread thread(&BatchSender::run, &sender); // blocks in the SDO queue
+    usleep(100000);
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    EXPECT_TRUE(driver.send(can::Frame(can::MsgHeader(0x80))));
+    EXPECT_LT(boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - start).count(), 500);
+
+    thread.join();
+    EXPECT_FALSE(sender.committed); // timed out
+}
+
+struct StateCounter{
+    boost::atomic<size_t> open; ///< transitions to open
+    can::State::DriverState last;
+    StateCounter() : open(0), last(can::State::ready) {}
+    void count(const can::State &s){
+        if(s.driver_state == can::State::open && last != can::State::open) ++open;
+        last = s.driver_state;
+    }
+};
+
+TEST_F(SocketCANTest, recoversFromErrorFrames)
+{
+    ASSERT_TRUE(driver.open());
+    driver.enableRecovery(boost::posix_time::milliseconds(10), boost::posix_time::milliseconds(500));
+    StateCounter states;
+    can::StateInterface::StateListener::Ptr state_listener = driver.createStateListener(can::StateInterface::StateDelegate(&states, &StateCounter::count));
+
+    can_frame error = {0};
+    error.can_id = CAN_ERR_FLAG | CAN_ERR_ACK;
+    for(int i = 0; i < 10; ++i) ASSERT_TRUE(driver.write(error));
+    ASSERT_TRUE(wait(10));
+    EXPECT_EQ(1u, states.open); // the error storm is reported once
+    EXPECT_TRUE(can::StateWaiter::wait_for(can::State::ready, &driver, boost::posix_time::seconds(1)));
+    EXPECT_EQ(0u, driver.getState().internal_error);
+    EXPECT_TRUE(driver.send(can::Frame(can::MsgHeader(0x201), 2)));
+
+    // the socket pair cannot be restarted via netlink, so the driver waits for the kernel
+    error.can_id = CAN_ERR_FLAG | CAN_ERR_BUSOFF;
+    ASSERT_TRUE(driver.write(error));
+    ASSERT_TRUE(wait(11));
+    EXPECT_EQ(2u, states.open);
+    usleep(100000);
+    EXPECT_EQ(can::State::open, driver.getState().driver_state);
+
+    error.can_id = CAN_ERR_FLAG | CAN_ERR_RESTARTED;
+    ASSERT_TRUE(driver.write(error));
+    EXPECT_TRUE(can::StateWaiter::wait_for(can::State::ready, &driver, boost::posix_time::seconds(1)));
+    ASSERT_TRUE(wait(12));
+    EXPECT_EQ(2u, states.open);
+}
+
+struct ShutdownOnError{
+    can::DriverInterface &driver;
+    ShutdownOnError(can::DriverInterface &d) : driver(d) {}
+    void handle(const can::State &s){
+        if(s.internal_error) driver.shutdown();
+    }
+};
+
+TEST_F(SocketCANTest, stateListenerMayShutDownDuringRecovery)
+{
+    ASSERT_TRUE(driver.open());
+    driver.enableRecovery(boost::posix_time::milliseconds(10), boost::posix_time::milliseconds(500));
+    ShutdownOnError handler(driver);
+    can::StateInterface::StateListener::Ptr state_listener = driver.createStateListener(can::StateInterface::StateDelegate(&handler, &ShutdownOnError::handle));
+
+    can_frame error = {0};
+    error.can_id = CAN_ERR_FLAG | CAN_ERR_BUSOFF;
+    ASSERT_TRUE(driver.write(error));
+    EXPECT_TRUE(can::StateWaiter::wait_for(can::State::closed, &driver, boost::posix_time::seconds(1))); // no deadlock on the recovery lock
+    usleep(50000);
+    EXPECT_FALSE(driver.getState().isReady()); // the recovery timer was cancelled
+}
+
+struct Counter{
+    boost::atomic<size_t> num;
+    Counter() : num(0) {}
+    void count(const can::Frame &f) { ++num; }
+    bool wait(size_t n){
+        for(int i = 0; i < 10000 && num < n; ++i) usleep(1000);
+        return num >= n;
+    }
+};
+
+TEST(ReactorTest, driversShareIOThread)
+{
+    can::Reactor::Ptr reactor(new can::Reactor(1));
+    boost::scoped_ptr<PairedInterface> first(new PairedInterface(reactor));
+    PairedInterface second(reactor);
+    Counter first_counter, second_counter;
+    can::CommInterface::FrameListener::Ptr first_listener = first->createMsgListener(can::CommInterface::FrameDelegate(&first_counter, &Counter::count));
+    can::CommInterface::FrameListener::Ptr second_listener = second.createMsgListener(can::CommInterface::FrameDelegate(&second_counter, &Counter::count));
+    ASSERT_TRUE(first->open());
+    ASSERT_TRUE(second.open());
+
+    can_frame frame = {0};
+    frame.can_id = 0x181;
+    for(int i = 0; i < 100; ++i){
+        ASSERT_TRUE(first->write(frame));
+        ASSERT_TRUE(second.write(frame));
+    }
+    EXPECT_TRUE(first->send(can::Frame(can::MsgHeader(0x201))));
+    EXPECT_TRUE(first_counter.wait(100));
+    EXPECT_TRUE(second_counter.wait(100));
+
+    first.reset(); // waits for its handlers, the other driver keeps running
+    ASSERT_TRUE(second.write(frame));
+    EXPECT_TRUE(second_counter.wait(101));
+    EXPECT_TRUE(second.getState().isReady());
+    EXPECT_EQ(1u, reactor->getNumThreads());
+}
+
+TEST(TxQueueTest, blockPolicyTimesOut)
+{
+    can::TxQueue queue;
+    queue.configure(can::tx_sdo, 1, can::TxQueue::block);
+    queue.setTimeout(boost::chrono::milliseconds(20));
+
+    can::Frame sdo(can::MsgHeader(0x601), 8);
+    EXPECT_EQ(can::tx_sdo, can::txClass(sdo));
+    EXPECT_EQ(can::tx_sync, can::txClass(can::Frame(can::MsgHeader(0))));
+    EXPECT_EQ(can::tx_rpdo, can::txClass(can::Frame(can::MsgHeader(0x201))));
+    EXPECT_EQ(can::tx_other, can::txClass(can::Frame(can::MsgHeader(0x701))));
+
+    EXPECT_TRUE(queue.push(sdo));
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.push(sdo));
+    EXPECT_GE(boost::chrono::steady_clock::now() - start, boost::chrono::milliseconds(20));
+
+    boost::thread producer(boost::bind(&can::TxQueue::push, &queue, sdo, can::tx_sdo)); // blocks until the writer pops
+    can::Frame frames[4];
+    can::TxClass classes[4];
+    usleep(5000);
+    ASSERT_EQ(1u, queue.peek(frames, classes, 4));
+    queue.pop(classes, 1);
+    producer.join();
+    EXPECT_EQ(1u, queue.peek(frames, classes, 4));
+
+    can::Statistics stats;
+    queue.getStatistics(stats);
+    EXPECT_EQ(1u, stats.tx_dropped[can::tx_sdo]);
+
+    queue.close();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.push(sdo));
+}
+
+TEST(StatisticsTest, frameBits)
+{
+    EXPECT_EQ(53u, can::frameBits(can::Frame(can::MsgHeader(0), 0))); // 34 dominant bits get 6 stuff bits
+    EXPECT_EQ(0u, can::frameBits(can::Frame(can::ErrorHeader(0x40), 8)));
+
+    srand(42);
+    for(int i = 0; i < 1000; ++i){
+        bool extended = i % 2;
+        can::Frame f(can::Header(extended ? rand() & 0x1fffffff : rand() & 0x7ff, extended, false, false), rand() % 9);
+        for(size_t j = 0; j < f.dlc; ++j) f.data[j] = rand();
+        unsigned int nominal = (extended ? 67 : 47) + 8 * f.dlc;
+        unsigned int stuffable = nominal - 13; // stuffing stops after the CRC
+        unsigned int bits = can::frameBits(f);
+        EXPECT_GE(bits, nominal);
+        EXPECT_LE(bits, nominal + (stuffable - 1) / 4);
+    }
+}
+
+TEST(StatisticsTest, windowRates)
+{
+    can::StatisticsCounter counter;
+    counter.setBitrate(125000);
+    counter.setWindow(boost::chrono::milliseconds(50));
+
+    can::Frame f(can::MsgHeader(0), 0);
+    for(int i = 0; i < 50; ++i){
+        counter.countRx(f);
+        counter.countTx(f);
+    }
+    counter.countTxFailure();
+    counter.updateLatency(boost::chrono::milliseconds(5));
+    counter.updateLatency(boost::chrono::milliseconds(2));
+
+    can::Statistics stats;
+    counter.snapshot(stats);
+    EXPECT_EQ(50u, stats.rx_frames);
+    EXPECT_EQ(50u, stats.tx_frames);
+    EXPECT_EQ(1u, stats.tx_failures);
+    EXPECT_EQ(0, stats.window); // first window is not complete yet
+
+    usleep(60000);
+    counter.snapshot(stats);
+    ASSERT_GE(stats.window, 0.05);
+    EXPECT_DOUBLE_EQ(100 / stats.window, stats.frame_rate);
+    EXPECT_DOUBLE_EQ(100 * 53 / stats.window, stats.bit_rate);
+    EXPECT_DOUBLE_EQ(stats.bit_rate / 125000, stats.bus_load);
+    EXPECT_DOUBLE_EQ(0.005, stats.max_dispatch_latency);
+}
+
+class MapSettings : public can::Settings{
+    virtual bool getRepr(const std::string &n, std::string & repr) const {
+        std::map<std::string, std::string>::const_iterator it = values.find(n);
+        if(it == values.end()) return false;
+        repr = it->second;
+        return true;
+    }
+public:
+    std::map<std::string, std::string> values;
+};
+
+TEST(NetlinkTest, configMatchesLink)
+{
+    can::CANLinkInfo info;
+    info.is_can = true;
+    info.bitrate = 500000;
+    info.sample_point = 875;
+    info.restart_ms = 100;
+    info.txqueuelen = 10;
+
+    can::CANLinkConfig config;
+    EXPECT_TRUE(config.matches(info));
+    config.bitrate = 510000; // within the tolerance of the bit timing calculation
+    config.sample_point = 870;
+    config.restart_ms = 100;
+    EXPECT_TRUE(config.matches(info));
+    config.bitrate = 250000;
+    EXPECT_FALSE(config.matches(info));
+    config.bitrate = 500000;
+    config.txqueuelen = 100;
+    EXPECT_FALSE(config.matches(info));
+    config.txqueuelen = -1;
+    config.data_bitrate = 2000000;
+    EXPECT_FALSE(config.matches(info)); // CAN FD is not enabled
+
+    info.is_can = false; // virtual devices have no bit timing
+    EXPECT_TRUE(config.matches(info));
+}
+
+TEST(NetlinkTest, queryLoopback)
+{
+    can::CANNetlink netlink;
+    can::CANLinkInfo info;
+    boost::system::error_code ec;
+    ASSERT_TRUE(netlink.query("lo", info, ec)) << ec.message();
+    EXPECT_FALSE(info.is_can);
+    EXPECT_TRUE(info.up);
+    EXPECT_FALSE(netlink.query("no_such_device", info, ec));
+    EXPECT_TRUE(ec);
+}
+
+TEST(ThreadConfigTest, readAndApply)
+{
+    MapSettings settings;
+    can::ThreadConfig config;
+    EXPECT_TRUE(config.read(settings, "thread"));
+    EXPECT_EQ(-1, config.policy);
+    EXPECT_TRUE(config.cpus.empty());
+
+    settings.values["thread_policy"] = "fifo";
+    settings.values["thread_priority"] = "80";
+    settings.values["thread_cpus"] = "0,2-3";
+    EXPECT_TRUE(config.read(settings, "thread"));
+    EXPECT_EQ(SCHED_FIFO, config.policy);
+    EXPECT_EQ(80, config.priority);
+    ASSERT_EQ(3u, config.cpus.size());
+    EXPECT_EQ(3, config.cpus[2]);
+    EXPECT_EQ("fifo:80 cpus=0,2,3", config.str());
+
+    settings.values["thread_policy"] = "idle";
+    EXPECT_FALSE(config.read(settings, "thread"));
+    settings.values["thread_policy"] = "other";
+    settings.values["thread_cpus"] = "3-2";
+    EXPECT_FALSE(config.read(settings, "thread"));
+
+    can::ThreadConfig current = can::ThreadConfig::current();
+    ASSERT_FALSE(current.cpus.empty());
+    can::ThreadConfig pinned;
+    pinned.policy = SCHED_OTHER;
+    pinned.cpus.push_back(current.cpus.front());
+
+    boost::thread thread(&can::ThreadConfig::apply, pinned, "test");
+    thread.join();
+    can::ThreadConfig::StatusMap status = can::ThreadConfig::getStatus();
+    ASSERT_EQ(1u, status.count("test"));
+    EXPECT_TRUE(status["test"].ok);
+    EXPECT_EQ(pinned.str(), status["test"].effective);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+testing::InitGoogleTest(&argc, argv);
+return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+// Bring in my package's API, which is what I'm testing
+#include <socketcan_interface/virtual_bus.h>
+#include <socketcan_interface/string.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+class Recorder : public can::VirtualBus::Port{
+public:
+    std::vector<can::Frame> frames;
+    virtual void deliver(const can::Frame &msg, bool own){
+        frames.push_back(msg);
+    }
+    void handle(const can::Frame &msg){
+        frames.push_back(msg);
+    }
+};
+
+TEST(VirtualBusTest, arbitration)
+{
+    can::VirtualBus::Ptr bus = boost::make_shared<can::VirtualBus>(1000000, false);
+    Recorder a, b;
+    bus->attach(&a);
+    bus->attach(&b);
+
+    bus->submit(can::toframe("701#05"), &a);
+    bus->submit(can::toframe("181#0102"), &b);
+    bus->submit(can::toframe("080#"), &a);
+    bus->submit(can::toframe("181#0304"), &a);
+
+    can::VirtualBus::TimePoint start = bus->now();
+    while(bus->step()) {}
+    EXPECT_FALSE(bus->step());
+
+    ASSERT_EQ(4u, b.frames.size());
+    EXPECT_EQ(0x80u, b.frames[0].id);
+    EXPECT_EQ(0x181u, b.frames[1].id);
+    EXPECT_EQ(0x01, b.frames[1].data[0]);
+    EXPECT_EQ(0x181u, b.frames[2].id);
+    EXPECT_EQ(0x03, b.frames[2].data[0]); // same ID, submission order
+    EXPECT_EQ(0x701u, b.frames[3].id);
+    EXPECT_EQ(4u, a.frames.size());
+
+    // 47 bits + 8 per byte at 1 Mbit/s
+    EXPECT_EQ(boost::chrono::microseconds(47), b.frames[0].stamp - start);
+    EXPECT_EQ(boost::chrono::microseconds(47 + 63), b.frames[1].stamp - start);
+    EXPECT_EQ(bus->now(), b.frames[3].stamp);
+
+    can::VirtualBus::Stats stats = bus->getStats();
+    EXPECT_EQ(4u, stats.frames);
+    EXPECT_EQ(47u + 63 + 63 + 55, stats.bits);
+    EXPECT_EQ(4u, stats.max_pending);
+}
+
+TEST(VirtualBusTest, advance)
+{
+    can::VirtualBus::Ptr bus = boost::make_shared<can::VirtualBus>(500000, false);
+    Recorder r;
+    bus->attach(&r);
+    for(int i = 0; i < 10; ++i) bus->submit(can::toframe("123#1122334455667788"), 0); // 111 bits, 222 us
+
+    // frames that start within the period get transmitted
+    bus->advance(boost::chrono::microseconds(500));
+    EXPECT_EQ(3u, r.frames.size());
+    bus->advance(boost::chrono::microseconds(1000));
+    EXPECT_EQ(8u, r.frames.size()); // continues at the end of the third frame
+    bus->advance(boost::chrono::milliseconds(10));
+    EXPECT_EQ(10u, r.frames.size());
+
+    bus->detach(&r);
+    bus->submit(can::toframe("123#"), 0);
+    EXPECT_TRUE(bus->step());
+    EXPECT_EQ(10u, r.frames.size());
+}
+
+TEST(VirtualBusTest, interface)
+{
+    can::VirtualBus::Ptr bus = boost::make_shared<can::VirtualBus>(1000000, false);
+    can::VirtualInterface sender(bus), receiver(bus);
+    EXPECT_FALSE(sender.send(can::toframe("123#")));
+    EXPECT_TRUE(sender.init("vbus", false));
+    EXPECT_TRUE(receiver.init("vbus", false));
+
+    Recorder sent, received;
+    can::CommInterface::FrameListener::Ptr l1 = sender.createMsgListener(can::CommInterface::FrameDelegate(&sent, &Recorder::handle));
+    can::CommInterface::FrameListener::Ptr l2 = receiver.createMsgListener(can::CommInterface::FrameDelegate(&received, &Recorder::handle));
+
+    EXPECT_TRUE(sender.send(can::toframe("123#42")));
+    EXPECT_TRUE(bus->step());
+    EXPECT_EQ(0u, sent.frames.size()); // no loopback
+    ASSERT_EQ(1u, received.frames.size());
+    EXPECT_EQ(0x42, received.frames[0].data[0]);
+
+    receiver.shutdown();
+    EXPECT_FALSE(receiver.getState().isReady());
+    EXPECT_TRUE(sender.send(can::toframe("123#43")));
+    EXPECT_TRUE(bus->step());
+    EXPECT_EQ(1u, received.frames.size());
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+testing::InitGoogleTest(&argc, argv);
+return RUN_ALL_TESTS();
+}